@@ -246,12 +246,18 @@ httpd_appcall(void)
        into the file and send back more data. If we are out of data to
        send, we close the connection. */
     if(uip_acked()) {
+#if UIP_SEND_WINDOW > 1
+       /* The file went out as one stream, and all of it has been
+          acknowledged. */
+       hs->count = 0;
+#else /* UIP_SEND_WINDOW > 1 */
        if(hs->count >= uip_conn->len) {
           hs->count -= uip_conn->len;
           hs->dataptr += uip_conn->len;
        } else {
           hs->count = 0;
        }
+#endif /* UIP_SEND_WINDOW > 1 */
 
        if(hs->count == 0) {
           uip_close();
@@ -259,9 +265,16 @@ httpd_appcall(void)
     }         
 
     if(!uip_poll()) {
+#if UIP_SEND_WINDOW > 1
+      /* The files are in flash and the API answers stay put until
+         the next request, so uIP can keep several segments of them
+         in flight. */
+      uip_stream(hs->dataptr, hs->count);
+#else /* UIP_SEND_WINDOW > 1 */
       /* Send a piece of data, but not more than the MSS of the
 	 connection. */
       uip_send(hs->dataptr, hs->count);
+#endif /* UIP_SEND_WINDOW > 1 */
     }
 
     /* Finally, return to uIP. Our outgoing packet will soon be on its
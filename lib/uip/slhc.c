@@ -0,0 +1,448 @@
+/**
+ * \addtogroup slip
+ * @{
+ */
+
+/**
+ * \file
+ * Van Jacobson TCP/IP header compression (RFC 1144) for SLIP.
+ *
+ * Only the headers uIP itself sends are compressed: 20 bytes of IP
+ * and 20 bytes of TCP, with no options. Received headers are rebuilt
+ * in place in uip_buf.
+ */
+
+/*
+ * Copyright (c) 1989 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of California, Berkeley.  The name of the
+ * University may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Van Jacobson (van@helios.ee.lbl.gov), Dec 31, 1989:
+ *   - Initial distribution.
+ */
+
+#include "uip.h"
+#include "slhc.h"
+#include <string.h>
+
+#if SLIP_CSLIP
+
+/* Bits in the change mask, the first byte of a compressed header. */
+#define NEW_C 0x40
+#define NEW_I 0x20
+#define NEW_S 0x08
+#define NEW_A 0x04
+#define NEW_W 0x02
+#define NEW_U 0x01
+#define TCP_PUSH_BIT 0x10
+
+/* Change masks that can't happen, used for the two common cases. */
+#define SPECIAL_I     (NEW_S|NEW_W|NEW_U) /* echoed interactive traffic */
+#define SPECIAL_D     (NEW_S|NEW_A|NEW_W|NEW_U) /* unidirectional data */
+#define SPECIALS_MASK (NEW_S|NEW_A|NEW_W|NEW_U)
+
+/* IP header offsets. */
+#define IP_VHL    0
+#define IP_TOS    1
+#define IP_LEN    2
+#define IP_ID     4
+#define IP_OFFSET 6
+#define IP_TTL    8
+#define IP_PROTO  9
+#define IP_CHKSUM 10
+#define IP_ADDRS  12
+
+/* TCP header offsets, from the start of the TCP header. */
+#define TCP_PORTS  0
+#define TCP_SEQ    4
+#define TCP_ACK    8
+#define TCP_OFFSET 12
+#define TCP_FLAGS  13
+#define TCP_WND    14
+#define TCP_CHKSUM 16
+#define TCP_URGP   18
+
+#define TCP_FIN_FLAG 0x01
+#define TCP_SYN_FLAG 0x02
+#define TCP_RST_FLAG 0x04
+#define TCP_PSH_FLAG 0x08
+#define TCP_ACK_FLAG 0x10
+#define TCP_URG_FLAG 0x20
+
+#define IPH_LEN 20
+
+/* The last header sent or received on a connection. */
+struct slhc_slot {
+  u8_t hdr[SLHC_HDR_SIZE];
+  u8_t valid;
+};
+
+static struct slhc_slot tx[SLIP_CSLIP_SLOTS];
+static struct slhc_slot rx[SLIP_CSLIP_SLOTS];
+static u8_t tx_last, tx_next;
+static u8_t rx_last, rx_toss;
+
+/* Set once the peer has sent a CSLIP frame, nothing is compressed
+   before that. */
+static u8_t peer;
+
+/*-----------------------------------------------------------------------------------*/
+static u16_t
+get16(const u8_t *p)
+{
+  return ((u16_t)p[0] << 8) | p[1];
+}
+/*-----------------------------------------------------------------------------------*/
+static void
+put16(u8_t *p, u16_t n)
+{
+  p[0] = n >> 8;
+  p[1] = n;
+}
+/*-----------------------------------------------------------------------------------*/
+static uint32_t
+get32(const u8_t *p)
+{
+  return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+/*-----------------------------------------------------------------------------------*/
+static void
+put32(u8_t *p, uint32_t n)
+{
+  put16(p, n >> 16);
+  put16(p + 2, n);
+}
+/*-----------------------------------------------------------------------------------*/
+/* Deltas take one byte if they fit, else a zero and two bytes. */
+static u8_t *
+encode(u8_t *cp, u16_t n)
+{
+  if(n == 0 || n >= 256) {
+    *cp++ = 0;
+    *cp++ = n >> 8;
+  }
+  *cp++ = n;
+  return cp;
+}
+/*-----------------------------------------------------------------------------------*/
+static u16_t
+decode(const u8_t **cp)
+{
+  const u8_t *p = *cp;
+  u16_t n;
+
+  if(*p == 0) {
+    n = get16(p + 1);
+    *cp = p + 3;
+  } else {
+    n = *p;
+    *cp = p + 1;
+  }
+  return n;
+}
+/*-----------------------------------------------------------------------------------*/
+void
+slhc_init(void)
+{
+  memset(tx, 0, sizeof(tx));
+  memset(rx, 0, sizeof(rx));
+  tx_last = rx_last = 0xff;
+  tx_next = 0;
+  rx_toss = 1;
+  peer = 0;
+}
+/*-----------------------------------------------------------------------------------*/
+void
+slhc_toss(void)
+{
+  rx_toss = 1;
+}
+/*-----------------------------------------------------------------------------------*/
+u16_t
+slhc_compress(u8_t *out)
+{
+  u8_t *const ip = &uip_buf[UIP_LLH_LEN];
+  u8_t *const th = ip + IPH_LEN;
+  u8_t *oh, *ot, *o;
+  u8_t deltas[16];
+  u8_t *cp = deltas;
+  u8_t changes = 0;
+  u8_t i;
+  uint32_t deltaA, deltaS;
+  u16_t delta;
+
+  /* Only TCP segments that are part of a running connection. */
+  if(!peer || uip_len < SLHC_HDR_SIZE ||
+     ip[IP_VHL] != 0x45 || ip[IP_PROTO] != UIP_PROTO_TCP ||
+     (get16(&ip[IP_OFFSET]) & 0x3fff) != 0 ||
+     (th[TCP_OFFSET] >> 4) != 5 ||
+     (th[TCP_FLAGS] & (TCP_SYN_FLAG|TCP_FIN_FLAG|TCP_RST_FLAG|TCP_ACK_FLAG)) != TCP_ACK_FLAG) {
+    return 0;
+  }
+
+  for(i = 0; i < SLIP_CSLIP_SLOTS; ++i) {
+    if(tx[i].valid &&
+       memcmp(&tx[i].hdr[IP_ADDRS], &ip[IP_ADDRS], 8) == 0 &&
+       memcmp(&tx[i].hdr[IPH_LEN + TCP_PORTS], &th[TCP_PORTS], 4) == 0) {
+      break;
+    }
+  }
+  if(i == SLIP_CSLIP_SLOTS) {
+    /* A new connection takes over the slot after the last new one. */
+    i = tx_next;
+    tx_next = (tx_next + 1) % SLIP_CSLIP_SLOTS;
+    goto uncompressed;
+  }
+
+  oh = tx[i].hdr;
+  ot = oh + IPH_LEN;
+
+  /* Fields that are sent whole when they change. */
+  if(ip[IP_TOS] != oh[IP_TOS] || ip[IP_TTL] != oh[IP_TTL] ||
+     get16(&ip[IP_OFFSET]) != get16(&oh[IP_OFFSET])) {
+    goto uncompressed;
+  }
+
+  if(th[TCP_FLAGS] & TCP_URG_FLAG) {
+    cp = encode(cp, get16(&th[TCP_URGP]));
+    changes |= NEW_U;
+  } else if(get16(&th[TCP_URGP]) != get16(&ot[TCP_URGP])) {
+    goto uncompressed;
+  }
+
+  delta = get16(&th[TCP_WND]) - get16(&ot[TCP_WND]);
+  if(delta != 0) {
+    cp = encode(cp, delta);
+    changes |= NEW_W;
+  }
+
+  deltaA = get32(&th[TCP_ACK]) - get32(&ot[TCP_ACK]);
+  if(deltaA != 0) {
+    if(deltaA > 0xffff) {
+      goto uncompressed;
+    }
+    cp = encode(cp, deltaA);
+    changes |= NEW_A;
+  }
+
+  deltaS = get32(&th[TCP_SEQ]) - get32(&ot[TCP_SEQ]);
+  if(deltaS != 0) {
+    if(deltaS > 0xffff) {
+      goto uncompressed;
+    }
+    cp = encode(cp, deltaS);
+    changes |= NEW_S;
+  }
+
+  switch(changes) {
+  case 0:
+    /* Nothing changed: only an ACK after data is expected. Anything
+       else is a retransmission or window probe, and goes whole in
+       case the peer missed the compressed one. */
+    if(get16(&ip[IP_LEN]) != get16(&oh[IP_LEN]) &&
+       get16(&oh[IP_LEN]) == SLHC_HDR_SIZE) {
+      break;
+    }
+    /* FALLTHROUGH */
+  case SPECIAL_I:
+  case SPECIAL_D:
+    /* These would be read as the special cases. */
+    goto uncompressed;
+  case NEW_S|NEW_A:
+    if(deltaS == deltaA && deltaS == get16(&oh[IP_LEN]) - SLHC_HDR_SIZE) {
+      changes = SPECIAL_I;
+      cp = deltas;
+    }
+    break;
+  case NEW_S:
+    if(deltaS == get16(&oh[IP_LEN]) - SLHC_HDR_SIZE) {
+      changes = SPECIAL_D;
+      cp = deltas;
+    }
+    break;
+  }
+
+  delta = get16(&ip[IP_ID]) - get16(&oh[IP_ID]);
+  if(delta != 1) {
+    cp = encode(cp, delta);
+    changes |= NEW_I;
+  }
+  if(th[TCP_FLAGS] & TCP_PSH_FLAG) {
+    changes |= TCP_PUSH_BIT;
+  }
+
+  memcpy(oh, ip, SLHC_HDR_SIZE);
+
+  o = out;
+  if(tx_last != i) {
+    tx_last = i;
+    *o++ = SLHC_TYPE_COMPRESSED_TCP | NEW_C | changes;
+    *o++ = i;
+  } else {
+    *o++ = SLHC_TYPE_COMPRESSED_TCP | changes;
+  }
+  *o++ = th[TCP_CHKSUM];
+  *o++ = th[TCP_CHKSUM + 1];
+  memcpy(o, deltas, cp - deltas);
+  return (o - out) + (cp - deltas);
+
+ uncompressed:
+  /* The whole header, with the slot in place of the protocol. */
+  memcpy(tx[i].hdr, ip, SLHC_HDR_SIZE);
+  tx[i].valid = 1;
+  tx_last = i;
+  memcpy(out, ip, SLHC_HDR_SIZE);
+  out[IP_VHL] |= SLHC_TYPE_UNCOMPRESSED_TCP;
+  out[IP_PROTO] = i;
+  return SLHC_HDR_SIZE;
+}
+/*-----------------------------------------------------------------------------------*/
+u16_t
+slhc_uncompress(u16_t len)
+{
+  u8_t *const buf = &uip_buf[UIP_LLH_LEN];
+  const u8_t *cp;
+  u8_t *ip, *th;
+  u8_t changes, i;
+  u16_t hlen, n;
+  uint32_t sum;
+
+  if(len < 3) {
+    return len;
+  }
+
+  if(!(buf[0] & SLHC_TYPE_COMPRESSED_TCP)) {
+    if(buf[0] < SLHC_TYPE_UNCOMPRESSED_TCP) {
+      /* Plain IP. TCP the peer could have compressed means it has
+         stopped doing so, so stop too. */
+      if(buf[IP_PROTO] == UIP_PROTO_TCP && len >= SLHC_HDR_SIZE &&
+         (buf[IPH_LEN + TCP_FLAGS] &
+          (TCP_SYN_FLAG|TCP_FIN_FLAG|TCP_RST_FLAG|TCP_ACK_FLAG)) == TCP_ACK_FLAG) {
+        peer = 0;
+      }
+      return len;
+    }
+
+    /* Uncompressed TCP: put the protocol back and remember the
+       header. */
+    i = buf[IP_PROTO];
+    if(i >= SLIP_CSLIP_SLOTS || len < SLHC_HDR_SIZE) {
+      goto bad;
+    }
+    buf[IP_VHL] &= 0x4f;
+    buf[IP_PROTO] = UIP_PROTO_TCP;
+    hlen = ((buf[IP_VHL] & 0x0f) << 2);
+    hlen += (buf[hlen + TCP_OFFSET] >> 4) << 2;
+    /* Headers with options aren't kept, so the peer has to send the
+       next one whole too. */
+    rx[i].valid = (hlen == SLHC_HDR_SIZE);
+    memcpy(rx[i].hdr, buf, SLHC_HDR_SIZE);
+    rx_last = i;
+    rx_toss = 0;
+    peer = 1;
+    return len;
+  }
+
+  peer = 1;
+  cp = buf;
+  changes = *cp++;
+  if(changes & NEW_C) {
+    if(*cp >= SLIP_CSLIP_SLOTS) {
+      goto bad;
+    }
+    rx_last = *cp++;
+    rx_toss = 0;
+  } else if(rx_toss) {
+    /* Lost track of the connection, wait for a full header. */
+    return 0;
+  }
+  if(rx_last >= SLIP_CSLIP_SLOTS || !rx[rx_last].valid) {
+    goto bad;
+  }
+
+  ip = rx[rx_last].hdr;
+  th = ip + IPH_LEN;
+  th[TCP_CHKSUM] = cp[0];
+  th[TCP_CHKSUM + 1] = cp[1];
+  cp += 2;
+  if(changes & TCP_PUSH_BIT) {
+    th[TCP_FLAGS] |= TCP_PSH_FLAG;
+  } else {
+    th[TCP_FLAGS] &= ~TCP_PSH_FLAG;
+  }
+
+  switch(changes & SPECIALS_MASK) {
+  case SPECIAL_I:
+    n = get16(&ip[IP_LEN]) - SLHC_HDR_SIZE;
+    put32(&th[TCP_ACK], get32(&th[TCP_ACK]) + n);
+    put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + n);
+    break;
+  case SPECIAL_D:
+    n = get16(&ip[IP_LEN]) - SLHC_HDR_SIZE;
+    put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + n);
+    break;
+  default:
+    if(changes & NEW_U) {
+      th[TCP_FLAGS] |= TCP_URG_FLAG;
+      put16(&th[TCP_URGP], decode(&cp));
+    } else {
+      th[TCP_FLAGS] &= ~TCP_URG_FLAG;
+    }
+    if(changes & NEW_W) {
+      put16(&th[TCP_WND], get16(&th[TCP_WND]) + decode(&cp));
+    }
+    if(changes & NEW_A) {
+      put32(&th[TCP_ACK], get32(&th[TCP_ACK]) + decode(&cp));
+    }
+    if(changes & NEW_S) {
+      put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + decode(&cp));
+    }
+    break;
+  }
+  if(changes & NEW_I) {
+    put16(&ip[IP_ID], get16(&ip[IP_ID]) + decode(&cp));
+  } else {
+    put16(&ip[IP_ID], get16(&ip[IP_ID]) + 1);
+  }
+
+  /* Swap the compressed header for the full one. */
+  hlen = cp - buf;
+  if(hlen > len || len - hlen + SLHC_HDR_SIZE > UIP_BUFSIZE) {
+    goto bad;
+  }
+  n = len - hlen + SLHC_HDR_SIZE;
+  put16(&ip[IP_LEN], n);
+
+  put16(&ip[IP_CHKSUM], 0);
+  sum = 0;
+  for(i = 0; i < IPH_LEN; i += 2) {
+    sum += get16(&ip[i]);
+  }
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum += sum >> 16;
+  put16(&ip[IP_CHKSUM], ~sum);
+
+  memmove(&buf[SLHC_HDR_SIZE], &buf[hlen], len - hlen);
+  memcpy(buf, ip, SLHC_HDR_SIZE);
+  return n;
+
+ bad:
+  rx_toss = 1;
+  return 0;
+}
+/*-----------------------------------------------------------------------------------*/
+
+#endif /* SLIP_CSLIP */
+
+/** @} */
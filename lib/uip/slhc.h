@@ -0,0 +1,86 @@
+/**
+ * \addtogroup slip
+ * @{
+ */
+
+/**
+ * \file
+ * Van Jacobson TCP/IP header compression (RFC 1144) for SLIP.
+ */
+
+/*
+ * Copyright (c) 1989 Regents of the University of California.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of California, Berkeley.  The name of the
+ * University may not be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Van Jacobson (van@helios.ee.lbl.gov), Dec 31, 1989:
+ *   - Initial distribution.
+ *
+ * Rewritten for uIP: header fields are accessed by offset, TCP
+ * headers with options are only ever received, never compressed.
+ */
+
+#ifndef __SLHC_H__
+#define __SLHC_H__
+
+#include "uip.h"
+
+/* Packet types, from the top bits of the first byte of a frame. */
+#define SLHC_TYPE_IP               0x40
+#define SLHC_TYPE_UNCOMPRESSED_TCP 0x70
+#define SLHC_TYPE_COMPRESSED_TCP   0x80
+
+/* Size of the IP and TCP headers uIP sends, which is what gets
+   compressed. */
+#define SLHC_HDR_SIZE 40
+
+/**
+ * Forget all connection state.
+ */
+void slhc_init(void);
+
+/**
+ * Compress the header of the packet in uip_buf.
+ *
+ * The header itself is left alone, what to send in place of its
+ * first #SLHC_HDR_SIZE bytes is put in out.
+ *
+ * \param out Buffer of #SLHC_HDR_SIZE bytes for the header to send.
+ *
+ * \return The number of bytes in out, or 0 if the packet is to be
+ * sent as it is.
+ */
+u16_t slhc_compress(u8_t *out);
+
+/**
+ * Rebuild the IP packet from a received frame in uip_buf, in place.
+ *
+ * \param len The length of the frame.
+ *
+ * \return The length of the IP packet, or 0 if the frame has to be
+ * dropped.
+ */
+u16_t slhc_uncompress(u16_t len);
+
+/**
+ * Drop compressed frames until the peer resends a full header.
+ *
+ * Called when a frame is lost on the link, since the next compressed
+ * frame would decode against the wrong header.
+ */
+void slhc_toss(void);
+
+#endif /* __SLHC_H__ */
+
+/** @} */
@@ -12,9 +12,14 @@
  * and is therefore not very widely used today.
  *
  * This SLIP implementation requires two functions for accessing the
- * serial device: slipdev_char_poll() and slipdev_char_put(). These
- * must be implemented specifically for the system on which the SLIP
- * protocol is to be run.
+ * serial device: slipdev_read() and slipdev_write(). These must be
+ * implemented specifically for the system on which the SLIP protocol
+ * is to be run.
+ *
+ * With SLIP_COBS the frames are encoded with Consistent Overhead
+ * Byte Stuffing instead of SLIP escapes: zero is the only byte that
+ * needs attention, it ends a frame, and the encoding grows the frame
+ * by at most one byte in 254 (SLIP may double it).
  */
 
 /**
@@ -68,6 +73,7 @@
 
 #include "uip.h"
 #include "slipdev.h"
+#include "slhc.h"
 #include <string.h>
 
 #define SLIP_END     0300
@@ -75,127 +81,415 @@
 #define SLIP_ESC_END 0334
 #define SLIP_ESC_ESC 0335
 
+/* Escape pairs written in one go when escaped bytes come back to
+   back, from the stack. */
+#ifndef SLIP_TX_ESC_PAIRS
+#define SLIP_TX_ESC_PAIRS 16
+#endif
+
+/* Word at a time escape scan: a word holds an END or ESC byte iff
+   (word ^ 0xC0C0C0C0) or (word ^ 0xDBDBDBDB) has a zero byte. The
+   zero byte test is exact, there are no false hits. */
+typedef uint32_t __attribute__((may_alias)) slip_word_t;
+#define SLIP_WORD_ONES  0x01010101UL
+#define SLIP_WORD_HIGHS 0x80808080UL
+#define SLIP_WORD_END   (SLIP_END * SLIP_WORD_ONES)
+#define SLIP_WORD_ESC   (SLIP_ESC * SLIP_WORD_ONES)
+#define SLIP_WORD_HASZERO(w) (((w) - SLIP_WORD_ONES) & ~(w) & SLIP_WORD_HIGHS)
+
+#if SLIP_COBS
+/* COBS frames end with a zero byte, and no other byte in the frame is
+   zero. */
+#define SLIP_DELIM 0
+#define SLIP_SPECIAL(c) ((c) == 0)
+#define SLIP_WORD_SPECIAL(w) SLIP_WORD_HASZERO(w)
+
+/* Longest run of non-zero bytes a code byte can stand for. */
+#define COBS_MAX_RUN 254
+
+/* Code bytes and runs shorter than this are put together on the
+   stack, and written with the next long run. */
+#ifndef SLIP_TX_COBS_STAGE
+#define SLIP_TX_COBS_STAGE 32
+#endif
+#else
+#define SLIP_DELIM SLIP_END
+#define SLIP_SPECIAL(c) ((c) == SLIP_END || (c) == SLIP_ESC)
+#define SLIP_WORD_SPECIAL(w) (SLIP_WORD_HASZERO((w) ^ SLIP_WORD_END) | \
+                              SLIP_WORD_HASZERO((w) ^ SLIP_WORD_ESC))
+#endif /* SLIP_COBS */
+
+/* Size of a read between frames. Big enough for a bare TCP ACK or
+   SYN, so those only take one read; larger frames take a second read
+   sized from their IP length. */
+#ifndef SLIP_RX_PROBE_SIZE
+#define SLIP_RX_PROBE_SIZE 64
+#endif
+
+/* Extra bytes asked for on top of the rest of a frame, so a few
+   escaped bytes don't cost another read. */
+#ifndef SLIP_RX_ESC_SLACK
+#define SLIP_RX_ESC_SLACK 8
+#endif
+
+/* Frames are decoded straight into uip_buf. */
 static u16_t len=0;
 static u16_t tmplen = 0;
 static u8_t lastc = 0;
+static u8_t dropping = 0;
+#if SLIP_COBS
+/* Bytes left in the current COBS block, and if a zero follows it. */
+static u8_t cobs_left = 0;
+static u8_t cobs_zero = 0;
+#endif /* SLIP_COBS */
+
+/* Raw bytes are read into uip_buf right after the decoded ones, and
+   decoded in place: a raw byte never decodes to more than one byte,
+   so len <= rx_pos always holds. */
+static u16_t rx_len = 0;
+static u16_t rx_pos = 0;
+
+/* Raw bytes read past the END of a frame. uIP builds its reply in
+   uip_buf, so they are moved out of the way until the next poll. The
+   read sizes in slipdev_rx_want() keep them from overflowing this. */
+static u8_t carry[SLIP_RX_PROBE_SIZE];
+static u16_t carry_len = 0;
+static u16_t carry_pos = 0;
+
+#if SLIP_STATISTICS == 1
+struct slipdev_stats slipdev_stat;
+#define SLIP_STAT(s) s
+#else
+#define SLIP_STAT(s)
+#endif /* SLIP_STATISTICS == 1 */
+
+/*-----------------------------------------------------------------------------------*/
+/* Count the bytes at ptr that need no escaping (with COBS, that
+   aren't zero), at most n. */
+static u16_t
+slipdev_clean(const u8_t *ptr, u16_t n)
+{
+  const u8_t *p = ptr;
+  const u8_t *const stop = ptr + n;
+  slip_word_t w;
+
+  /* A byte at a time up to a word boundary, the M0+ can't do
+     unaligned loads and uip_appdata may point anywhere in flash. */
+  while(p < stop && ((uintptr_t)p & 3) != 0) {
+    if(SLIP_SPECIAL(*p)) {
+      return p - ptr;
+    }
+    ++p;
+  }
+
+  while(stop - p >= 4) {
+    w = *(const slip_word_t *)p;
+    if(SLIP_WORD_SPECIAL(w)) {
+      break;
+    }
+    p += 4;
+  }
 
+  /* The tail, or the word with the byte to escape in it. */
+  while(p < stop && !SLIP_SPECIAL(*p)) {
+    ++p;
+  }
+  return p - ptr;
+}
+/*-----------------------------------------------------------------------------------*/
+#if SLIP_COBS
+/* Write the packet as COBS blocks: a code byte, then up to 254 bytes
+   that aren't zero. The code is one more than their count and stands
+   for the zero after them, except in a full block or the last one.
+   The packet comes in two parts, the header and the data, and a block
+   may span both. Long runs go to the device straight from the packet,
+   code bytes and short runs are put together here. */
+static void
+slipdev_send_cobs(const u8_t *a, u16_t alen, const u8_t *b, u16_t blen)
+{
+  u8_t stage[SLIP_TX_COBS_STAGE];
+  u8_t staged = 0;
+  const u8_t *run[2];
+  u16_t n[2];
+  u8_t i;
+
+  for(;;) {
+    /* Zeros back to back are a code byte each. */
+    while((alen > 0 && *a == 0) || (alen == 0 && blen > 0 && *b == 0)) {
+      if(staged == sizeof(stage)) {
+        slipdev_write(stage, staged);
+        staged = 0;
+      }
+      stage[staged++] = 1;
+      if(alen > 0) {
+        ++a;
+        --alen;
+      } else {
+        ++b;
+        --blen;
+      }
+    }
+
+    run[0] = a;
+    n[0] = slipdev_clean(a, alen < COBS_MAX_RUN ? alen : COBS_MAX_RUN);
+    run[1] = b;
+    n[1] = 0;
+    if(n[0] == alen) {
+      n[1] = slipdev_clean(b, blen < COBS_MAX_RUN - n[0] ?
+                           blen : COBS_MAX_RUN - n[0]);
+    }
+
+    if(staged == sizeof(stage)) {
+      slipdev_write(stage, staged);
+      staged = 0;
+    }
+    stage[staged++] = n[0] + n[1] + 1;
+    for(i = 0; i < 2; ++i) {
+      if(n[i] == 0) {
+        continue;
+      } else if(n[i] < sizeof(stage) / 2) {
+        if(staged + n[i] > sizeof(stage)) {
+          slipdev_write(stage, staged);
+          staged = 0;
+        }
+        memcpy(&stage[staged], run[i], n[i]);
+        staged += n[i];
+      } else {
+        slipdev_write(stage, staged);
+        staged = 0;
+        slipdev_write(run[i], n[i]);
+      }
+    }
+    a += n[0];
+    alen -= n[0];
+    b += n[1];
+    blen -= n[1];
+
+    if(n[0] + n[1] == COBS_MAX_RUN) {
+      /* A full block, no zero after it. */
+      if(alen + blen == 0) {
+        break;
+      }
+    } else if(alen > 0) {
+      /* Skip the zero the code stands for. */
+      ++a;
+      --alen;
+    } else if(blen > 0) {
+      ++b;
+      --blen;
+    } else {
+      break;
+    }
+  }
+  if(staged > 0) {
+    slipdev_write(stage, staged);
+  }
+}
+#else /* SLIP_COBS */
+/* Write a run of packet bytes, escaping as needed. Unescaped runs go
+   to the device straight from the packet, only the escape pairs are
+   put together here, a few at a time. */
+static void
+slipdev_send_run(const u8_t *ptr, u16_t n)
+{
+  u8_t esc[SLIP_TX_ESC_PAIRS * 2];
+  u16_t run;
+  u8_t i;
+
+  while(n > 0) {
+    run = slipdev_clean(ptr, n);
+    if(run > 0) {
+      slipdev_write(ptr, run);
+      ptr += run;
+      n -= run;
+    }
+    for(i = 0; n > 0 && i < sizeof(esc) &&
+          (*ptr == SLIP_END || *ptr == SLIP_ESC); i += 2) {
+      esc[i] = SLIP_ESC;
+      esc[i + 1] = (*ptr == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+      ++ptr;
+      --n;
+    }
+    if(i > 0) {
+      slipdev_write(esc, i);
+    }
+  }
+}
+#endif /* SLIP_COBS */
 /*-----------------------------------------------------------------------------------*/
 /**
  * Send the packet in the uip_buf and uip_appdata buffers using the
- * SLIP protocol.
+ * SLIP protocol, or COBS with SLIP_COBS.
  *
  * The first 40 bytes of the packet (the IP and TCP headers) are read
  * from the uip_buf buffer, and the following bytes (the application
  * data) are read from the uip_appdata buffer.
  *
+ * Nothing is copied here: the packet is handed to slipdev_write() in
+ * runs between the bytes that need escaping (or the zeros, with
+ * COBS), and slipdev_flush() is
+ * called at the end of the frame. With SLIP_CSLIP the header may be
+ * swapped for a compressed one on the way.
  */
 /*-----------------------------------------------------------------------------------*/
-#if 0 // this send 1 char at a time
 void
 slipdev_send(void)
 {
-  u16_t i;
-  u8_t *ptr;
-  u8_t c;
+  static const u8_t end = SLIP_DELIM;
+  const u8_t *hdr = uip_buf;
+  u16_t hlen = uip_len < 40 ? uip_len : 40;
+#if SLIP_CSLIP
+  u8_t chdr[SLHC_HDR_SIZE];
+  u16_t clen;
 
-  slipdev_char_put(SLIP_END);
-
-  ptr = uip_buf;
-  for(i = 0; i < uip_len; ++i) {
-    if(i == 40) {
-      ptr = (char *)uip_appdata;
+  clen = slhc_compress(chdr);
+  if(clen > 0) {
+    if(chdr[0] & SLHC_TYPE_COMPRESSED_TCP) {
+      SLIP_STAT(++slipdev_stat.cslip_out);
     }
-    c = *ptr++;
-    switch(c) {
-    case SLIP_END:
-      slipdev_char_put(SLIP_ESC);
-      slipdev_char_put(SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slipdev_char_put(SLIP_ESC);
-      slipdev_char_put(SLIP_ESC_ESC);
-      break;
-    default:
-      slipdev_char_put(c);
-      break;
+    hdr = chdr;
+    hlen = clen;
+  }
+#endif /* SLIP_CSLIP */
+
+  slipdev_write(&end, 1);
+#if SLIP_COBS
+  slipdev_send_cobs(hdr, hlen, (u8_t *)uip_appdata,
+                    uip_len > 40 ? uip_len - 40 : 0);
+#else /* SLIP_COBS */
+  slipdev_send_run(hdr, hlen);
+  if(uip_len > 40) {
+    slipdev_send_run((u8_t *)uip_appdata, uip_len - 40);
+  }
+#endif /* SLIP_COBS */
+  slipdev_write(&end, 1);
+  slipdev_flush();
+}
+/*-----------------------------------------------------------------------------------*/
+/* Give up on the frame being received and skip to its END. */
+static void
+slipdev_drop(void)
+{
+  len = 0;
+  dropping = 1;
+#if SLIP_CSLIP
+  slhc_toss();
+#endif /* SLIP_CSLIP */
+}
+/*-----------------------------------------------------------------------------------*/
+/* How many bytes to ask the device for, given the decoder state. */
+static u16_t
+slipdev_rx_want(void)
+{
+  u16_t iplen;
+
+#if SLIP_CSLIP
+  /* A compressed header says nothing about the length. */
+  if(len >= 1 && (uip_buf[0] & SLHC_TYPE_COMPRESSED_TCP)) {
+    return SLIP_RX_PROBE_SIZE;
+  }
+#endif /* SLIP_CSLIP */
+  if(len >= 4) {
+    iplen = ((u16_t)uip_buf[2] << 8) | uip_buf[3];
+    if(iplen > UIP_BUFSIZE) {
+      /* Known to be too big before it is all in. */
+      SLIP_STAT(++slipdev_stat.oversize);
+      slipdev_drop();
+      return SLIP_RX_PROBE_SIZE;
     }
+    /* Ask for the rest of the frame and the END marker. */
+    return (iplen > len) ? iplen - len + 1 + SLIP_RX_ESC_SLACK : 1 + SLIP_RX_ESC_SLACK;
   }
-  slipdev_char_put(SLIP_END);
+
+  /* Between frames or before the IP length is in: probe. */
+  return SLIP_RX_PROBE_SIZE;
 }
-#else
-#define SLIP_BUFFER_SIZE UIP_BUFSIZE + 64
-void
-slipdev_send(void)
+/*-----------------------------------------------------------------------------------*/
+#if SLIP_COBS
+/* Decode raw bytes into uip_buf, stopping after a zero that completes
+   a frame. Returns the number of bytes consumed, and sets *end if a
+   frame is complete.
+
+   The zero a code byte stands for is only written when the next code
+   byte shows it wasn't the end of the frame, so the output never gets
+   ahead of the input and the frame can be decoded in place. */
+static u16_t
+slipdev_decode(const u8_t *raw, u16_t n, u8_t *end)
 {
-  u16_t i;
-  u8_t *ptr;
+  u16_t i = 0;
+  u16_t run;
   u8_t c;
-  static u8_t slip_tx_buf[SLIP_BUFFER_SIZE];
-  u16_t buf_pos = 0;
-  
-  // Add starting SLIP_END
-  slip_tx_buf[buf_pos++] = SLIP_END;
-
-  ptr = uip_buf;
-  for(i = 0; i < uip_len; ++i) {
-    if(i == 40) {
-      ptr = (u8_t *)uip_appdata;
+
+  while(i < n) {
+    c = raw[i];
+
+    if(c == SLIP_DELIM) {
+      ++i;
+      if(dropping) {
+        /* End of the frame being skipped. */
+        dropping = 0;
+      } else if(cobs_left > 0) {
+        /* Cut short, the rest of the block is missing. */
+        len = 0;
+      } else if(len > 0) {
+        cobs_zero = 0;
+        *end = 1;
+        return i;
+      }
+      cobs_left = 0;
+      cobs_zero = 0;
+      continue;
     }
-    c = *ptr++;
-    
-    // Check if we need space for worst case (2 bytes for escaped char)
-    if (buf_pos >= SLIP_BUFFER_SIZE - 2) {
-      slipdev_write(slip_tx_buf, buf_pos);
-      buf_pos = 0;
+
+    if(dropping) {
+      ++i;
+      continue;
     }
-    
-    switch(c) {
-    case SLIP_END:
-      slip_tx_buf[buf_pos++] = SLIP_ESC;
-      slip_tx_buf[buf_pos++] = SLIP_ESC_END;
-      break;
-    case SLIP_ESC:
-      slip_tx_buf[buf_pos++] = SLIP_ESC;
-      slip_tx_buf[buf_pos++] = SLIP_ESC_ESC;
-      break;
-    default:
-      slip_tx_buf[buf_pos++] = c;
-      break;
+
+    if(cobs_left > 0) {
+      /* Copy the rest of the block, up to a zero if it is cut short. */
+      run = slipdev_clean(&raw[i], cobs_left < n - i ? cobs_left : n - i);
+      if(run > UIP_BUFSIZE - len) {
+        /* No room for the rest, drop the whole frame. */
+        SLIP_STAT(++slipdev_stat.oversize);
+        slipdev_drop();
+        continue;
+      }
+      memmove(&uip_buf[len], &raw[i], run);
+      len += run;
+      cobs_left -= run;
+      i += run;
+      continue;
     }
+
+    /* A code byte, so the last block wasn't the end of the frame. */
+    ++i;
+    if(cobs_zero) {
+      if(len == UIP_BUFSIZE) {
+        SLIP_STAT(++slipdev_stat.oversize);
+        slipdev_drop();
+        continue;
+      }
+      uip_buf[len++] = 0;
+    }
+    cobs_left = c - 1;
+    cobs_zero = (c != 0xFF);
   }
-  
-  // Add ending SLIP_END
-  if (buf_pos >= SLIP_BUFFER_SIZE) {
-    slipdev_write(slip_tx_buf, buf_pos);
-    buf_pos = 0;
-  }
-  slip_tx_buf[buf_pos++] = SLIP_END;
-  
-  // Send remaining bytes
-  slipdev_write(slip_tx_buf, buf_pos);
+  return n;
 }
-#endif
-/*-----------------------------------------------------------------------------------*/
-/** 
- * Poll the SLIP device for an available packet.
- *
- * This function will poll the SLIP device to see if a packet is
- * available. It uses a buffer in which all avaliable bytes from the
- * RS232 interface are read into. When a full packet has been read
- * into the buffer, the packet is copied into the uip_buf buffer and
- * the length of the packet is returned.
- *
- * \return The length of the packet placed in the uip_buf buffer, or
- * zero if no packet is available.
- */
-/*-----------------------------------------------------------------------------------*/
-u16_t
-slipdev_poll(void)
+#else /* SLIP_COBS */
+/* Decode raw bytes into uip_buf, stopping after an END that completes
+   a frame. Returns the number of bytes consumed, and sets *end if a
+   frame is complete. */
+static u16_t
+slipdev_decode(const u8_t *raw, u16_t n, u8_t *end)
 {
+  u16_t i;
   u8_t c;
-  static u8_t slip_buf[UIP_BUFSIZE];
-  
-  while(slipdev_char_poll(&c)) {
+
+  for(i = 0; i < n; ++i) {
+     c = raw[i];
+
      switch(c) {
         case SLIP_ESC:
            lastc = c;
@@ -203,12 +497,14 @@ slipdev_poll(void)
 
         case SLIP_END:
            lastc = c;
-           /* End marker found, we copy our input buffer to the uip_buf
-              buffer and return the size of the packet we copied. */
-           memcpy(uip_buf, slip_buf, len);
-           tmplen = len;
-           len = 0;
-           return tmplen;
+           if(dropping) {
+              /* End of the frame being skipped. */
+              dropping = 0;
+           } else if(len > 0) {
+              *end = 1;
+              return i + 1;
+           }
+           break;
 
         default:     
            if(lastc == SLIP_ESC) {
@@ -227,16 +523,145 @@ slipdev_poll(void)
               lastc = c;
            }
 
-           slip_buf[len] = c;
+           if(dropping) {
+              break;
+           }
+           if(len == UIP_BUFSIZE) {
+              /* No room for the rest, drop the whole frame. */
+              SLIP_STAT(++slipdev_stat.oversize);
+              slipdev_drop();
+              break;
+           }
+           uip_buf[len] = c;
            ++len;
+           break;
+     }
+  }
+  return n;
+}
+#endif /* SLIP_COBS */
+/*-----------------------------------------------------------------------------------*/
+/** 
+ * Poll the SLIP device for an available packet.
+ *
+ * This function will poll the SLIP device to see if a packet is
+ * available. Bytes are read from the RS232 interface a block at a
+ * time, straight into the uip_buf buffer, with the size of each read
+ * picked from how much of the current frame is missing. They are
+ * decoded in place, and when a full packet has been decoded its
+ * length is returned.
+ *
+ * Frames too big for uip_buf are dropped and counted.
+ *
+ * \return The length of the packet placed in the uip_buf buffer, or
+ * zero if no packet is available.
+ */
+/*-----------------------------------------------------------------------------------*/
+u16_t
+slipdev_poll(void)
+{
+  u8_t end = 0;
+  u16_t n;
 
-           if(len > UIP_BUFSIZE) {
-              len = 0;
-           }
+  for(;;) {
+     if(carry_pos < carry_len) {
+        /* What was read past the last frame comes first. */
+        carry_pos += slipdev_decode(&carry[carry_pos], carry_len - carry_pos, &end);
+        if(end) {
            break;
+        }
+        continue;
+     }
+
+     if(rx_pos == rx_len) {
+        /* Everything read so far is decoded, get the next block. */
+        n = slipdev_rx_want();
+        if(len == UIP_BUFSIZE) {
+           /* A full sized frame still waiting for its END. */
+           carry_pos = 0;
+           carry_len = slipdev_read(carry, n < sizeof(carry) ? n : sizeof(carry));
+           n = carry_len;
+        } else {
+           if(n > UIP_BUFSIZE - len) {
+              n = UIP_BUFSIZE - len;
+           }
+           rx_pos = rx_len = len;
+           rx_len += slipdev_read(&uip_buf[len], n);
+           n = rx_len - rx_pos;
+        }
+        if(n == 0) {
+           return 0;
+        }
+        SLIP_STAT(++slipdev_stat.reads);
+        SLIP_STAT(slipdev_stat.bytes += n);
+        continue;
      }
+
+     rx_pos += slipdev_decode(&uip_buf[rx_pos], rx_len - rx_pos, &end);
+     if(end) {
+        /* Save what was read past the END before uIP overwrites it. */
+        n = rx_len - rx_pos;
+        if(n > sizeof(carry)) {
+           /* Only a corrupt IP length gets here. The next frame is
+              cut short, so skip it. */
+           SLIP_STAT(++slipdev_stat.aborted);
+           dropping = 1;
+           n = 0;
+        }
+        memcpy(carry, &uip_buf[rx_pos], n);
+        carry_pos = 0;
+        carry_len = n;
+        rx_pos = rx_len = 0;
+        break;
+     }
+  }
+
+  tmplen = len;
+  len = 0;
+#if SLIP_CSLIP
+  if(uip_buf[0] & SLHC_TYPE_COMPRESSED_TCP) {
+    SLIP_STAT(++slipdev_stat.cslip_in);
+  }
+  tmplen = slhc_uncompress(tmplen);
+  if(tmplen == 0) {
+    SLIP_STAT(++slipdev_stat.tossed);
+    return 0;
+  }
+#endif /* SLIP_CSLIP */
+  SLIP_STAT(++slipdev_stat.frames);
+  return tmplen;
+}
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Check if a frame is being received.
+ *
+ * The partly decoded frame is in uip_buf, so nothing else may use
+ * uip_buf until slipdev_poll() has returned it, or slipdev_abort()
+ * has been called.
+ *
+ * \return Non-zero if uip_buf holds part of a frame.
+ */
+/*-----------------------------------------------------------------------------------*/
+u8_t
+slipdev_busy(void)
+{
+  return len > 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Abort the frame being received, if any.
+ *
+ * The rest of the frame is skipped when it arrives, and uip_buf is
+ * free to use.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+slipdev_abort(void)
+{
+  if(len > 0) {
+    SLIP_STAT(++slipdev_stat.aborted);
+    slipdev_drop();
   }
-  return 0;
 }
 /*-----------------------------------------------------------------------------------*/
 /**
@@ -250,6 +675,15 @@ void
 slipdev_init(void)
 {
   lastc = len = 0;
+  dropping = 0;
+#if SLIP_COBS
+  cobs_left = cobs_zero = 0;
+#endif /* SLIP_COBS */
+  rx_len = rx_pos = 0;
+  carry_len = carry_pos = 0;
+#if SLIP_CSLIP
+  slhc_init();
+#endif /* SLIP_CSLIP */
 }
 /*-----------------------------------------------------------------------------------*/
 
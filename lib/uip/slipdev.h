@@ -49,41 +49,76 @@
 #include "uip.h"
 
 /**
- * Put a character on the serial device.
+ * Write a block of bytes to the serial device.
  *
- * This function is used by the SLIP implementation to put a character
- * on the serial device. It must be implemented specifically for the
- * system on which the SLIP implementation is to be run.
+ * This function is used by the SLIP implementation to send encoded
+ * data, a run of bytes at a time. It must be implemented specifically
+ * for the system on which the SLIP implementation is to be run. It
+ * may hold on to the data until slipdev_flush() is called, but must
+ * not keep the pointer: the data may be in uip_buf.
  *
- * \param c The character to be put on the serial device.
+ * \param buf A pointer to the data to be written.
+ *
+ * \param len The number of bytes to write.
  */
-void slipdev_char_put(u8_t c);
+void slipdev_write(const u8_t *buf, u16_t len);
 
-void slipdev_write(uint8_t *buf, uint16_t len);
+/**
+ * Mark the end of a frame written with slipdev_write().
+ *
+ * This function is called by the SLIP implementation at the end of
+ * every frame. It may push the data out to the serial device, and
+ * block until it has been sent, or hold on to it so that several
+ * frames go out together; the application must then send them
+ * itself before it waits for input.
+ */
+void slipdev_flush(void);
 
 /**
- * Poll the serial device for a character.
+ * Read a block of bytes from the serial device.
  *
  * This function is used by the SLIP implementation to poll the serial
- * device for a character. It must be implemented specifically for the
- * system on which the SLIP implementation is to be run.
+ * device for received data. It must be implemented specifically for
+ * the system on which the SLIP implementation is to be run.
+ *
+ * The function should return immediately regardless if data is
+ * available or not.
  *
- * The function should return immediately regardless if a character is
- * available or not. If a character is available it should be placed
- * at the memory location pointed to by the pointer supplied by the
- * arguement c.
+ * \param buf A pointer to the buffer that is filled in with the
+ * received data.
  *
- * \param c A pointer to a byte that is filled in by the function with
- * the received character, if available.
+ * \param len The maximum number of bytes to read.
  *
- * \retval 0 If no character is available.
- * \retval Non-zero If a character is available.
+ * \return The number of bytes read, 0 if none are available.
  */
-u8_t slipdev_char_poll(u8_t *c);
+u16_t slipdev_read(u8_t *buf, u16_t len);
+
+/**
+ * The SLIP receive statistics that are gathered if SLIP_STATISTICS
+ * is set to 1.
+ */
+struct slipdev_stats {
+  uint32_t reads;  /**< Number of reads that returned data. */
+  uint32_t bytes;  /**< Number of bytes read, before decoding. */
+  uint32_t frames; /**< Number of frames passed up to uIP. */
+  uint32_t oversize; /**< Number of frames dropped for not fitting
+                        in uip_buf. */
+  uint32_t aborted;  /**< Number of frames dropped half way, see
+                        slipdev_abort(). */
+#if SLIP_CSLIP
+  uint32_t cslip_in;  /**< Number of compressed TCP frames received. */
+  uint32_t cslip_out; /**< Number of compressed TCP frames sent. */
+  uint32_t tossed;    /**< Number of frames CSLIP could not rebuild. */
+#endif /* SLIP_CSLIP */
+};
+
+extern struct slipdev_stats slipdev_stat;
 
 void slipdev_init(void);
 void slipdev_send(void);
 u16_t slipdev_poll(void);
+u8_t slipdev_busy(void);
+void slipdev_abort(void);
 
 #endif /* __SLIPDEV_H__ */
 
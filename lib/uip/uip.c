@@ -115,6 +115,16 @@ struct uip_conn *uip_conn;   /* uip_conn always points to the current
 struct uip_conn uip_conns[UIP_CONNS];
                              /* The uip_conns array holds all TCP
 				connections. */
+u8_t uip_active;             /* The first connection that isn't
+				CLOSED, the rest follow through their
+				next fields. */
+static u8_t conntab[UIP_CONN_HASH_SIZE];
+                             /* The numbers of the connections that
+				aren't CLOSED, hashed on their ports
+				and remote address with linear probing.
+				UIP_CONNS marks a free slot. */
+static u8_t lasthit;         /* The connection that the last incoming
+				segment was for. */
 u16_t uip_listenports[UIP_LISTENPORTS];
                              /* The uip_listenports list all currently
 				listning ports. */
@@ -124,7 +134,7 @@ struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 
 
-static u16_t ipid;           /* Ths ipid variable is an increasing
+u16_t uip_ipid;              /* Ths ipid variable is an increasing
 				number that is used for the IP ID
 				field. */
 
@@ -140,6 +150,23 @@ static u16_t lastport;       /* Keeps track of the last port used for
 volatile u8_t uip_acc32[4];
 static u8_t c, opt;
 static u16_t tmp16;
+#if UIP_SEND_WINDOW > 1
+static u16_t sndoff;         /* How far past snd_nxt the segment being
+				sent starts. */
+#define SNDOFF sndoff
+#else /* UIP_SEND_WINDOW > 1 */
+#define SNDOFF 0
+#endif /* UIP_SEND_WINDOW > 1 */
+
+static u16_t rtx_next;       /* The earliest retransmission deadline,
+				if rtx_armed is set. */
+static u8_t rtx_armed;
+static void rtx_remember(u16_t deadline);
+
+#if UIP_CONN_HASH_SIZE <= UIP_CONNS || \
+    (UIP_CONN_HASH_SIZE & (UIP_CONN_HASH_SIZE - 1)) != 0
+#error "UIP_CONN_HASH_SIZE must be a power of two, larger than UIP_CONNS"
+#endif
 
 /* Structures and definitions. */
 #define TCP_FIN 0x01
@@ -150,10 +177,24 @@ static u16_t tmp16;
 #define TCP_URG 0x20
 #define TCP_CTL 0x3f
 
+#if UIP_SEND_WINDOW > 1
+/* Duplicate ACKs that make us retransmit, and the uip_conn->dupacks
+   value while recovering from a retransmission. */
+#define TCP_DUPACKS  3
+#define TCP_RECOVERY 0x80
+#endif /* UIP_SEND_WINDOW > 1 */
+
 #define ICMP_ECHO_REPLY 0
 #define ICMP_ECHO       8     
 
 /* Macros. */
+/* Is time a before time b? Both are on the uip_clock() timebase, and
+   less than 32 seconds apart. */
+#define TIME_BEFORE(a, b) ((u16_t)((a) - (b)) & 0x8000)
+/* The low 16 bits of the sequence number of the next byte to be
+   acknowledged. */
+#define SND_NXT16(conn) (((u16_t)(conn)->snd_nxt[2] << 8) | (conn)->snd_nxt[3])
+
 #define BUF ((uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define FBUF ((uip_tcpip_hdr *)&uip_reassbuf[0])
 #define ICMPBUF ((uip_icmpip_hdr *)&uip_buf[UIP_LLH_LEN])
@@ -166,6 +207,20 @@ struct uip_stats uip_stat;
 #define UIP_STAT(s)
 #endif /* UIP_STATISTICS == 1 */
 
+#if UIP_DEMUX_STATISTICS == 1
+struct uip_demux_stats uip_demux_stat;
+#define DEMUX_STAT(s) s
+#else
+#define DEMUX_STAT(s)
+#endif /* UIP_DEMUX_STATISTICS == 1 */
+
+/* Is the incoming segment for this connection? */
+#define CONN_MATCH(conn) (BUF->destport == (conn)->lport && \
+			  BUF->srcport == (conn)->rport && \
+			  BUF->srcipaddr[0] == (conn)->ripaddr[0] && \
+			  BUF->srcipaddr[1] == (conn)->ripaddr[1])
+#define CONNTAB_NEXT(i) (((i) + 1) & (UIP_CONN_HASH_SIZE - 1))
+
 #if UIP_LOGGING == 1
 #include <stdio.h>
 void uip_log(char *msg);
@@ -184,6 +239,10 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = CLOSED;
   }
+  uip_active = UIP_CONNS;
+  for(c = 0; c < UIP_CONN_HASH_SIZE; ++c) {
+    conntab[c] = UIP_CONNS;
+  }
 #if UIP_ACTIVE_OPEN
   lastport = 1024;
 #endif /* UIP_ACTIVE_OPEN */
@@ -200,6 +259,91 @@ uip_init(void)
   uip_hostaddr[0] = uip_hostaddr[1] = 0;
 #endif /* UIP_FIXEDADDR */
 
+}
+/*-----------------------------------------------------------------------------------*/
+/* Put a connection that was CLOSED on the uip_active list. */
+static void
+conn_open(register struct uip_conn *conn)
+{
+  conn->next = uip_active;
+  uip_active = conn - uip_conns;
+}
+/*-----------------------------------------------------------------------------------*/
+/* Where a connection with these ports and remote address starts
+   looking in conntab. The ports and address are in network byte
+   order, so both bytes are folded in. */
+static u8_t
+conn_slot(u16_t lport, u16_t rport, u16_t *ripaddr)
+{
+  u16_t h = lport ^ rport ^ ripaddr[0] ^ ripaddr[1];
+  return (h ^ (h >> 8)) & (UIP_CONN_HASH_SIZE - 1);
+}
+/*-----------------------------------------------------------------------------------*/
+/* Enter a connection in conntab, once its ports and remote address
+   are set. There is always a free slot, conntab is larger than
+   uip_conns. */
+static void
+conn_hash(register struct uip_conn *conn)
+{
+  register u8_t i;
+
+  i = conn_slot(conn->lport, conn->rport, conn->ripaddr);
+  while(conntab[i] != UIP_CONNS) {
+    i = CONNTAB_NEXT(i);
+  }
+  conntab[i] = conn - uip_conns;
+}
+/*-----------------------------------------------------------------------------------*/
+/* Take a connection out of conntab. The entries after it that were
+   pushed past its slot are moved back, so that a lookup can still
+   stop at the first free slot. */
+static void
+conn_unhash(register struct uip_conn *conn)
+{
+  register u8_t i, j, home;
+  register struct uip_conn *other;
+
+  i = conn_slot(conn->lport, conn->rport, conn->ripaddr);
+  while(&uip_conns[conntab[i]] != conn) {
+    if(conntab[i] == UIP_CONNS) {
+      return;
+    }
+    i = CONNTAB_NEXT(i);
+  }
+  for(j = CONNTAB_NEXT(i); conntab[j] != UIP_CONNS; j = CONNTAB_NEXT(j)) {
+    other = &uip_conns[conntab[j]];
+    home = conn_slot(other->lport, other->rport, other->ripaddr);
+    /* It can fill the hole unless its own slot lies between the hole
+       and where it is now. */
+    if(((j - home) & (UIP_CONN_HASH_SIZE - 1)) >=
+       ((j - i) & (UIP_CONN_HASH_SIZE - 1))) {
+      conntab[i] = conntab[j];
+      i = j;
+    }
+  }
+  conntab[i] = UIP_CONNS;
+}
+/*-----------------------------------------------------------------------------------*/
+/* Close a connection and take it off the uip_active list and out of
+   conntab. Its next field is left alone, so that a sweep over the
+   list can carry on past it. */
+static void
+conn_close(register struct uip_conn *conn)
+{
+  register u8_t *p;
+
+  conn->tcpstateflags = CLOSED;
+  conn_unhash(conn);
+  for(p = &uip_active; *p < UIP_CONNS; p = &uip_conns[*p].next) {
+    if(&uip_conns[*p] == conn) {
+      *p = conn->next;
+      break;
+    }
+  }
+  if(uip_active == UIP_CONNS) {
+    /* No sweep will come along to forget the deadline. */
+    rtx_armed = 0;
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 #if UIP_ACTIVE_OPEN
@@ -218,10 +362,8 @@ uip_connect(u16_t *ripaddr, u16_t rport)
 
   /* Check if this port is already in use, and if so try to find
      another one. */
-  for(c = 0; c < UIP_CONNS; ++c) {
-    conn = &uip_conns[c];
-    if(conn->tcpstateflags != CLOSED &&
-       conn->lport == htons(lastport)) {
+  for(c = uip_active; c < UIP_CONNS; c = uip_conns[c].next) {
+    if(uip_conns[c].lport == htons(lastport)) {
       goto again;
     }
   }
@@ -245,7 +387,13 @@ uip_connect(u16_t *ripaddr, u16_t rport)
   if(conn == 0) {
     return 0;
   }
-  
+
+  if(conn->tcpstateflags == CLOSED) {
+    conn_open(conn);
+  } else {
+    /* A connection in TIME_WAIT is still known by its old ports. */
+    conn_unhash(conn);
+  }
   conn->tcpstateflags = SYN_SENT;
 
   conn->snd_nxt[0] = iss[0];
@@ -257,14 +405,18 @@ uip_connect(u16_t *ripaddr, u16_t rport)
   
   conn->len = 1;   /* TCP length of the SYN is one. */
   conn->nrtx = 0;
-  conn->timer = 1; /* Send the SYN next time around. */
   conn->rto = UIP_RTO;
   conn->sa = 0;
-  conn->sv = 16;
+  conn->sv = 0;
+  conn->rttseq = SND_NXT16(conn);
+  /* Send the SYN when the retransmission timers are next looked at. */
+  conn->timer = uip_clock();
+  rtx_remember(conn->timer);
   conn->lport = htons(lastport);
   conn->rport = rport;
   conn->ripaddr[0] = ripaddr[0];
   conn->ripaddr[1] = ripaddr[1];
+  conn_hash(conn);
   
   return conn;
 }
@@ -477,116 +629,255 @@ uip_add_rcv_nxt(u16_t n)
   uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
 /*-----------------------------------------------------------------------------------*/
+/* Make sure uip_rtx_wait() knows about a retransmission deadline. */
+static void
+rtx_remember(u16_t deadline)
+{
+  if(!rtx_armed || TIME_BEFORE(deadline, rtx_next)) {
+    rtx_next = deadline;
+    rtx_armed = 1;
+  }
+}
+/*-----------------------------------------------------------------------------------*/
+/* (Re)start the retransmission timer of a connection. */
+static void
+rtx_start(register struct uip_conn *conn, u16_t now)
+{
+  conn->timer = now + conn->rto;
+  rtx_remember(conn->timer);
+}
+/*-----------------------------------------------------------------------------------*/
+/* Does an ACK for this many bytes past snd_nxt cover the segment that
+   is being timed? Nothing is timed if rttseq isn't past snd_nxt. */
+static u8_t
+rtt_acked(register struct uip_conn *conn, u16_t acked)
+{
+  u16_t off = conn->rttseq - SND_NXT16(conn);
+  return off > 0 && off <= acked;
+}
+/*-----------------------------------------------------------------------------------*/
+/* Update the round trip time estimate with a new measurement, in
+   milliseconds, and work out the retransmission time-out from it
+   (Jacobson/Karels, RFC 6298). sa holds the smoothed round trip time
+   times 8 and sv the mean deviation times 4, so the time-out is
+   (sa >> 3) + sv. */
+static void
+rtt_update(register struct uip_conn *conn, u16_t m)
+{
+  int d;
+
+  if(m > 0x1fff) {
+    m = 0x1fff;
+  }
+  if(conn->sa == 0) {
+    /* The first measurement: half of it is taken as the deviation. */
+    conn->sa = m << 3;
+    conn->sv = m << 1;
+  } else {
+    d = (int)m - (conn->sa >> 3);
+    conn->sa += d;
+    if(d < 0) {
+      d = -d;
+    }
+    d -= conn->sv >> 2;
+    conn->sv += d;
+  }
+  m = (conn->sa >> 3) + conn->sv;
+  if(m < UIP_RTO_MIN) {
+    m = UIP_RTO_MIN;
+  } else if(m > UIP_RTO_MAX) {
+    m = UIP_RTO_MAX;
+  }
+  conn->rto = m;
+}
+/*-----------------------------------------------------------------------------------*/
+u16_t
+uip_rtx_wait(void)
+{
+  u16_t wait;
+
+  if(!rtx_armed) {
+    return UIP_RTO_MAX;
+  }
+  wait = rtx_next - uip_clock();
+  return (wait & 0x8000) ? 0 : wait;
+}
+/*-----------------------------------------------------------------------------------*/
+void
+uip_tick(void)
+{
+#if UIP_REASSEMBLY
+  if(uip_reasstmr != 0) {
+    --uip_reasstmr;
+  }
+#endif /* UIP_REASSEMBLY */
+  /* Increase the initial sequence number. */
+  if(++iss[3] == 0) {
+    if(++iss[2] == 0) {
+      if(++iss[1] == 0) {
+	++iss[0];
+      }
+    }
+  }
+}
+/*-----------------------------------------------------------------------------------*/
 void
 uip_process(u8_t flag)
 {
   register struct uip_conn *uip_connr = uip_conn;
+  u16_t now = uip_clock();
   
   uip_appdata = &uip_buf[40 + UIP_LLH_LEN];
+  /* Left over from the last call otherwise, and tcp_send looks at
+     UIP_REXMIT. */
+  uip_flags = 0;
+#if UIP_SEND_WINDOW > 1
+  sndoff = 0;
+#endif /* UIP_SEND_WINDOW > 1 */
 
   
   /* Check if we were invoked because of the perodic timer fireing. */
   if(flag == UIP_TIMER) {
-#if UIP_REASSEMBLY
-    if(uip_reasstmr != 0) {
-      --uip_reasstmr;
-    }
-#endif /* UIP_REASSEMBLY */
-    /* Increase the initial sequence number. */
-    if(++iss[3] == 0) {
-      if(++iss[2] == 0) {
-	if(++iss[1] == 0) {
-	  ++iss[0];
-	}
-      }
-    }    
     uip_len = 0;
     if(uip_connr->tcpstateflags == TIME_WAIT ||
        uip_connr->tcpstateflags == FIN_WAIT_2) {
       ++(uip_connr->timer);
       if(uip_connr->timer == UIP_TIME_WAIT_TIMEOUT) {
-	uip_connr->tcpstateflags = CLOSED;
+	conn_close(uip_connr);
       }
-    } else if(uip_connr->tcpstateflags != CLOSED) {
-      /* If the connection has outstanding data, we increase the
-	 connection's timer and see if it has reached the RTO value
-	 in which case we retransmit. */
-      if(uip_outstanding(uip_connr)) {
-	if(uip_connr->timer-- == 0) {
-	  if(uip_connr->nrtx == UIP_MAXRTX ||
-	     ((uip_connr->tcpstateflags == SYN_SENT ||
-	       uip_connr->tcpstateflags == SYN_RCVD) &&
-	      uip_connr->nrtx == UIP_MAXSYNRTX)) {
-	    uip_connr->tcpstateflags = CLOSED;
-
-	    /* We call UIP_APPCALL() with uip_flags set to
-	       UIP_TIMEDOUT to inform the application that the
-	       connection has timed out. */
-	    uip_flags = UIP_TIMEDOUT;
-	    UIP_APPCALL();
-
-	    /* We also send a reset packet to the remote host. */
-	    BUF->flags = TCP_RST | TCP_ACK;
-	    goto tcp_send_nodata;
-	  }
+    } else if((uip_connr->tcpstateflags & TS_MASK) == ESTABLISHED &&
+	      !uip_outstanding(uip_connr)) {
+      /* If there is no data in flight, we poll the application for
+	 new data. */
+      uip_len = 0;
+      uip_slen = 0;
+      uip_flags = UIP_POLL;
+      UIP_APPCALL();
+      goto appsend;
+    }
+    goto drop;
+  }
 
-	  /* Exponential backoff. */
-	  uip_connr->timer = UIP_RTO << (uip_connr->nrtx > 4?
-					 4:
-					 uip_connr->nrtx);
-	  ++(uip_connr->nrtx);
-	  
-	  /* Ok, so we need to retransmit. We do this differently
-	     depending on which state we are in. In ESTABLISHED, we
-	     call upon the application so that it may prepare the
-	     data for the retransmit. In SYN_RCVD, we resend the
-	     SYNACK that we sent earlier and in LAST_ACK we have to
-	     retransmit our FINACK. */
-	  UIP_STAT(++uip_stat.tcp.rexmit);
-	  switch(uip_connr->tcpstateflags & TS_MASK) {
-	  case SYN_RCVD:
-	    /* In the SYN_RCVD state, we should retransmit our
-               SYNACK. */
-	    goto tcp_send_synack;
-	    
+  /* Check if we were invoked because a retransmission timer may have
+     run out. */
+  if(flag == UIP_RTX_TIMER) {
+    uip_len = 0;
+    /* A sweep starts with the first connection in use. Forget the
+       deadline, the connections that still have one put it back. */
+    if(uip_connr == &uip_conns[uip_active]) {
+      rtx_armed = 0;
+    }
+    if(uip_connr->tcpstateflags == CLOSED ||
+       uip_connr->tcpstateflags == TIME_WAIT ||
+       uip_connr->tcpstateflags == FIN_WAIT_2 ||
+       !uip_outstanding(uip_connr)) {
+      goto drop;
+    }
+    if(TIME_BEFORE(now, uip_connr->timer)) {
+      rtx_remember(uip_connr->timer);
+      goto drop;
+    }
 #if UIP_ACTIVE_OPEN
-	  case SYN_SENT:
-	    /* In the SYN_SENT state, we retransmit out SYN. */
-	    BUF->flags = 0;
-	    goto tcp_send_syn;
+    /* uip_connect() leaves the first SYN to be sent from here. Until
+       it has gone out nothing is timed, and it goes out as new: timed,
+       and with the time-out neither backed off nor counted. */
+    if(uip_connr->tcpstateflags == SYN_SENT && uip_connr->nrtx == 0 &&
+       uip_connr->rttseq == SND_NXT16(uip_connr)) {
+      BUF->flags = 0;
+      goto tcp_send_syn;
+    }
 #endif /* UIP_ACTIVE_OPEN */
-	    
-	  case ESTABLISHED:
-	    /* In the ESTABLISHED state, we call upon the application
-               to do the actual retransmit after which we jump into
-               the code for sending out the packet (the apprexmit
-               label). */
-	    uip_len = 0;
-	    uip_slen = 0;
-	    uip_flags = UIP_REXMIT;
-	    UIP_APPCALL();
-	    goto apprexmit;
-	    
-	  case FIN_WAIT_1:
-	  case CLOSING:
-	  case LAST_ACK:
-	    /* In all these states we should retransmit a FINACK. */
-	    goto tcp_send_finack;
-	    
-	  }
-	}
-      } else if((uip_connr->tcpstateflags & TS_MASK) == ESTABLISHED) {
-	/* If there was no need for a retransmission, we poll the
-           application for new data. */
-	uip_len = 0;
-	uip_slen = 0;
-	uip_flags = UIP_POLL;
-	UIP_APPCALL();
-	goto appsend;
+    if(uip_connr->nrtx == UIP_MAXRTX ||
+       ((uip_connr->tcpstateflags == SYN_SENT ||
+	 uip_connr->tcpstateflags == SYN_RCVD) &&
+	uip_connr->nrtx == UIP_MAXSYNRTX)) {
+      conn_close(uip_connr);
+
+      /* We call UIP_APPCALL() with uip_flags set to
+	 UIP_TIMEDOUT to inform the application that the
+	 connection has timed out. */
+      uip_flags = UIP_TIMEDOUT;
+      UIP_APPCALL();
+
+      /* We also send a reset packet to the remote host. */
+      BUF->flags = TCP_RST | TCP_ACK;
+      goto tcp_send_nodata;
+    }
+
+    /* Exponential backoff. The time-out stays backed off until a
+       segment that hasn't been resent is acknowledged, and nothing
+       in flight is timed any more (Karn). */
+    if(uip_connr->rto > UIP_RTO_MAX / 2) {
+      uip_connr->rto = UIP_RTO_MAX;
+    } else {
+      uip_connr->rto <<= 1;
+    }
+    rtx_start(uip_connr, now);
+    uip_connr->rttseq = SND_NXT16(uip_connr);
+    ++(uip_connr->nrtx);
+
+    /* Ok, so we need to retransmit. We do this differently
+       depending on which state we are in. In ESTABLISHED, we
+       call upon the application so that it may prepare the
+       data for the retransmit. In SYN_RCVD, we resend the
+       SYNACK that we sent earlier and in LAST_ACK we have to
+       retransmit our FINACK. */
+    UIP_STAT(++uip_stat.tcp.rexmit);
+    switch(uip_connr->tcpstateflags & TS_MASK) {
+    case SYN_RCVD:
+      /* In the SYN_RCVD state, we should retransmit our
+	 SYNACK. */
+      goto tcp_send_synack;
+
+#if UIP_ACTIVE_OPEN
+    case SYN_SENT:
+      /* In the SYN_SENT state, we retransmit out SYN. */
+      BUF->flags = 0;
+      goto tcp_send_syn;
+#endif /* UIP_ACTIVE_OPEN */
+
+    case ESTABLISHED:
+#if UIP_SEND_WINDOW > 1
+      /* A stream is resent from where it was last acknowledged,
+	 one segment per ACK until everything that was in flight
+	 has been acknowledged. */
+      if(uip_connr->streamlen > 0) {
+	uip_connr->dupacks = TCP_RECOVERY;
+	uip_flags = UIP_REXMIT;
+	goto stream_send;
       }
+#endif /* UIP_SEND_WINDOW > 1 */
+      /* In the ESTABLISHED state, we call upon the application
+	 to do the actual retransmit after which we jump into
+	 the code for sending out the packet (the apprexmit
+	 label). */
+      uip_len = 0;
+      uip_slen = 0;
+      uip_flags = UIP_REXMIT;
+      UIP_APPCALL();
+      goto apprexmit;
+
+    case FIN_WAIT_1:
+    case CLOSING:
+    case LAST_ACK:
+      /* In all these states we should retransmit a FINACK. */
+      goto tcp_send_finack;
+
     }
     goto drop;
   }
+#if UIP_SEND_WINDOW > 1
+  /* Check if we were invoked to fill the send window of the current
+     connection. */
+  if(flag == UIP_WINDOW) {
+    if(uip_connr == 0 ||
+       (uip_connr->tcpstateflags & TS_MASK) != ESTABLISHED) {
+      goto drop;
+    }
+    uip_flags = 0;
+    goto stream_send;
+  }
+#endif /* UIP_SEND_WINDOW > 1 */
 #if UIP_UDP 
   if(flag == UIP_UDP_TIMER) {
     if(uip_udp_conn->lport != 0) {
@@ -824,16 +1115,25 @@ uip_process(u8_t flag)
   }
   
   /* Demultiplex this segment. */
-  /* First check any active connections. */
-  for(uip_connr = &uip_conns[0]; uip_connr < &uip_conns[UIP_CONNS]; ++uip_connr) {
-    if(uip_connr->tcpstateflags != CLOSED &&
-       BUF->destport == uip_connr->lport &&
-       BUF->srcport == uip_connr->rport &&
-       BUF->srcipaddr[0] == uip_connr->ripaddr[0] &&
-       BUF->srcipaddr[1] == uip_connr->ripaddr[1]) {
-      goto found;    
+  /* First check the connection that the last segment was for, as
+     segments tend to come in runs, then look the others up in
+     conntab. */
+  DEMUX_STAT(++uip_demux_stat.lookups);
+  uip_connr = &uip_conns[lasthit];
+  if(uip_connr->tcpstateflags != CLOSED && CONN_MATCH(uip_connr)) {
+    DEMUX_STAT(++uip_demux_stat.hits);
+    goto found;
+  }
+  for(c = conn_slot(BUF->destport, BUF->srcport, BUF->srcipaddr);
+      conntab[c] != UIP_CONNS; c = CONNTAB_NEXT(c)) {
+    DEMUX_STAT(++uip_demux_stat.probes);
+    uip_connr = &uip_conns[conntab[c]];
+    if(CONN_MATCH(uip_connr)) {
+      lasthit = conntab[c];
+      goto found;
     }
   }
+  DEMUX_STAT(++uip_demux_stat.misses);
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -941,16 +1241,28 @@ uip_process(u8_t flag)
     goto drop;
   }
   uip_conn = uip_connr;
+  if(uip_connr->tcpstateflags == CLOSED) {
+    conn_open(uip_connr);
+  } else {
+    /* A connection in TIME_WAIT is still known by its old ports. */
+    conn_unhash(uip_connr);
+  }
   
   /* Fill in the necessary fields for the new connection. */
-  uip_connr->rto = uip_connr->timer = UIP_RTO;
+  uip_connr->rto = UIP_RTO;
   uip_connr->sa = 0;
-  uip_connr->sv = 4;  
+  uip_connr->sv = 0;
   uip_connr->nrtx = 0;
+#if UIP_SEND_WINDOW > 1
+  uip_connr->dupacks = 0;
+  uip_connr->wnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+  uip_connr->streamlen = 0;
+#endif /* UIP_SEND_WINDOW > 1 */
   uip_connr->lport = BUF->destport;
   uip_connr->rport = BUF->srcport;
   uip_connr->ripaddr[0] = BUF->srcipaddr[0];
   uip_connr->ripaddr[1] = BUF->srcipaddr[1];
+  conn_hash(uip_connr);
   uip_connr->tcpstateflags = SYN_RCVD;
 
   uip_connr->snd_nxt[0] = iss[0];
@@ -958,6 +1270,7 @@ uip_process(u8_t flag)
   uip_connr->snd_nxt[2] = iss[2];
   uip_connr->snd_nxt[3] = iss[3];
   uip_connr->len = 1;
+  uip_connr->rttseq = SND_NXT16(uip_connr);
 
   /* rcv_nxt should be the seqno from the incoming packet + 1. */
   uip_connr->rcv_nxt[3] = BUF->seqno[3];
@@ -1031,7 +1344,7 @@ uip_process(u8_t flag)
      sequence number of this reset is wihtin our advertised window
      before we accept the reset. */
   if(BUF->flags & TCP_RST) {
-    uip_connr->tcpstateflags = CLOSED;
+    conn_close(uip_connr);
     UIP_LOG("tcp: got reset, aborting connection.");
     uip_flags = UIP_ABORT;
     UIP_APPCALL();
@@ -1045,6 +1358,14 @@ uip_process(u8_t flag)
      c) and the length of the IP header (20 bytes). */
   uip_len = uip_len - c - 20;
 
+#if UIP_SEND_WINDOW > 1
+  /* Anything but a retransmission of a stream is sent after what is
+     already in flight. */
+  if(uip_connr->streamlen > 0) {
+    sndoff = uip_connr->len;
+  }
+#endif /* UIP_SEND_WINDOW > 1 */
+
   /* First, check if the sequence number of the incoming packet is
      what we're expecting next. If not, we send out an ACK with the
      correct numbers in. */
@@ -1060,38 +1381,88 @@ uip_process(u8_t flag)
      data. If so, we update the sequence number, reset the length of
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
+#if UIP_SEND_WINDOW > 1
+  if(uip_connr->streamlen > 0) {
+    /* A stream has several segments in flight, so any ACK up to the
+       end of them moves it along. An ACK that doesn't, and carries
+       nothing else, tells us a segment has gone missing. */
+    if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
+      tmp16 = (((u16_t)BUF->ackno[2] << 8) | BUF->ackno[3]) -
+	(((u16_t)uip_connr->snd_nxt[2] << 8) | uip_connr->snd_nxt[3]);
+      uip_add32(uip_connr->snd_nxt, tmp16);
+      if(tmp16 > 0 && tmp16 <= uip_connr->len &&
+	 BUF->ackno[0] == uip_acc32[0] &&
+	 BUF->ackno[1] == uip_acc32[1] &&
+	 BUF->ackno[2] == uip_acc32[2] &&
+	 BUF->ackno[3] == uip_acc32[3]) {
+	if(rtt_acked(uip_connr, tmp16)) {
+	  rtt_update(uip_connr, now - uip_connr->rtttime);
+	}
+	uip_connr->snd_nxt[0] = uip_acc32[0];
+	uip_connr->snd_nxt[1] = uip_acc32[1];
+	uip_connr->snd_nxt[2] = uip_acc32[2];
+	uip_connr->snd_nxt[3] = uip_acc32[3];
+	uip_connr->len -= tmp16;
+	uip_connr->stream += tmp16;
+	uip_connr->streamlen -= tmp16;
+	sndoff = uip_connr->len;
+
+	/* Restart the retransmission timer for what is still in
+	   flight. */
+	uip_connr->nrtx = 0;
+	if(uip_connr->len > 0) {
+	  rtx_start(uip_connr, now);
+	}
+
+	/* While recovering, each ACK that still leaves data in flight
+	   points at the next hole. */
+	if(uip_connr->dupacks == TCP_RECOVERY && uip_connr->len > 0) {
+	  UIP_STAT(++uip_stat.tcp.rexmit);
+	  uip_connr->rttseq = SND_NXT16(uip_connr);
+	  uip_flags = UIP_REXMIT;
+	} else {
+	  uip_connr->dupacks = 0;
+	}
+
+	/* Only the end of the stream is for the application. */
+	if(uip_connr->streamlen == 0) {
+	  uip_flags = UIP_ACKDATA;
+	}
+      } else if(tmp16 == 0 && uip_len == 0 &&
+		(BUF->flags & (TCP_SYN | TCP_FIN)) == 0 &&
+		BUF->wnd[0] == (uip_connr->wnd >> 8) &&
+		BUF->wnd[1] == (uip_connr->wnd & 0xff) &&
+		uip_connr->dupacks < TCP_DUPACKS &&
+		++uip_connr->dupacks == TCP_DUPACKS) {
+	/* Fast retransmit. The segment resent may be the one being
+	   timed, so stop timing (Karn). */
+	UIP_STAT(++uip_stat.tcp.rexmit);
+	uip_connr->dupacks = TCP_RECOVERY;
+	uip_connr->rttseq = SND_NXT16(uip_connr);
+	uip_flags = UIP_REXMIT;
+      }
+    }
+  } else
+#endif /* UIP_SEND_WINDOW > 1 */
   if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
     uip_add32(uip_connr->snd_nxt, uip_connr->len);
     if(BUF->ackno[0] == uip_acc32[0] &&
        BUF->ackno[1] == uip_acc32[1] &&
        BUF->ackno[2] == uip_acc32[2] &&
        BUF->ackno[3] == uip_acc32[3]) {
+      /* Do RTT estimation, if the segment was timed. */
+      if(rtt_acked(uip_connr, uip_connr->len)) {
+	rtt_update(uip_connr, now - uip_connr->rtttime);
+      }
       /* Update sequence number. */
       uip_connr->snd_nxt[0] = uip_acc32[0];
       uip_connr->snd_nxt[1] = uip_acc32[1];
       uip_connr->snd_nxt[2] = uip_acc32[2];
       uip_connr->snd_nxt[3] = uip_acc32[3];
-	
-
-      /* Do RTT estimation, unless we have done retransmissions. */
-      if(uip_connr->nrtx == 0) {
-	signed char m;
-	m = uip_connr->rto - uip_connr->timer;
-	/* This is taken directly from VJs original code in his paper */
-	m = m - (uip_connr->sa >> 3);
-	uip_connr->sa += m;
-	if(m < 0) {
-	  m = -m;
-	}
-	m = m - (uip_connr->sv >> 2);
-	uip_connr->sv += m;
-	uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
 
-      }
-      /* Set the acknowledged flag. */
+      /* Set the acknowledged flag. Nothing is in flight now, so the
+	 retransmission timer starts again with the next segment. */
       uip_flags = UIP_ACKDATA;
-      /* Reset the retransmission timer. */
-      uip_connr->timer = uip_connr->rto;
     }
     
   }
@@ -1251,6 +1622,9 @@ uip_process(u8_t flag)
        "persistent timer" and uses the retransmission mechanim.
     */
     tmp16 = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+#if UIP_SEND_WINDOW > 1
+    uip_connr->wnd = tmp16;
+#endif /* UIP_SEND_WINDOW > 1 */
     if(tmp16 > uip_connr->initialmss ||
        tmp16 == 0) {
       tmp16 = uip_connr->initialmss;
@@ -1279,9 +1653,15 @@ uip_process(u8_t flag)
 
     appsend:
       
+#if UIP_SEND_WINDOW > 1
+      if(uip_flags & (UIP_ABORT | UIP_CLOSE)) {
+	uip_connr->streamlen = 0;
+      }
+#endif /* UIP_SEND_WINDOW > 1 */
+
       if(uip_flags & UIP_ABORT) {
 	uip_slen = 0;
-	uip_connr->tcpstateflags = CLOSED;
+	conn_close(uip_connr);
 	BUF->flags = TCP_RST | TCP_ACK;
 	goto tcp_send_nodata;
       }
@@ -1295,6 +1675,12 @@ uip_process(u8_t flag)
 	goto tcp_send_nodata;	
       }
 
+#if UIP_SEND_WINDOW > 1
+      if(uip_connr->streamlen > 0) {
+	goto stream_send;
+      }
+#endif /* UIP_SEND_WINDOW > 1 */
+
       /* If uip_slen > 0, the application has data to be sent. */
       if(uip_slen > 0) {
 
@@ -1351,12 +1737,55 @@ uip_process(u8_t flag)
 	goto tcp_send_noopts;
       }
     }
+#if UIP_SEND_WINDOW > 1
+    if(uip_connr->streamlen == 0) {
+      goto drop;
+    }
+
+  stream_send:
+    /* Resend the oldest segment of the stream if it went missing, or
+       send the next one if the window has room for it. Each duplicate
+       ACK lets one more segment out, so that a lost segment is
+       followed by enough others to make the three duplicate ACKs for
+       a fast retransmit (RFC 3042). Segments are kept to an even
+       length so that the next one starts 16-bit aligned, since the
+       checksum reads the data 16 bits at a time. */
+    if(uip_flags & UIP_REXMIT) {
+      sndoff = 0;
+      tmp16 = uip_connr->len;
+    } else if((uip_connr->dupacks & TCP_RECOVERY) == 0) {
+      sndoff = uip_connr->len;
+      tmp16 = uip_connr->streamlen - uip_connr->len;
+    } else {
+      tmp16 = 0;
+    }
+    if(tmp16 > uip_connr->mss) {
+      tmp16 = uip_connr->mss & ~1;
+    }
+    if(tmp16 > 0 &&
+       (sndoff == 0 ||
+	(sndoff + tmp16 <= uip_connr->wnd &&
+	 sndoff + tmp16 <= (UIP_SEND_WINDOW + uip_connr->dupacks) *
+	 uip_connr->initialmss))) {
+      uip_appdata = uip_connr->stream + sndoff;
+      if(sndoff == uip_connr->len) {
+	uip_connr->len += tmp16;
+      }
+      uip_len = tmp16 + UIP_TCPIP_HLEN;
+      BUF->flags = TCP_ACK | TCP_PSH;
+      goto tcp_send_noopts;
+    }
+    if(uip_flags & UIP_NEWDATA) {
+      sndoff = uip_connr->len;
+      goto tcp_send_ack;
+    }
+#endif /* UIP_SEND_WINDOW > 1 */
     goto drop;
   case LAST_ACK:
     /* We can close this connection if the peer has acknowledged our
        FIN. This is indicated by the UIP_ACKDATA flag. */     
     if(uip_flags & UIP_ACKDATA) {
-      uip_connr->tcpstateflags = CLOSED;
+      conn_close(uip_connr);
       uip_flags = UIP_CLOSE;
       UIP_APPCALL();
     }
@@ -1438,10 +1867,39 @@ uip_process(u8_t flag)
   BUF->ackno[2] = uip_connr->rcv_nxt[2];
   BUF->ackno[3] = uip_connr->rcv_nxt[3];
   
+#if UIP_SEND_WINDOW > 1
+  uip_add32(uip_connr->snd_nxt, sndoff);
+  BUF->seqno[0] = uip_acc32[0];
+  BUF->seqno[1] = uip_acc32[1];
+  BUF->seqno[2] = uip_acc32[2];
+  BUF->seqno[3] = uip_acc32[3];
+#else /* UIP_SEND_WINDOW > 1 */
   BUF->seqno[0] = uip_connr->snd_nxt[0];
   BUF->seqno[1] = uip_connr->snd_nxt[1];
   BUF->seqno[2] = uip_connr->snd_nxt[2];
   BUF->seqno[3] = uip_connr->snd_nxt[3];
+#endif /* UIP_SEND_WINDOW > 1 */
+
+  /* The first time the newest segment goes out, time it if no other
+     is being timed, and start the retransmission timer if nothing was
+     in flight before it. Resent segments are never timed (Karn). */
+  if(uip_connr->nrtx == 0 && (uip_flags & UIP_REXMIT) == 0) {
+    tmp16 = uip_len - 20 - ((BUF->tcpoffset >> 4) << 2);
+    if(BUF->flags & (TCP_SYN | TCP_FIN)) {
+      ++tmp16;
+    }
+    if(tmp16 > 0 && SNDOFF + tmp16 == uip_connr->len) {
+      /* Nothing in flight is being timed if an ACK for all of it
+	 wouldn't cover rttseq. */
+      if(!rtt_acked(uip_connr, uip_connr->len)) {
+	uip_connr->rttseq = SND_NXT16(uip_connr) + uip_connr->len;
+	uip_connr->rtttime = now;
+      }
+      if(SNDOFF == 0) {
+	rtx_start(uip_connr, now);
+      }
+    }
+  }
 
   BUF->proto = UIP_PROTO_TCP;
   
@@ -1478,9 +1936,9 @@ uip_process(u8_t flag)
   BUF->tos = 0;
   BUF->ipoffset[0] = BUF->ipoffset[1] = 0;
   BUF->ttl  = UIP_TTL;
-  ++ipid;
-  BUF->ipid[0] = ipid >> 8;
-  BUF->ipid[1] = ipid & 0xff;
+  ++uip_ipid;
+  BUF->ipid[0] = uip_ipid >> 8;
+  BUF->ipid[1] = uip_ipid & 0xff;
   
   /* Calculate IP checksum. */
   BUF->ipchksum = 0;
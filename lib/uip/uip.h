@@ -182,7 +182,8 @@ void uip_init(void);
  * This function does the necessary periodic processing (timers,
  * polling) for a uIP TCP conneciton, and should be called when the
  * periodic uIP timer goes off. It should be called for every
- * connection, regardless of whether they are open of closed.
+ * connection in use, after a call to uip_tick(). CLOSED connections
+ * have nothing to do, so only the #uip_active list is walked.
  *
  * When the function returns, it may have an outbound packet waiting
  * for service in the uIP packet buffer, and if so the uip_len
@@ -192,7 +193,8 @@ void uip_init(void);
  * The ususal way of calling the function is through a for() loop like
  * this:
  \code
-  for(i = 0; i < UIP_CONNS; ++i) {
+  uip_tick();
+  for(i = uip_active; i < UIP_CONNS; i = uip_conns[i].next) {
     uip_periodic(i);
     if(uip_len > 0) {
       devicedriver_send();
@@ -205,7 +207,8 @@ void uip_init(void);
  * Ethernet, you will need to call the uip_arp_out() function before
  * calling the device driver:
  \code
-  for(i = 0; i < UIP_CONNS; ++i) {
+  uip_tick();
+  for(i = uip_active; i < UIP_CONNS; i = uip_conns[i].next) {
     uip_periodic(i);
     if(uip_len > 0) {
       uip_arp_out();
@@ -236,6 +239,83 @@ void uip_init(void);
 #define uip_periodic_conn(conn) do { uip_conn = conn; \
                                      uip_process(UIP_TIMER); } while (0)
 
+/**
+ * Periodic processing that isn't tied to a connection.
+ *
+ * Advances the initial sequence number and the IP reassembly timer.
+ * Should be called once every time the periodic uIP timer goes off,
+ * before the connections are processed with uip_periodic().
+ */
+void uip_tick(void);
+
+/**
+ * Retransmission timer processing for a connection identified by its
+ * number.
+ *
+ * Retransmission timers count milliseconds on the uip_clock()
+ * timebase rather than periodic timer pulses, so that a lost segment
+ * is resent after about a round trip instead of seconds later. When
+ * uip_rtx_wait() returns 0, this should be called for every
+ * connection in use, in #uip_active order, and the packet it leaves
+ * in uip_buf sent:
+ \code
+  if(uip_rtx_wait() == 0) {
+    for(i = uip_active; i < UIP_CONNS; i = uip_conns[i].next) {
+      uip_rtx_timer(i);
+      if(uip_len > 0) {
+	devicedriver_send();
+      }
+    }
+  }
+ \endcode
+ *
+ * \param conn The number of the connection.
+ *
+ * \hideinitializer
+ */
+#define uip_rtx_timer(conn) do { uip_conn = &uip_conns[conn]; \
+                                 uip_process(UIP_RTX_TIMER); } while (0)
+
+/**
+ * The number of milliseconds until a retransmission timer runs out.
+ *
+ * \return 0 if uip_rtx_timer() is due, or #UIP_RTO_MAX if no
+ * connection has anything in flight.
+ */
+u16_t uip_rtx_wait(void);
+
+/**
+ * The current time in milliseconds, for the retransmission timers.
+ *
+ * This function must be implemented by the application. Only the
+ * difference between two readings is used, so it may wrap.
+ */
+u16_t uip_clock(void);
+
+#if UIP_SEND_WINDOW > 1
+/**
+ * Send the next segment of the current connection's stream, if its
+ * send window has room for one.
+ *
+ * uip_input() answers with at most one segment, so to keep several
+ * segments of a stream (see uip_stream()) in flight the device
+ * driver should call this function after sending that answer, for
+ * as long as it leaves a packet in the uIP packet buffer:
+ \code
+  uip_input();
+  if(uip_len > 0) {
+    devicedriver_send();
+    for(uip_window(); uip_len > 0; uip_window()) {
+      devicedriver_send();
+    }
+  }
+ \endcode
+ *
+ * \hideinitializer
+ */
+#define uip_window()       uip_process(UIP_WINDOW)
+#endif /* UIP_SEND_WINDOW > 1 */
+
 #if UIP_UDP
 /**
  * Periodic processing for a UDP connection identified by its number.
@@ -432,6 +512,32 @@ struct uip_conn *uip_connect(u16_t *ripaddr, u16_t port);
  */
 #define uip_send(data, len) do { uip_sappdata = (data); uip_slen = (len);} while(0)   
 
+#if UIP_SEND_WINDOW > 1
+/**
+ * Send a stream of data on the current connection.
+ *
+ * Unlike uip_send(), the data must stay where it is until all of it
+ * has been acknowledged, e.g. because it is in flash: uIP splits it
+ * into segments itself, keeps up to UIP_SEND_WINDOW of them in
+ * flight and retransmits them from the data when needed. The
+ * application is not called for acknowledgements or retransmissions
+ * until the whole stream has been acknowledged, when it is invoked
+ * with the uip_acked() flag set.
+ *
+ * The call is ignored while a stream is already being sent, and may
+ * only be made when there is no data outstanding from uip_send().
+ *
+ * \param data A pointer to the data, aligned to 16 bits.
+ *
+ * \param len The length of the data.
+ *
+ * \hideinitializer
+ */
+#define uip_stream(data, len) do { if(uip_conn->streamlen == 0) { \
+                                     uip_conn->stream = (u8_t *)(data); \
+                                     uip_conn->streamlen = (len); } } while(0)
+#endif /* UIP_SEND_WINDOW > 1 */
+
 /**
  * The length of any incoming data that is currently avaliable (if avaliable)
  * in the uip_appdata buffer.
@@ -784,15 +890,31 @@ struct uip_conn {
 			 connection. */
   u16_t initialmss;   /**< Initial maximum segment size for the
 			 connection. */  
-  u8_t sa;            /**< Retransmission time-out calculation state
-			 variable. */
-  u8_t sv;            /**< Retransmission time-out calculation state
-			 variable. */
-  u8_t rto;           /**< Retransmission time-out. */
+  u16_t sa;           /**< Smoothed round trip time in milliseconds,
+			 times 8. */
+  u16_t sv;           /**< Mean deviation of the round trip time in
+			 milliseconds, times 4. */
+  u16_t rto;          /**< Retransmission time-out in milliseconds. */
+  u16_t timer;        /**< When to retransmit, on the uip_clock()
+			 timebase, or the seconds spent in TIME_WAIT
+			 or FIN_WAIT_2. */
+  u16_t rtttime;      /**< When the segment being timed was sent. */
+  u16_t rttseq;       /**< The low 16 bits of the sequence number
+			 following the segment being timed. */
   u8_t tcpstateflags; /**< TCP state and flags. */
-  u8_t timer;         /**< The retransmission timer. */
   u8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+  u8_t next;          /**< The number of the next connection in use,
+			 see #uip_active. */
+#if UIP_SEND_WINDOW > 1
+  u16_t wnd;          /**< The window advertised by the remote host. */
+  u16_t streamlen;    /**< Bytes of the stream not yet acknowledged,
+			 including the len bytes in flight. */
+  u8_t *stream;       /**< The first unacknowledged byte of the
+			 stream. */
+  u8_t dupacks;       /**< Duplicate ACKs seen in a row, or
+			 recovering from a retransmission. */
+#endif /* UIP_SEND_WINDOW > 1 */
 
   /** The application state. */
   u8_t appstate[UIP_APPSTATE_SIZE];  
@@ -803,6 +925,16 @@ struct uip_conn {
 extern struct uip_conn *uip_conn;
 /* The array containing all uIP connections. */
 extern struct uip_conn uip_conns[UIP_CONNS];
+/**
+ * The number of the first connection that isn't CLOSED, or UIP_CONNS
+ * if there is none.
+ *
+ * The connections in use are linked in a list through their next
+ * fields, so that the timers need only look at those (see
+ * uip_periodic()). A connection closed while its turn is being
+ * processed keeps its next field, so the loop may carry on from it.
+ */
+extern u8_t uip_active;
 /**
  * \addtogroup uiparch
  * @{
@@ -815,6 +947,12 @@ extern volatile u8_t uip_acc32[4];
 
 /** @} */
 
+/**
+ * The IP ID of the last packet sent, for output stages that send
+ * more than one packet from uip_buf (see uip_split.h).
+ */
+extern u16_t uip_ipid;
+
 
 #if UIP_UDP
 /**
@@ -887,6 +1025,25 @@ struct uip_stats {
  */
 extern struct uip_stats uip_stat;
 
+/**
+ * How incoming TCP segments found their connection, gathered if
+ * UIP_DEMUX_STATISTICS is set to 1.
+ */
+struct uip_demux_stats {
+  uint32_t lookups;       /**< Number of TCP segments looked up. */
+  uint32_t hits;          /**< Number of segments for the same
+			     connection as the one before. */
+  uint32_t probes;        /**< Number of table slots looked at for the
+			     others. */
+  uint32_t misses;        /**< Number of segments for no connection:
+			     SYNs, and strays that get a RST. */
+};
+
+/**
+ * The uIP connection lookup statistics.
+ */
+extern struct uip_demux_stats uip_demux_stat;
+
 
 /*-----------------------------------------------------------------------------------*/
 /* All the stuff below this point is internal to uIP and should not be
@@ -958,6 +1115,13 @@ void uip_process(u8_t flag);
 #if UIP_UDP
 #define UIP_UDP_TIMER 3
 #endif /* UIP_UDP */
+#if UIP_SEND_WINDOW > 1
+#define UIP_WINDOW  4     /* Tells uIP to send more of the current
+                             connection's stream. */
+#endif /* UIP_SEND_WINDOW > 1 */
+#define UIP_RTX_TIMER 5   /* Tells uIP that the retransmission timer
+                             of the current connection may have run
+                             out. */
 
 /* The TCP states used in the uip_conn->tcpstateflags. */
 #define CLOSED      0
@@ -0,0 +1,118 @@
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ * Output stage that sends a TCP data segment as two packets.
+ */
+
+#include "uip_split.h"
+#include "uip_arch.h"
+
+#if UIP_TCP_SPLIT
+
+#define BUF ((uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_PSH 0x08
+
+/* Fix up the lengths and checksums after the payload has changed. */
+static void
+split_finish(u16_t len)
+{
+  uip_len = len + UIP_TCPIP_HLEN;
+  BUF->len[0] = uip_len >> 8;
+  BUF->len[1] = uip_len & 0xff;
+
+  BUF->tcpchksum = 0;
+  BUF->tcpchksum = ~(uip_tcpchksum());
+
+  BUF->ipchksum = 0;
+  BUF->ipchksum = ~(uip_ipchksum());
+}
+/*-----------------------------------------------------------------------------------*/
+/* The peer ACKs every second segment it gets at once, and counts
+   from its last ACK, which is the one uIP has seen: more of them may
+   be on the way, but those cover pairs. So a segment needs splitting
+   if it is the last one the connection has to send and it leaves an
+   odd number of segments in flight. Without uip_stream() that is
+   every segment. */
+static u8_t
+split_wanted(u16_t len)
+{
+  u16_t before, seg;
+
+  if(uip_conn == 0 || uip_conn->len < len) {
+    return 0;
+  }
+  before = uip_conn->len - len;
+
+  /* Not the newest segment, such as a resend of the oldest one. */
+  uip_add32(uip_conn->snd_nxt, before);
+  if(BUF->seqno[0] != uip_acc32[0] ||
+     BUF->seqno[1] != uip_acc32[1] ||
+     BUF->seqno[2] != uip_acc32[2] ||
+     BUF->seqno[3] != uip_acc32[3]) {
+    return 0;
+  }
+
+#if UIP_SEND_WINDOW > 1
+  /* More of the stream to come. */
+  if(uip_conn->streamlen > uip_conn->len) {
+    return 0;
+  }
+#endif /* UIP_SEND_WINDOW > 1 */
+
+  /* The stream goes out in segments of an even MSS, see uip.c. */
+  seg = uip_conn->mss & ~1;
+  return ((before + seg - 1) / seg & 1) == 0;
+}
+/*-----------------------------------------------------------------------------------*/
+void
+uip_split_output(void)
+{
+  u16_t len, len1;
+
+  /* Only plain TCP segments that carry data, no SYNs with options. */
+  if(uip_len <= UIP_TCPIP_HLEN ||
+     BUF->proto != UIP_PROTO_TCP ||
+     BUF->tcpoffset != 5 << 4 ||
+     (BUF->flags & (TCP_SYN | TCP_FIN))) {
+    slipdev_send();
+    return;
+  }
+
+  len = uip_len - UIP_TCPIP_HLEN;
+  len1 = (len >> 1) & ~1;
+  if(len1 == 0 || !split_wanted(len)) {
+    slipdev_send();
+    return;
+  }
+
+  /* The first half goes out with the PSH flag cleared, so that the
+     peer doesn't hand a half-segment to its application early. */
+  BUF->flags &= ~TCP_PSH;
+  split_finish(len1);
+  slipdev_send();
+
+  /* The second half starts len1 bytes further in. */
+  uip_add32(BUF->seqno, len1);
+  BUF->seqno[0] = uip_acc32[0];
+  BUF->seqno[1] = uip_acc32[1];
+  BUF->seqno[2] = uip_acc32[2];
+  BUF->seqno[3] = uip_acc32[3];
+  ++uip_ipid;
+  BUF->ipid[0] = uip_ipid >> 8;
+  BUF->ipid[1] = uip_ipid & 0xff;
+  BUF->flags |= TCP_PSH;
+  uip_appdata += len1;
+  split_finish(len - len1);
+  slipdev_send();
+}
+/*-----------------------------------------------------------------------------------*/
+#endif /* UIP_TCP_SPLIT */
+
+/** @} */
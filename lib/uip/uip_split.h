@@ -0,0 +1,49 @@
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ * Output stage that sends a TCP data segment as two packets.
+ *
+ * Most TCP stacks only acknowledge every second segment right away
+ * and hold the ACK for a lone one until their delayed-ACK timer
+ * fires. A connection with one segment in flight, which is every
+ * uip_send() answer and every segment with #UIP_SEND_WINDOW at 1,
+ * waits out that timer for each segment, and a uip_stream() answer
+ * waits for it at the end when it leaves an odd number in flight.
+ * Sending the last segment as two halves gets the ACK back after one
+ * round trip instead.
+ *
+ * uIP never knows about the split: the ACK covers the whole segment,
+ * and a retransmission is built whole and split again.
+ */
+
+#ifndef __UIP_SPLIT_H__
+#define __UIP_SPLIT_H__
+
+#include "uip.h"
+#include "slipdev.h"
+
+#if UIP_TCP_SPLIT
+/**
+ * Send the packet in uip_buf with slipdev_send(), in two halves if it
+ * is the last data segment its connection has to send and would
+ * leave an odd number of segments in flight.
+ *
+ * This is called in place of slipdev_send() after uip_input(),
+ * uip_periodic() or uip_window() have left a packet to send. Each
+ * half gets its own sequence number, IP ID and checksums. The
+ * payload is split at an even offset so that the second half can
+ * still be summed 16 bits at a time. On return uip_buf holds the
+ * header of the second half.
+ */
+void uip_split_output(void);
+#else /* UIP_TCP_SPLIT */
+#define uip_split_output() slipdev_send()
+#endif /* UIP_TCP_SPLIT */
+
+#endif /* __UIP_SPLIT_H__ */
+
+/** @} */
@@ -311,6 +311,20 @@ typedef uint16_t uip_stats_t;
  */
 #define UIP_CONNS       10
 
+/**
+ * The number of slots in the table that incoming segments are looked
+ * up in to find their connection.
+ *
+ * Must be a power of two, larger than UIP_CONNS. Each slot takes one
+ * byte, and with twice as many slots as connections a lookup rarely
+ * looks at more than one.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONN_HASH_SIZE
+#define UIP_CONN_HASH_SIZE 16
+#endif /* UIP_CONN_HASH_SIZE */
+
 /**
  * The maximum number of simultaneously listening TCP ports.
  *
@@ -343,11 +357,41 @@ typedef uint16_t uip_stats_t;
 #define UIP_URGDATA      0
 
 /**
- * The initial retransmission timeout counted in timer pulses.
+ * The retransmission time-out in milliseconds until the round trip
+ * time has been measured.
  *
  * This should not be changed.
  */
-#define UIP_RTO         3
+#define UIP_RTO         1000
+
+/**
+ * The shortest retransmission time-out in milliseconds.
+ *
+ * RFC 6298 asks for a second, to be safe on any path across the
+ * Internet. A point-to-point link has no hidden queues, so a lost
+ * segment can be resent soon after its round trip time.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_RTO_MIN
+#define UIP_RTO_MIN     100
+#endif
+
+/**
+ * The longest retransmission time-out in milliseconds, which limits
+ * the exponential backoff.
+ *
+ * Deadlines are kept in 16 bits, so this must be less than 32768.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_RTO_MAX
+#define UIP_RTO_MAX     30000
+#endif
+
+#if UIP_RTO_MAX >= 32768
+#error "UIP_RTO_MAX must be less than 32768, deadlines are kept in 16 bits"
+#endif /* UIP_RTO_MAX >= 32768 */
 
 /**
  * The maximum number of times a segment should be retransmitted
@@ -373,6 +417,36 @@ typedef uint16_t uip_stats_t;
  */
 #define UIP_TCP_MSS     (UIP_BUFSIZE - UIP_LLH_LEN - 40)
 
+/**
+ * The number of segments a connection may have in flight when it
+ * sends with uip_stream().
+ *
+ * With 1 every connection waits for each segment to be acknowledged
+ * before sending the next, and uip_stream() is not compiled in. Each
+ * connection costs 9 bytes of RAM more (with 32-bit pointers) when
+ * this is larger.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_SEND_WINDOW
+#define UIP_SEND_WINDOW 4
+#endif
+
+/**
+ * Determines if uip_split_output() sends the last data segment of an
+ * answer as two halves.
+ *
+ * A peer that delays its ACKs answers two segments at once but sits
+ * on a single one for up to 200 ms. Each split costs one more header,
+ * and is only done when the segment would leave an odd number in
+ * flight.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_TCP_SPLIT
+#define UIP_TCP_SPLIT 0
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
@@ -439,6 +513,70 @@ typedef uint16_t uip_stats_t;
  */
 #define UIP_STATISTICS  0
 
+/**
+ * Determines if SLIP receive statistics should be compiled in.
+ *
+ * Counts reads, bytes and frames, to see how many reads (and so
+ * semihosting traps) each received frame costs.
+ *
+ * \hideinitializer
+ */
+#ifndef SLIP_STATISTICS
+#define SLIP_STATISTICS 1
+#endif
+
+/**
+ * Determines if connection lookup statistics should be compiled in.
+ *
+ * Counts how incoming TCP segments found their connection: through
+ * the last one used, or through how many table slots.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_DEMUX_STATISTICS
+#define UIP_DEMUX_STATISTICS 1
+#endif /* UIP_DEMUX_STATISTICS */
+
+/**
+ * Determines if Van Jacobson TCP/IP header compression (CSLIP, RFC
+ * 1144) should be compiled in.
+ *
+ * Incoming compressed frames are always understood. Outgoing frames
+ * are only compressed once the peer has sent a compressed one, so a
+ * plain SLIP peer keeps getting plain SLIP.
+ *
+ * \hideinitializer
+ */
+#ifndef SLIP_CSLIP
+#define SLIP_CSLIP 0
+#endif
+
+/**
+ * The number of TCP connections tracked by CSLIP in each direction.
+ *
+ * Each one costs 41 bytes of RAM per direction. The peer must not
+ * use more slots than this when compressing.
+ *
+ * \hideinitializer
+ */
+#ifndef SLIP_CSLIP_SLOTS
+#define SLIP_CSLIP_SLOTS 4
+#endif
+
+/**
+ * Determines if frames are encoded with Consistent Overhead Byte
+ * Stuffing (COBS) instead of SLIP escapes.
+ *
+ * COBS frames are delimited by zero bytes and grow by at most one
+ * byte in 254, where SLIP may double a frame. Both ends of the link
+ * must agree, there is no negotiation.
+ *
+ * \hideinitializer
+ */
+#ifndef SLIP_COBS
+#define SLIP_COBS 0
+#endif
+
 /**
  * Determines if logging of certain events should be compiled in.
  *
@@ -0,0 +1,217 @@
+//------------------------------------------------------------------------------
+//       Filename: clock.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the millisecond timebase
+//------------------------------------------------------------------------------
+//       Notes : SysTick counts milliseconds, but it stops while the core is
+//               halted for a semihosting call, so it runs slow. Every
+//               CLOCK_SYNC_INTERVAL_MS the lost time is added back from the
+//               host's clock (SYS_ELLAPSED, or SYS_CLOCK if the debugger
+//               doesn't support it). The clock only ever steps forward.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "clock.h"
+#include "semihost.h"
+#if defined(HOST)
+#include "host.h"
+#else
+#include "system.h"
+#endif
+
+#include <stddef.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+static volatile uint32_t s_ticks = 0; // SysTick interrupts
+static uint32_t s_offset = 0;         // time lost while halted
+static uint32_t s_halted = 0;         // s_offset, without the start-up adjustment
+static uint32_t s_lastSync = 0;
+
+static uint32_t s_hostMs = 0;      // host time since CLOCK_Init
+static uint32_t s_ticksPerMs = 0;  // 0 if SYS_ELLAPSED isn't supported
+static uint64_t s_hostBase = 0;    // SYS_ELLAPSED ticks at s_hostMs
+static uint32_t s_hostClock = 0;   // SYS_CLOCK centiseconds at s_hostMs
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+static int CLOCK_HostElapsed(uint64_t *ticks);
+static uint32_t CLOCK_HostMillis(void);
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Initialise the timebase.
+ * @param  None
+ * @return None
+ * @note   SysTick itself is set up for 1ms interrupts by SYS_init().
+ */
+void CLOCK_Init(void)
+{
+    const int freq = SEMIHOST_SysCall(SYS_TICKFREQ, NULL);
+    if (freq >= 1000 && CLOCK_HostElapsed(&s_hostBase) == 0)
+    {
+        s_ticksPerMs = (uint32_t)freq / 1000;
+    }
+    else
+    {
+        s_hostClock = SEMIHOST_SysCall(SYS_CLOCK, NULL);
+    }
+
+    // Start at 0, like the host's count
+    s_offset = 0 - s_ticks;
+    s_lastSync = 0;
+}
+
+/**
+ * @brief  Correct the timebase against the host's clock.
+ * @param  None
+ * @return None
+ * @note   Call from the main loop. Only traps once per CLOCK_SYNC_INTERVAL_MS.
+ */
+void CLOCK_Sync(void)
+{
+    const uint32_t now = CLOCK_Millis();
+    if (now - s_lastSync < CLOCK_SYNC_INTERVAL_MS)
+    {
+        return;
+    }
+
+    const uint32_t host = CLOCK_HostMillis();
+    const int32_t behind = (int32_t)(host - now);
+    if (behind > 0)
+    {
+        s_offset += (uint32_t)behind;
+        s_halted += (uint32_t)behind;
+    }
+    s_lastSync = CLOCK_Millis();
+}
+
+/**
+ * @brief  Get the time since CLOCK_Init.
+ * @param  None
+ * @return Milliseconds, wraps after ~49 days.
+ */
+uint32_t CLOCK_Millis(void)
+{
+    return s_ticks + s_offset;
+}
+
+/**
+ * @brief  Get a fine grained timestamp for profiling.
+ * @param  None
+ * @return Microseconds, wraps after ~71 minutes.
+ * @note   Only differences are meaningful, and only while no CLOCK_Sync()
+ *         happens in between.
+ */
+uint32_t CLOCK_Micros(void)
+{
+#if defined(HOST)
+    return HOST_Micros();
+#else
+    uint32_t ms;
+    uint32_t val;
+    // Retry if the SysTick interrupt hit between the two reads
+    do
+    {
+        ms = CLOCK_Millis();
+        val = SysTick->VAL;
+    } while (ms != CLOCK_Millis());
+    return ms * 1000 + (SysTick->LOAD - val) / (F_CPU / 1000000);
+#endif
+}
+
+/**
+ * @brief  Get the total time CLOCK_Sync() has added back.
+ * @param  None
+ * @return Milliseconds the core spent halted (mostly in semihosting calls).
+ */
+uint32_t CLOCK_HaltedMillis(void)
+{
+    return s_halted;
+}
+
+/**
+ * @brief  SysTick interrupt handler.
+ * @param  None
+ * @return None
+ */
+void SysTick_Handler(void)
+{
+    s_ticks++;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Read the host's tick counter.
+ * @param  ticks - where to store the 64-bit count
+ * @return 0 if successful, -1 otherwise.
+ */
+static int CLOCK_HostElapsed(uint64_t *ticks)
+{
+    uint32_t count[2] = {0, 0}; // least significant word first
+    if (SEMIHOST_SysCall(SYS_ELLAPSED, &count[0]) != 0)
+    {
+        return -1;
+    }
+    *ticks = ((uint64_t)count[1] << 32) | count[0];
+    return 0;
+}
+
+/**
+ * @brief  Get the host time since CLOCK_Init.
+ * @param  None
+ * @return Milliseconds.
+ * @note   The remainder is carried in the base, so rounding doesn't add up.
+ */
+static uint32_t CLOCK_HostMillis(void)
+{
+    if (s_ticksPerMs != 0)
+    {
+        uint64_t ticks;
+        if (CLOCK_HostElapsed(&ticks) == 0)
+        {
+            const uint32_t ms = (uint32_t)((ticks - s_hostBase) / s_ticksPerMs);
+            s_hostBase += (uint64_t)ms * s_ticksPerMs;
+            s_hostMs += ms;
+        }
+    }
+    else
+    {
+        const uint32_t clk = SEMIHOST_SysCall(SYS_CLOCK, NULL);
+        s_hostMs += (clk - s_hostClock) * 10;
+        s_hostClock = clk;
+    }
+    return s_hostMs;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
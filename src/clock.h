@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+//       Filename: clock.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the millisecond timebase API
+//------------------------------------------------------------------------------
+//       Notes : None
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+// How often to correct the SysTick count against the host's clock
+#ifndef CLOCK_SYNC_INTERVAL_MS
+#define CLOCK_SYNC_INTERVAL_MS (1000)
+#endif
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+void CLOCK_Init(void);
+void CLOCK_Sync(void);
+uint32_t CLOCK_Millis(void);
+uint32_t CLOCK_Micros(void);
+uint32_t CLOCK_HaltedMillis(void);
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,712 @@
+//------------------------------------------------------------------------------
+//       Filename: host.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the semihosting API on top of POSIX I/O
+//------------------------------------------------------------------------------
+//       Notes : By default the SLIP link runs over stdin/stdout. If
+//               SEMIHOST_TTY is set, a pty is created and linked to that
+//               path instead, so slattach/slip can attach to it exactly
+//               like they attach to the socat pty in front of pyocd.
+//               With LINK_RTT, a pump thread plays the part of the probe
+//               and moves the link data through the RTT rings.
+//               With LINK_SEMIHOST or LINK_FILE, a doorbell thread drives
+//               SEMIHOST_RxReady for stdin or the opened link file, the
+//               way a debugger would (disable with SEMIHOST_DOORBELL=0).
+//               Like pyocd, reads of opened files block until data comes.
+//               A SysTick thread calls SysTick_Handler() every millisecond,
+//               and wakes SLEEP_WFI_now() like the interrupt would.
+//               Trap statistics are printed to stderr on exit, SIGINT and
+//               SIGTERM included (the SysTick thread does the exiting).
+//------------------------------------------------------------------------------
+#define _GNU_SOURCE
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "host.h"
+#include "link.h"
+#include "semihost.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+#define TTY_ENV      "SEMIHOST_TTY"
+#define DOORBELL_ENV "SEMIHOST_DOORBELL"
+
+// Highest semihosting reason we keep statistics for (SYS_TICKFREQ)
+#define REASON_MAX 0x32
+
+// SYS_ELLAPSED counts nanoseconds
+#define TICK_FREQ 1000000000
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+typedef struct
+{
+    uint64_t traps;
+    uint64_t bytes;
+} trap_stats_t;
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+const uint8_t HOST_UniqueId[8] = {'H', 'O', 'S', 'T', 0, 'P', 'C', 'X'};
+volatile uint32_t SEMIHOST_RxReady = SEMIHOST_RX_READY_UNKNOWN;
+
+static int s_inFd = STDIN_FILENO;
+static int s_outFd = STDOUT_FILENO;
+static int s_slaveFd = -1;
+static const char *s_ttyLink = NULL;
+static struct timespec s_start;
+static trap_stats_t s_stats[REASON_MAX];
+static uint64_t s_emptyReads = 0;
+static uint64_t s_rings = 0;
+static uint64_t s_ringLatencyNs = 0;
+static struct timespec s_ringTime;
+static volatile int s_ringPending = 0;
+static volatile int s_fileFd = -1; // last file opened with SYS_OPEN
+static volatile sig_atomic_t s_quit = 0;
+static pthread_mutex_t s_tickLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_tickCond = PTHREAD_COND_INITIALIZER;
+static uint32_t s_tickCount = 0;
+#if CONFIG_LINK == LINK_RTT
+static uint64_t s_rttUpBytes = 0;
+static uint64_t s_rttDownBytes = 0;
+#endif
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+static void HOST_Init(void) __attribute__((constructor));
+static void HOST_Exit(void);
+static void HOST_Signal(int sig);
+static int HOST_OpenPty(const char *link);
+static int HOST_Open(const char *name, int mode, int len);
+static int HOST_Read(int fd, uint8_t *buf, int count);
+static int HOST_Write(int fd, const uint8_t *buf, int count);
+static int HOST_ReadC(void);
+static int HOST_Clock(void);
+static int HOST_Elapsed(uint32_t *count);
+static void *HOST_SysTick(void *arg);
+#if CONFIG_LINK == LINK_RTT
+static void *HOST_RttPump(void *arg);
+#elif CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE
+static void *HOST_Doorbell(void *arg);
+#endif
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Perform a semihosting system call on the host.
+ * @param  reason - the semihosting operation code
+ * @param  arg - pointer to the argument array (if needed)
+ * @return The result of the operation, with the same semantics as pyocd.
+ */
+int SEMIHOST_Trap(SEMIHOST_Reason_e reason, void *arg)
+{
+    const intptr_t *const args = (const intptr_t *)arg;
+    int ret = -1;
+
+    switch (reason)
+    {
+        case SYS_OPEN:
+            ret = HOST_Open((const char *)args[0], args[1], args[2]);
+            break;
+        case SYS_CLOSE:
+            // Never close the link itself
+            ret = (args[0] > SEMIHOST_STDERR) ? close(args[0]) : 0;
+            break;
+        case SYS_READ:
+            ret = HOST_Read(args[0], (uint8_t *)args[1], args[2]);
+            break;
+        case SYS_WRITE:
+            ret = HOST_Write(args[0], (const uint8_t *)args[1], args[2]);
+            break;
+        case SYS_READC:
+            ret = HOST_ReadC();
+            break;
+        case SYS_CLOCK:
+            ret = HOST_Clock();
+            break;
+        case SYS_ELLAPSED:
+            ret = HOST_Elapsed((uint32_t *)arg);
+            break;
+        case SYS_TICKFREQ:
+            ret = TICK_FREQ;
+            break;
+        default:
+            fprintf(stderr, "host: unsupported semihosting call 0x%02x\n", reason);
+            break;
+    }
+
+    if (reason < REASON_MAX)
+    {
+        s_stats[reason].traps++;
+    }
+    return ret;
+}
+
+/**
+ * @brief  Time since start-up, for CLOCK_Micros().
+ * @param  None
+ * @return Microseconds.
+ */
+uint32_t HOST_Micros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - s_start.tv_sec) * 1000000 +
+                      (now.tv_nsec - s_start.tv_nsec) / 1000);
+}
+
+/**
+ * @brief  Map a semihosting file descriptor onto a host one.
+ * @param  fd - semihosting file descriptor
+ * @return The host file descriptor.
+ */
+int HOST_MapFd(int fd)
+{
+    switch (fd)
+    {
+        case SEMIHOST_STDIN:
+            return s_inFd;
+        case SEMIHOST_STDOUT:
+            return s_outFd;
+        default:
+            return fd;
+    }
+}
+
+/**
+ * @brief  Sleep until the next interrupt, i.e. the next SysTick.
+ * @param  None
+ * @return None
+ */
+void SLEEP_WFI_now(void)
+{
+    pthread_mutex_lock(&s_tickLock);
+    const uint32_t tick = s_tickCount;
+    while (s_tickCount == tick)
+    {
+        pthread_cond_wait(&s_tickCond, &s_tickLock);
+    }
+    pthread_mutex_unlock(&s_tickLock);
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Set up the link file descriptors before main() runs.
+ * @param  None
+ * @return None
+ */
+static void HOST_Init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+
+    const char *link = getenv(TTY_ENV);
+    if (link != NULL && link[0] != '\0')
+    {
+        const int fd = HOST_OpenPty(link);
+        if (fd < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        s_inFd = s_outFd = fd;
+        s_ttyLink = link;
+        fprintf(stderr, "host: SLIP pty linked at %s\n", link);
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, HOST_SysTick, NULL);
+#if CONFIG_LINK == LINK_RTT
+    pthread_create(&thread, NULL, HOST_RttPump, NULL);
+#elif CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE
+    const char *doorbell = getenv(DOORBELL_ENV);
+    if (doorbell == NULL || doorbell[0] != '0')
+    {
+        SEMIHOST_RxReady = 0;
+        pthread_create(&thread, NULL, HOST_Doorbell, NULL);
+    }
+#endif
+
+    atexit(HOST_Exit);
+    signal(SIGINT, HOST_Signal);
+    signal(SIGTERM, HOST_Signal);
+}
+
+/**
+ * @brief  Print the trap statistics and clean up the pty link.
+ * @param  None
+ * @return None
+ */
+static void HOST_Exit(void)
+{
+    static const struct
+    {
+        SEMIHOST_Reason_e reason;
+        const char *name;
+    } names[] = {
+        {SYS_READ, "SYS_READ"},
+        {SYS_WRITE, "SYS_WRITE"},
+        {SYS_READC, "SYS_READC"},
+        {SYS_CLOCK, "SYS_CLOCK"},
+        {SYS_ELLAPSED, "SYS_ELLAPSED"},
+        {SYS_TICKFREQ, "SYS_TICKFREQ"},
+    };
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < REASON_MAX; i++)
+    {
+        total += s_stats[i].traps;
+    }
+
+    const double seconds = HOST_Clock() / 100.0;
+    fprintf(stderr, "\nhost: %llu traps in %.2fs\n", (unsigned long long)total, seconds);
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        const trap_stats_t *const s = &s_stats[names[i].reason];
+        fprintf(stderr, "host: %-12s %10llu traps %10llu bytes %8.2f bytes/trap\n",
+                names[i].name, (unsigned long long)s->traps, (unsigned long long)s->bytes,
+                s->traps ? (double)s->bytes / s->traps : 0.0);
+    }
+    fprintf(stderr, "host: %llu empty reads (%.1f/s)\n", (unsigned long long)s_emptyReads,
+            seconds > 0 ? s_emptyReads / seconds : 0.0);
+    if (s_rings > 0)
+    {
+        fprintf(stderr, "host: %llu doorbell rings, %.1f us ring to SYS_READ\n",
+                (unsigned long long)s_rings, s_ringLatencyNs / 1000.0 / s_rings);
+    }
+
+    // What the firmware costs the machine it runs on, threads included
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "host: cpu %.2fs user %.2fs sys\n",
+            usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+#if CONFIG_LINK == LINK_RTT
+    fprintf(stderr, "host: RTT %llu bytes up %llu bytes down\n",
+            (unsigned long long)s_rttUpBytes, (unsigned long long)s_rttDownBytes);
+#endif
+
+    if (s_ttyLink != NULL)
+    {
+        unlink(s_ttyLink);
+    }
+}
+
+/**
+ * @brief  Ask for a clean exit, so the statistics are printed.
+ * @param  sig - signal number
+ * @return None
+ * @note   exit() and stdio aren't async-signal-safe, so the SysTick
+ *         thread does the exiting on its next tick.
+ */
+static void HOST_Signal(int sig)
+{
+    (void)sig;
+    s_quit = 1;
+}
+
+/**
+ * @brief  Create a raw pty and symlink its slave side to the given path.
+ * @param  link - path of the symlink to create
+ * @return The master file descriptor, or -1 on error.
+ */
+static int HOST_OpenPty(const char *link)
+{
+    const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+        perror("host: posix_openpt");
+        return -1;
+    }
+
+    const char *const slave = ptsname(fd);
+    if (slave == NULL)
+    {
+        perror("host: ptsname");
+        return -1;
+    }
+
+    // Keep the slave open ourselves so the master doesn't hang up
+    // between clients (slattach restarts, etc.)
+    s_slaveFd = open(slave, O_RDWR | O_NOCTTY);
+    if (s_slaveFd < 0)
+    {
+        perror("host: open slave");
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(s_slaveFd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(s_slaveFd, TCSANOW, &tio);
+    }
+
+    unlink(link);
+    if (symlink(slave, link) != 0)
+    {
+        perror("host: symlink");
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief  Open a host file.
+ * @param  name - path, not necessarily null terminated
+ * @param  mode - fopen() style mode index (0-11)
+ * @param  len - length of the path
+ * @return The file descriptor, or -1 on error.
+ */
+static int HOST_Open(const char *name, int mode, int len)
+{
+    static const int access[] = {O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT | O_APPEND};
+    char path[256];
+
+    if (len <= 0 || len >= (int)sizeof(path) || mode < 0 || mode > 11)
+    {
+        return -1;
+    }
+    memcpy(path, name, len);
+    path[len] = '\0';
+
+    // ":tt" is the console, like in pyocd
+    if (strcmp(path, ":tt") == 0)
+    {
+        return (mode < 4) ? SEMIHOST_STDIN : SEMIHOST_STDOUT;
+    }
+
+    int flags = access[mode / 4] | O_NOCTTY;
+    if (mode & 2)
+    {
+        // "+" modes read and write
+        flags = (flags & ~(O_RDONLY | O_WRONLY)) | O_RDWR;
+    }
+
+    const int fd = open(path, flags, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "host: open %s: %s\n", path, strerror(errno));
+    }
+    else
+    {
+        s_fileFd = fd;
+    }
+    return fd;
+}
+
+/**
+ * @brief  Read, like pyocd: without blocking from the telnet console, and
+ *         blocking until there is data from an opened file.
+ * @param  fd - semihosting file descriptor
+ * @param  buf - destination buffer
+ * @param  count - maximum number of bytes to read
+ * @return The number of bytes NOT read (count when nothing is available).
+ */
+static int HOST_Read(int fd, uint8_t *buf, int count)
+{
+    const int hostFd = HOST_MapFd(fd);
+    struct pollfd pfd = {.fd = hostFd, .events = POLLIN};
+
+    if (s_ringPending)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        s_ringLatencyNs += (now.tv_sec - s_ringTime.tv_sec) * 1000000000LL +
+                           (now.tv_nsec - s_ringTime.tv_nsec);
+        s_ringPending = 0;
+    }
+
+    const int timeout = (fd > SEMIHOST_STDERR) ? -1 : 0;
+    if (poll(&pfd, 1, timeout) <= 0 || !(pfd.revents & (POLLIN | POLLHUP)))
+    {
+        s_emptyReads++;
+        return count;
+    }
+
+    const ssize_t n = read(hostFd, buf, count);
+    if (n == 0)
+    {
+        fprintf(stderr, "host: end of input\n");
+        exit(EXIT_SUCCESS);
+    }
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EINTR)
+        {
+            perror("host: read");
+            exit(EXIT_FAILURE);
+        }
+        s_emptyReads++;
+        return count;
+    }
+
+    s_stats[SYS_READ].bytes += n;
+    return count - n;
+}
+
+/**
+ * @brief  Blocking write of the whole buffer.
+ * @param  fd - semihosting file descriptor
+ * @param  buf - source buffer
+ * @param  count - number of bytes to write
+ * @return The number of bytes NOT written.
+ */
+static int HOST_Write(int fd, const uint8_t *buf, int count)
+{
+    const int hostFd = HOST_MapFd(fd);
+    int remaining = count;
+
+    while (remaining > 0)
+    {
+        const ssize_t n = write(hostFd, buf, remaining);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            perror("host: write");
+            break;
+        }
+        buf += n;
+        remaining -= n;
+    }
+
+    s_stats[SYS_WRITE].bytes += count - remaining;
+    return remaining;
+}
+
+/**
+ * @brief  Blocking read of a single character.
+ * @param  None
+ * @return The character read, or -1 on error.
+ */
+static int HOST_ReadC(void)
+{
+    uint8_t c;
+    if (read(s_inFd, &c, 1) != 1)
+    {
+        return -1;
+    }
+    s_stats[SYS_READC].bytes++;
+    return c;
+}
+
+/**
+ * @brief  Time since start-up.
+ * @param  None
+ * @return Centiseconds since the process started, like SYS_CLOCK.
+ */
+static int HOST_Clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int)((now.tv_sec - s_start.tv_sec) * 100 +
+                 (now.tv_nsec - s_start.tv_nsec) / 10000000);
+}
+
+/**
+ * @brief  Time since start-up in ticks of TICK_FREQ.
+ * @param  count - where to store the 64-bit count, least significant word first
+ * @return 0, like SYS_ELLAPSED on success.
+ */
+static int HOST_Elapsed(uint32_t *count)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t ns = (uint64_t)(now.tv_sec - s_start.tv_sec) * TICK_FREQ +
+                        (now.tv_nsec - s_start.tv_nsec);
+    count[0] = (uint32_t)ns;
+    count[1] = (uint32_t)(ns >> 32);
+    return 0;
+}
+
+/**
+ * @brief  Call SysTick_Handler() every millisecond, like the SysTick interrupt.
+ * @param  arg - unused
+ * @return Never returns.
+ */
+static void *HOST_SysTick(void *arg)
+{
+    (void)arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (;;)
+    {
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if (s_quit)
+        {
+            exit(EXIT_SUCCESS);
+        }
+        SysTick_Handler();
+
+        pthread_mutex_lock(&s_tickLock);
+        s_tickCount++;
+        pthread_cond_broadcast(&s_tickCond);
+        pthread_mutex_unlock(&s_tickLock);
+    }
+
+    return NULL;
+}
+
+#if CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE
+/**
+ * @brief  Ring SEMIHOST_RxReady whenever the link has data, like a debugger
+ *         would: stdin, or with LINK_FILE the file the target opened.
+ * @param  arg - unused
+ * @return Never returns.
+ */
+static void *HOST_Doorbell(void *arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        // Wait for the target to take the last ring
+        if (SEMIHOST_RxReady != 0)
+        {
+            usleep(50);
+            continue;
+        }
+
+#if CONFIG_LINK == LINK_FILE
+        struct pollfd pfd = {.fd = s_fileFd, .events = POLLIN};
+        if (pfd.fd < 0)
+        {
+            usleep(1000);
+            continue;
+        }
+#else
+        struct pollfd pfd = {.fd = s_inFd, .events = POLLIN};
+#endif
+        if (poll(&pfd, 1, 10) > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &s_ringTime);
+            s_ringPending = 1;
+            s_rings++;
+            SEMIHOST_RxReady = 1;
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+#if CONFIG_LINK == LINK_RTT
+/**
+ * @brief  Move the link data between the host fds and the RTT rings.
+ * @param  arg - unused
+ * @return Never returns.
+ */
+static void *HOST_RttPump(void *arg)
+{
+    (void)arg;
+    RTT_ControlBlock_t *cb;
+    uint8_t up[RTT_UP_BUFFER_SIZE];
+    uint8_t down[RTT_DOWN_BUFFER_SIZE];
+    int pending = 0;
+    int sent = 0;
+    int eof = 0;
+    int idle = 0;
+
+    // Wait for the firmware to call RTT_Init()
+    while ((cb = RTT_HostFind(&_SEGGER_RTT, sizeof(_SEGGER_RTT))) == NULL)
+    {
+        usleep(1000);
+    }
+
+    for (;;)
+    {
+        const int n = RTT_HostReadUp(cb, up, sizeof(up));
+        for (int done = 0; done < n;)
+        {
+            const ssize_t ret = write(s_outFd, &up[done], n - done);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN)
+            {
+                perror("host: write");
+                exit(EXIT_FAILURE);
+            }
+            done += (ret > 0) ? ret : 0;
+        }
+        s_rttUpBytes += n;
+
+        if (eof)
+        {
+            // Let the firmware finish answering before we go away
+            const int drained = cb->down[0].RdOff == cb->down[0].WrOff;
+            idle = (drained && n == 0) ? idle + 1 : 0;
+            if (idle >= 100)
+            {
+                fprintf(stderr, "host: end of input\n");
+                exit(EXIT_SUCCESS);
+            }
+            usleep(1000);
+        }
+        else if (pending == sent)
+        {
+            // Only sleep in poll() when the target has nothing for us either
+            struct pollfd pfd = {.fd = s_inFd, .events = POLLIN};
+            pending = sent = 0;
+            if (poll(&pfd, 1, n > 0 ? 0 : 1) > 0)
+            {
+                pending = read(s_inFd, down, sizeof(down));
+                eof = (pending == 0);
+                if (pending < 0)
+                {
+                    pending = 0;
+                }
+            }
+        }
+
+        const int written = RTT_HostWriteDown(cb, &down[sent], pending - sent);
+        sent += written;
+        s_rttDownBytes += written;
+    }
+
+    return NULL;
+}
+#endif
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
@@ -0,0 +1,61 @@
+//------------------------------------------------------------------------------
+//       Filename: host.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the host (Linux) stand-in for the target platform
+//------------------------------------------------------------------------------
+//       Notes : Only used when building with -DHOST (make host)
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "rtt.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+// The host has no factory UID area, point the firmware at a fake one instead
+#define UNIQUE_ID_ADDRESS (HOST_UniqueId)
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+extern const uint8_t HOST_UniqueId[8];
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+uint32_t HOST_Micros(void);
+int HOST_MapFd(int fd);
+
+RTT_ControlBlock_t *RTT_HostFind(void *image, size_t size);
+int RTT_HostReadUp(RTT_ControlBlock_t *cb, void *buf, int len);
+int RTT_HostWriteDown(RTT_ControlBlock_t *cb, const void *buf, int len);
+
+// Target interrupt handlers the host calls from its own threads
+void SysTick_Handler(void);
+
+// Blocks until the next SysTick, the only interrupt the host emulates
+void SLEEP_WFI_now(void);
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
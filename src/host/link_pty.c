@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+//       Filename: link_pty.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the LINK_PTY backend with plain POSIX I/O
+//------------------------------------------------------------------------------
+//       Notes : Uses the same file descriptors as the semihosting stand-in
+//               (the SEMIHOST_TTY pty, or stdin/stdout), but without going
+//               through SEMIHOST_Trap(). This is the baseline the other
+//               backends are measured against.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "host.h"
+#include "link.h"
+#include "semihost.h"
+
+#if CONFIG_LINK == LINK_PTY
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+static int s_inFd = -1;
+static int s_outFd = -1;
+static LINK_Stats_t s_stats;
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Pick up the link file descriptors set up by the host stand-in.
+ * @param  None
+ * @return None
+ */
+void LINK_Init(void)
+{
+    s_inFd = HOST_MapFd(SEMIHOST_STDIN);
+    s_outFd = HOST_MapFd(SEMIHOST_STDOUT);
+}
+
+/**
+ * @brief  Read whatever is available, without blocking.
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read, or 0 if none are available.
+ */
+int LINK_Read(uint8_t *buf, int len)
+{
+    struct pollfd pfd = {.fd = s_inFd, .events = POLLIN};
+    if (poll(&pfd, 1, 0) <= 0)
+    {
+        return 0;
+    }
+
+    const ssize_t n = read(s_inFd, buf, len);
+    if (n == 0)
+    {
+        fprintf(stderr, "host: end of input\n");
+        exit(EXIT_SUCCESS);
+    }
+    return (n > 0) ? n : 0;
+}
+
+/**
+ * @brief  Write a whole block.
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ */
+void LINK_Write(const uint8_t *buf, int len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = write(s_outFd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            perror("host: write");
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief  Count a frame, it has already been written.
+ * @param  None
+ * @return None
+ */
+void LINK_EndFrame(void)
+{
+    s_stats.frames++;
+}
+
+/**
+ * @brief  Nothing to do, LINK_Write() goes straight to the file descriptor.
+ * @param  None
+ * @return None
+ */
+void LINK_Flush(void)
+{
+}
+
+/**
+ * @brief  Check if there is anything to read.
+ * @param  None
+ * @return Non-zero if a read would find data.
+ */
+int LINK_Pending(void)
+{
+    struct pollfd pfd = {.fd = s_inFd, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @brief  Get the transmit statistics.
+ * @param  None
+ * @return Pointer to the counters, which keep counting.
+ */
+const LINK_Stats_t *LINK_GetStats(void)
+{
+    return &s_stats;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+#endif /* CONFIG_LINK == LINK_PTY */
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
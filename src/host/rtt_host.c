@@ -0,0 +1,167 @@
+//------------------------------------------------------------------------------
+//       Filename: rtt_host.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the debugger side of the RTT rings
+//------------------------------------------------------------------------------
+//       Notes : This is what pyocd does over SWD, done on a memory image
+//               instead. In the host build the image is the firmware's own
+//               RAM and a pump thread stands in for the probe.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "host.h"
+#include "rtt.h"
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Find the RTT control block in a memory image.
+ * @param  image - pointer to the start of the image
+ * @param  size - size of the image in bytes
+ * @return Pointer to the control block, or NULL if not (yet) present.
+ */
+RTT_ControlBlock_t *RTT_HostFind(void *image, size_t size)
+{
+    uint8_t *const mem = (uint8_t *)image;
+
+    for (size_t i = 0; i + sizeof(RTT_ControlBlock_t) <= size; i += sizeof(uint32_t))
+    {
+        if (memcmp(&mem[i], RTT_ID, sizeof(RTT_ID)) == 0)
+        {
+            return (RTT_ControlBlock_t *)&mem[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  Drain the up buffer (target -> host).
+ * @param  cb - control block
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read.
+ */
+int RTT_HostReadUp(RTT_ControlBlock_t *cb, void *buf, int len)
+{
+    RTT_Buffer_t *const ring = &cb->up[0];
+    uint8_t *dst = (uint8_t *)buf;
+    uint32_t rd = ring->RdOff;
+    int count = 0;
+
+    while (count < len)
+    {
+        const uint32_t wr = ring->WrOff;
+        if (wr == rd)
+        {
+            break;
+        }
+
+        uint32_t avail = (wr > rd) ? wr - rd : ring->SizeOfBuffer - rd;
+        if (avail > (uint32_t)(len - count))
+        {
+            avail = len - count;
+        }
+
+        RTT_DMB();
+        memcpy(dst, &ring->pBuffer[rd], avail);
+        dst += avail;
+        count += avail;
+        rd += avail;
+        if (rd == ring->SizeOfBuffer)
+        {
+            rd = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        RTT_DMB();
+        ring->RdOff = rd;
+    }
+    return count;
+}
+
+/**
+ * @brief  Fill the down buffer (host -> target) as far as it will go.
+ * @param  cb - control block
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return The number of bytes written, which may be less than len.
+ */
+int RTT_HostWriteDown(RTT_ControlBlock_t *cb, const void *buf, int len)
+{
+    RTT_Buffer_t *const ring = &cb->down[0];
+    const uint8_t *src = (const uint8_t *)buf;
+    uint32_t wr = ring->WrOff;
+    int count = 0;
+
+    while (count < len)
+    {
+        const uint32_t rd = ring->RdOff;
+        uint32_t space = (rd > wr) ? rd - wr - 1 : ring->SizeOfBuffer - wr - (rd == 0);
+        if (space == 0)
+        {
+            break;
+        }
+        if (space > (uint32_t)(len - count))
+        {
+            space = len - count;
+        }
+
+        memcpy(&ring->pBuffer[wr], src, space);
+        src += space;
+        count += space;
+        wr += space;
+        if (wr == ring->SizeOfBuffer)
+        {
+            wr = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        RTT_DMB();
+        ring->WrOff = wr;
+    }
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
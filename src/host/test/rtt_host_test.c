@@ -0,0 +1,262 @@
+//------------------------------------------------------------------------------
+//       Filename: rtt_host_test.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Tests the debugger side of the RTT rings (rtt_host.c)
+//------------------------------------------------------------------------------
+//       Notes : Builds a control block and its rings in a byte array, the
+//               way they sit in target RAM, and plays the target's part by
+//               moving WrOff/RdOff by hand. Run with make test.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "host.h"
+#include "rtt.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+#define IMAGE_SIZE (1024)
+#define CB_OFFSET  (200) // word aligned, not at the start of the image
+#define UP_SIZE    (16)
+#define DOWN_SIZE  (8)
+
+#define CHECK(cond)                                                     \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            printf("%s:%d: %s: FAIL %s\n", __FILE__, __LINE__, __func__, #cond); \
+            s_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+static _Alignas(uint32_t) uint8_t s_image[IMAGE_SIZE];
+static int s_failures = 0;
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+static RTT_ControlBlock_t *TEST_BuildImage(void);
+static void TEST_TargetWrite(RTT_Buffer_t *ring, const uint8_t *data, uint32_t len);
+static void TEST_Find(void);
+static void TEST_ReadUpEmpty(void);
+static void TEST_ReadUpWrap(void);
+static void TEST_ReadUpFull(void);
+static void TEST_WriteDownFull(void);
+static void TEST_WriteDownWrap(void);
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+int main(void)
+{
+    TEST_Find();
+    TEST_ReadUpEmpty();
+    TEST_ReadUpWrap();
+    TEST_ReadUpFull();
+    TEST_WriteDownFull();
+    TEST_WriteDownWrap();
+
+    printf("rtt_host_test: %s (%d failures)\n", s_failures ? "FAIL" : "PASS", s_failures);
+    return s_failures ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Lay out a control block and both rings in the image.
+ * @param  None
+ * @return The control block, at CB_OFFSET.
+ */
+static RTT_ControlBlock_t *TEST_BuildImage(void)
+{
+    // Junk that starts like the ID, so the search has to look past it
+    memset(s_image, 0xa5, sizeof(s_image));
+    memcpy(&s_image[16], "SEGGER", 6);
+
+    RTT_ControlBlock_t *const cb = (RTT_ControlBlock_t *)&s_image[CB_OFFSET];
+    uint8_t *const rings = &s_image[CB_OFFSET + sizeof(*cb)];
+    memset(cb, 0, sizeof(*cb));
+    memcpy(cb->acID, RTT_ID, sizeof(RTT_ID));
+    cb->MaxNumUpBuffers = 1;
+    cb->MaxNumDownBuffers = 1;
+    cb->up[0].pBuffer = rings;
+    cb->up[0].SizeOfBuffer = UP_SIZE;
+    cb->down[0].pBuffer = rings + UP_SIZE;
+    cb->down[0].SizeOfBuffer = DOWN_SIZE;
+    return cb;
+}
+
+/**
+ * @brief  Put bytes in a ring the way the target does, wrapping at the end.
+ * @param  ring - ring to write to
+ * @param  data - bytes to write
+ * @param  len - number of bytes, no more than the free space
+ * @return None
+ */
+static void TEST_TargetWrite(RTT_Buffer_t *ring, const uint8_t *data, uint32_t len)
+{
+    uint32_t wr = ring->WrOff;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        ring->pBuffer[wr] = data[i];
+        wr = (wr + 1 == ring->SizeOfBuffer) ? 0 : wr + 1;
+    }
+    ring->WrOff = wr;
+}
+
+static void TEST_Find(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    CHECK(RTT_HostFind(s_image, sizeof(s_image)) == cb);
+
+    // Not there at all
+    memset(cb->acID, 0, sizeof(cb->acID));
+    CHECK(RTT_HostFind(s_image, sizeof(s_image)) == NULL);
+
+    // ID present, but the image ends before the rest of the block does
+    memcpy(cb->acID, RTT_ID, sizeof(RTT_ID));
+    CHECK(RTT_HostFind(s_image, CB_OFFSET + sizeof(*cb) - 1) == NULL);
+    CHECK(RTT_HostFind(s_image, CB_OFFSET + sizeof(*cb)) == cb);
+}
+
+static void TEST_ReadUpEmpty(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    uint8_t out[UP_SIZE];
+
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == 0);
+    CHECK(cb->up[0].RdOff == 0);
+
+    // Empty again after reading everything, away from offset 0
+    cb->up[0].WrOff = cb->up[0].RdOff = 5;
+    TEST_TargetWrite(&cb->up[0], (const uint8_t *)"abc", 3);
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == 3);
+    CHECK(memcmp(out, "abc", 3) == 0);
+    CHECK(cb->up[0].RdOff == 8);
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == 0);
+}
+
+static void TEST_ReadUpWrap(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    RTT_Buffer_t *const up = &cb->up[0];
+    uint8_t out[UP_SIZE];
+
+    // 10 bytes starting 4 from the end: 4 before the wrap, 6 after
+    up->WrOff = up->RdOff = UP_SIZE - 4;
+    TEST_TargetWrite(up, (const uint8_t *)"0123456789", 10);
+    CHECK(up->WrOff == 6);
+
+    // A short read stops before the wrap
+    CHECK(RTT_HostReadUp(cb, out, 3) == 3);
+    CHECK(memcmp(out, "012", 3) == 0);
+    CHECK(up->RdOff == UP_SIZE - 1);
+
+    // The rest comes back in one read, across the wrap
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == 7);
+    CHECK(memcmp(out, "3456789", 7) == 0);
+    CHECK(up->RdOff == 6);
+
+    // A read that ends exactly at the end of the buffer wraps RdOff to 0
+    up->WrOff = up->RdOff = UP_SIZE - 2;
+    TEST_TargetWrite(up, (const uint8_t *)"xy", 2);
+    CHECK(up->WrOff == 0);
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == 2);
+    CHECK(memcmp(out, "xy", 2) == 0);
+    CHECK(up->RdOff == 0);
+}
+
+static void TEST_ReadUpFull(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    RTT_Buffer_t *const up = &cb->up[0];
+    uint8_t in[UP_SIZE - 1];
+    uint8_t out[UP_SIZE];
+
+    for (size_t i = 0; i < sizeof(in); i++)
+    {
+        in[i] = (uint8_t)(0x40 + i);
+    }
+
+    // Full from 0: WrOff one behind RdOff, SizeOfBuffer - 1 bytes
+    TEST_TargetWrite(up, in, sizeof(in));
+    CHECK(up->WrOff == UP_SIZE - 1);
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == (int)sizeof(in));
+    CHECK(memcmp(out, in, sizeof(in)) == 0);
+    CHECK(up->RdOff == up->WrOff);
+
+    // Full across the wrap
+    up->WrOff = up->RdOff = 9;
+    TEST_TargetWrite(up, in, sizeof(in));
+    CHECK(up->WrOff == 8);
+    CHECK(RTT_HostReadUp(cb, out, sizeof(out)) == (int)sizeof(in));
+    CHECK(memcmp(out, in, sizeof(in)) == 0);
+    CHECK(up->RdOff == 8);
+}
+
+static void TEST_WriteDownFull(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    RTT_Buffer_t *const down = &cb->down[0];
+    const uint8_t *const ring = down->pBuffer;
+
+    // One slot always stays free, so a full ring isn't mistaken for empty
+    CHECK(RTT_HostWriteDown(cb, "ABCDEFGHIJ", 10) == DOWN_SIZE - 1);
+    CHECK(down->WrOff == DOWN_SIZE - 1);
+    CHECK(memcmp(ring, "ABCDEFG", DOWN_SIZE - 1) == 0);
+    CHECK(RTT_HostWriteDown(cb, "K", 1) == 0);
+    CHECK(down->WrOff == DOWN_SIZE - 1);
+
+    // The target taking one byte makes room for exactly one more
+    down->RdOff = 1;
+    CHECK(RTT_HostWriteDown(cb, "KL", 2) == 1);
+    CHECK(ring[DOWN_SIZE - 1] == 'K');
+    CHECK(down->WrOff == 0);
+    CHECK(RTT_HostWriteDown(cb, "L", 1) == 0);
+
+    // And nothing is written to a zero length request
+    down->RdOff = 0;
+    CHECK(RTT_HostWriteDown(cb, "M", 0) == 0);
+}
+
+static void TEST_WriteDownWrap(void)
+{
+    RTT_ControlBlock_t *const cb = TEST_BuildImage();
+    RTT_Buffer_t *const down = &cb->down[0];
+    const uint8_t *const ring = down->pBuffer;
+
+    // 3 bytes fit before the end, the rest go in from offset 0 up to RdOff - 1
+    down->WrOff = down->RdOff = DOWN_SIZE - 3;
+    CHECK(RTT_HostWriteDown(cb, "uvwxyz", 6) == 6);
+    CHECK(down->WrOff == 3);
+    CHECK(memcmp(&ring[DOWN_SIZE - 3], "uvw", 3) == 0);
+    CHECK(memcmp(ring, "xyz", 3) == 0);
+
+    // One more byte fills it
+    CHECK(RTT_HostWriteDown(cb, "!?", 2) == 1);
+    CHECK(down->WrOff == 4);
+    CHECK(ring[3] == '!');
+
+    // Empty, since the target read it all
+    down->RdOff = down->WrOff;
+    CHECK(RTT_HostWriteDown(cb, "12345678", 8) == DOWN_SIZE - 1);
+    CHECK(down->WrOff == 3);
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
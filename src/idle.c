@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+//       Filename: idle.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the main loop idle back-off
+//------------------------------------------------------------------------------
+//       Notes : Sleeping uses WFI, so SysTick wakes the core every
+//               millisecond and the clock keeps running. Each wake-up only
+//               checks LINK_Pending(), which never traps, so a link with a
+//               doorbell (or RTT) still gets its data within a millisecond.
+//               LPT_sleep() isn't used: SysTick would wake it every
+//               millisecond anyway, and it costs a 2ms busy wait per call.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "idle.h"
+#include "clock.h"
+#include "link.h"
+#if defined(HOST)
+#include "host.h"
+#else
+#include "system.h"
+#endif
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+static uint32_t s_lastActivity = 0;
+static uint32_t s_sleepMs = 1;
+static IDLE_Stats_t s_stats;
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Note that the link is busy, so the loop polls flat out again.
+ * @param  None
+ * @return None
+ */
+void IDLE_Activity(void)
+{
+    s_lastActivity = CLOCK_Millis();
+    s_sleepMs = 1;
+}
+
+/**
+ * @brief  Called after a loop iteration that found nothing to do.
+ * @param  deadline - CLOCK_Millis() time the loop must be back by
+ * @return None
+ * @note   Spins for IDLE_SPIN_MS after the last activity, then sleeps for 1, 2, 4...
+ *         IDLE_MAX_SLEEP_MS milliseconds, but never past the deadline.
+ */
+void IDLE_Wait(uint32_t deadline)
+{
+    const uint32_t start = CLOCK_Millis();
+    if (IDLE_MAX_SLEEP_MS == 0 || start - s_lastActivity < IDLE_SPIN_MS)
+    {
+        return;
+    }
+
+    const int32_t left = (int32_t)(deadline - start);
+    if (left <= 0)
+    {
+        return;
+    }
+    const uint32_t ms = ((uint32_t)left < s_sleepMs) ? (uint32_t)left : s_sleepMs;
+
+    s_stats.sleeps++;
+    while (CLOCK_Millis() - start < ms)
+    {
+        if (LINK_Pending())
+        {
+            s_stats.early++;
+            break;
+        }
+        SLEEP_WFI_now();
+        s_stats.wakeups++;
+    }
+    s_stats.idleMs += CLOCK_Millis() - start;
+
+    if (s_sleepMs < IDLE_MAX_SLEEP_MS)
+    {
+        s_sleepMs *= 2;
+    }
+}
+
+/**
+ * @brief  Get the idle statistics.
+ * @param  None
+ * @return Pointer to the statistics.
+ */
+const IDLE_Stats_t *IDLE_GetStats(void)
+{
+    return &s_stats;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
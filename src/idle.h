@@ -0,0 +1,66 @@
+//------------------------------------------------------------------------------
+//       Filename: idle.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the main loop idle back-off API
+//------------------------------------------------------------------------------
+//       Notes : Every poll of an idle link costs the debugger a trap, so
+//               once the link goes quiet the main loop sleeps between
+//               polls, for longer each time, up to IDLE_MAX_SLEEP_MS.
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+// How long to keep polling flat out after the last frame, long enough for
+// the peer to answer it
+#ifndef IDLE_SPIN_MS
+#define IDLE_SPIN_MS (20)
+#endif
+
+// Longest sleep between polls, this is the worst case added latency for
+// links without a cheap "data pending" check. 0 never sleeps.
+#ifndef IDLE_MAX_SLEEP_MS
+#define IDLE_MAX_SLEEP_MS (32)
+#endif
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t sleeps;  // calls to IDLE_Wait() that slept
+    uint32_t wakeups; // interrupts that woke the core while sleeping
+    uint32_t early;   // sleeps cut short by link data
+    uint32_t idleMs;  // time spent sleeping
+} IDLE_Stats_t;
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+void IDLE_Activity(void);
+void IDLE_Wait(uint32_t deadline);
+const IDLE_Stats_t *IDLE_GetStats(void);
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,441 @@
+//------------------------------------------------------------------------------
+//       Filename: link.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the target link backends
+//------------------------------------------------------------------------------
+//       Notes : LINK_PTY lives in host/link_pty.c.
+//               SYS_READ and SYS_WRITE return the number of bytes NOT
+//               transferred.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "link.h"
+#include "prof.h"
+#include "rtt.h"
+#include "semihost.h"
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+#if CONFIG_LINK == LINK_FILE
+static int s_handle = -1;
+#endif
+
+#if (CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE) && LINK_TX_BUFFER_SIZE > 0
+static uint8_t s_txBuffer[LINK_TX_BUFFER_SIZE];
+static int s_txLen = 0;
+static uint32_t s_txFrames = 0; // frames ended since the last write
+#endif
+#if CONFIG_LINK != LINK_PTY
+static LINK_Stats_t s_stats;
+#endif
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+#if CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE
+static int LINK_SemihostRead(int fd, uint8_t *buf, int len);
+static void LINK_SemihostWrite(int fd, const uint8_t *buf, int len);
+static void LINK_Gather(int fd, const uint8_t *buf, int len);
+static void LINK_Drain(int fd);
+static void LINK_FrameDone(int fd);
+#endif
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+#if CONFIG_LINK == LINK_SEMIHOST
+
+/**
+ * @brief  Initialise the link.
+ * @param  None
+ * @return None
+ */
+void LINK_Init(void)
+{
+}
+
+/**
+ * @brief  Read whatever the host has sent, without blocking.
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read, or 0 if none are available.
+ */
+int LINK_Read(uint8_t *buf, int len)
+{
+    // Only trap if the host has something
+    if (!SEMIHOST_RxPending())
+    {
+        return 0;
+    }
+    return LINK_SemihostRead(SEMIHOST_STDIN, buf, len);
+}
+
+/**
+ * @brief  Queue a block for the host.
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ * @note   Short blocks are copied and long ones written out before this
+ *         returns, so buf may be reused straight away.
+ */
+void LINK_Write(const uint8_t *buf, int len)
+{
+    LINK_Gather(SEMIHOST_STDOUT, buf, len);
+}
+
+/**
+ * @brief  Mark the end of a frame.
+ * @param  None
+ * @return None
+ * @note   Writes out the queue once LINK_TX_HIGH_WATER bytes are waiting,
+ *         otherwise the frame waits for the next one or LINK_Flush().
+ */
+void LINK_EndFrame(void)
+{
+    LINK_FrameDone(SEMIHOST_STDOUT);
+}
+
+/**
+ * @brief  Write everything queued by LINK_Write() to the host.
+ * @param  None
+ * @return None
+ * @note   Blocks until all of it has been written.
+ */
+void LINK_Flush(void)
+{
+    LINK_Drain(SEMIHOST_STDOUT);
+}
+
+/**
+ * @brief  Check if the doorbell says the host has data, without trapping.
+ * @param  None
+ * @return Non-zero if a read would find data.
+ * @note   Without a doorbell this can't tell, and says no.
+ */
+int LINK_Pending(void)
+{
+    const uint32_t ready = SEMIHOST_RxReady;
+    return ready != 0 && ready != SEMIHOST_RX_READY_UNKNOWN;
+}
+
+#elif CONFIG_LINK == LINK_FILE
+
+/**
+ * @brief  Open CONFIG_LINK_FILE_PATH on the host.
+ * @param  None
+ * @return None
+ * @note   The path is opened "r+b". pyocd serves SYS_READ on an opened
+ *         file with a blocking read, halting the core until the host
+ *         writes something, so reads wait for SEMIHOST_RxReady to say the
+ *         file has data (see LINK_Read()).
+ */
+void LINK_Init(void)
+{
+    static const char path[] = CONFIG_LINK_FILE_PATH;
+    intptr_t args[3] = {(intptr_t)path, SEMIHOST_OPEN_RPLUSB, sizeof(path) - 1};
+    s_handle = SEMIHOST_SysCall(SYS_OPEN, &args[0]);
+}
+
+/**
+ * @brief  Read whatever the host has sent.
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read, or 0 if none are available.
+ * @note   Only traps when the doorbell has rung for the file, so a read
+ *         never blocks. Without a debugger driving the doorbell every
+ *         call traps, and each one waits for data on real hardware.
+ */
+int LINK_Read(uint8_t *buf, int len)
+{
+    if (s_handle < 0 || !SEMIHOST_RxPending())
+    {
+        return 0;
+    }
+    return LINK_SemihostRead(s_handle, buf, len);
+}
+
+/**
+ * @brief  Queue a block for the host.
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ * @note   Short blocks are copied and long ones written out before this
+ *         returns, so buf may be reused straight away.
+ */
+void LINK_Write(const uint8_t *buf, int len)
+{
+    if (s_handle >= 0)
+    {
+        LINK_Gather(s_handle, buf, len);
+    }
+}
+
+/**
+ * @brief  Mark the end of a frame.
+ * @param  None
+ * @return None
+ * @note   Writes out the queue once LINK_TX_HIGH_WATER bytes are waiting,
+ *         otherwise the frame waits for the next one or LINK_Flush().
+ */
+void LINK_EndFrame(void)
+{
+    if (s_handle >= 0)
+    {
+        LINK_FrameDone(s_handle);
+    }
+}
+
+/**
+ * @brief  Write everything queued by LINK_Write() to the host.
+ * @param  None
+ * @return None
+ * @note   Blocks until all of it has been written.
+ */
+void LINK_Flush(void)
+{
+    if (s_handle >= 0)
+    {
+        LINK_Drain(s_handle);
+    }
+}
+
+/**
+ * @brief  Check if the doorbell says the host has data, without trapping.
+ * @param  None
+ * @return Non-zero if a read would find data.
+ * @note   Without a doorbell this can't tell, and says no.
+ */
+int LINK_Pending(void)
+{
+    const uint32_t ready = SEMIHOST_RxReady;
+    return s_handle >= 0 && ready != 0 && ready != SEMIHOST_RX_READY_UNKNOWN;
+}
+
+#elif CONFIG_LINK == LINK_RTT
+
+/**
+ * @brief  Set up the RTT control block for the debugger to find.
+ * @param  None
+ * @return None
+ */
+void LINK_Init(void)
+{
+    RTT_Init();
+}
+
+/**
+ * @brief  Read whatever the host has put in the down ring.
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read, or 0 if none are available.
+ */
+int LINK_Read(uint8_t *buf, int len)
+{
+    return RTT_Read(buf, len);
+}
+
+/**
+ * @brief  Write a block to the up ring.
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ * @note   Blocks until the host has made room for all of it.
+ */
+void LINK_Write(const uint8_t *buf, int len)
+{
+    (void)RTT_Write(buf, len);
+}
+
+/**
+ * @brief  Count a frame, it is already in the ring.
+ * @param  None
+ * @return None
+ */
+void LINK_EndFrame(void)
+{
+    s_stats.frames++;
+}
+
+/**
+ * @brief  Nothing to do, LINK_Write() copies straight into the ring.
+ * @param  None
+ * @return None
+ */
+void LINK_Flush(void)
+{
+}
+
+/**
+ * @brief  Check if the host has put anything in the down ring.
+ * @param  None
+ * @return Non-zero if a read would find data.
+ */
+int LINK_Pending(void)
+{
+    return RTT_HasData();
+}
+
+#endif /* CONFIG_LINK */
+
+#if CONFIG_LINK != LINK_PTY
+/**
+ * @brief  Get the transmit statistics.
+ * @param  None
+ * @return Pointer to the counters, which keep counting.
+ */
+const LINK_Stats_t *LINK_GetStats(void)
+{
+    return &s_stats;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+#if CONFIG_LINK == LINK_SEMIHOST || CONFIG_LINK == LINK_FILE
+
+/**
+ * @brief  Read from a semihosting file descriptor.
+ * @param  fd - semihosting file descriptor
+ * @param  buf - destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read.
+ */
+static int LINK_SemihostRead(int fd, uint8_t *buf, int len)
+{
+    intptr_t args[3] = {fd, (intptr_t)buf, len};
+    const int ret = SEMIHOST_SysCall(SYS_READ, &args[0]);
+    const int count = (ret < 0 || ret > len) ? 0 : len - ret;
+    PROF_RxFill(count, len);
+    return count;
+}
+
+/**
+ * @brief  Write all of a block to a semihosting file descriptor.
+ * @param  fd - semihosting file descriptor
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ */
+static void LINK_SemihostWrite(int fd, const uint8_t *buf, int len)
+{
+    while (len > 0)
+    {
+        intptr_t args[3] = {fd, (intptr_t)buf, len};
+        const int ret = SEMIHOST_SysCall(SYS_WRITE, &args[0]);
+        if (ret < 0 || ret >= len)
+        {
+            break; // error, or no progress at all
+        }
+        buf += len - ret;
+        len = ret;
+    }
+}
+
+/**
+ * @brief  Stage a short block for the host, or write a long run straight out.
+ * @param  fd - semihosting file descriptor
+ * @param  buf - source buffer
+ * @param  len - number of bytes to write
+ * @return None
+ * @note   SYS_WRITE needs the data in one piece, so the short pieces the SLIP
+ *         encoder writes (END bytes, escape pairs, headers) are put together
+ *         here and trap once. Runs of LINK_TX_DIRECT_MIN bytes or more are
+ *         written from where they are, after whatever is staged.
+ */
+static void LINK_Gather(int fd, const uint8_t *buf, int len)
+{
+#if LINK_TX_BUFFER_SIZE > 0
+    if (len < LINK_TX_DIRECT_MIN)
+    {
+        if (s_txLen + len > LINK_TX_BUFFER_SIZE)
+        {
+            s_stats.early++;
+            LINK_Drain(fd);
+        }
+        memcpy(&s_txBuffer[s_txLen], buf, len);
+        s_txLen += len;
+        return;
+    }
+    if (s_txLen > 0)
+    {
+        s_stats.early++;
+        LINK_Drain(fd);
+    }
+#endif
+    s_stats.direct++;
+    LINK_SemihostWrite(fd, buf, len);
+}
+
+/**
+ * @brief  Write out the staged bytes.
+ * @param  fd - semihosting file descriptor
+ * @return None
+ */
+static void LINK_Drain(int fd)
+{
+#if LINK_TX_BUFFER_SIZE > 0
+    if (s_txLen > 0)
+    {
+        LINK_SemihostWrite(fd, s_txBuffer, s_txLen);
+        s_txLen = 0;
+        s_stats.flushes++;
+        if (s_txFrames > s_stats.maxFrames)
+        {
+            s_stats.maxFrames = s_txFrames;
+        }
+        s_txFrames = 0;
+    }
+#else
+    (void)fd;
+#endif
+}
+
+/**
+ * @brief  Count a finished frame, and write out the queue past the high-water mark.
+ * @param  fd - semihosting file descriptor
+ * @return None
+ */
+static void LINK_FrameDone(int fd)
+{
+    s_stats.frames++;
+#if LINK_TX_BUFFER_SIZE > 0
+    s_txFrames++;
+    if (s_txLen >= LINK_TX_HIGH_WATER)
+    {
+        s_stats.early++;
+        LINK_Drain(fd);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+//       Filename: link.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the byte stream transport under the SLIP link
+//------------------------------------------------------------------------------
+//       Notes : The backend is picked at build time with CONFIG_LINK
+//               (make LINK=...), so there is no indirection at runtime.
+//               All backends move whole blocks, never single bytes.
+//               LINK_Write() may hold data back until LINK_Flush(), so the
+//               caller can write a frame in pieces without a trap per piece,
+//               and queue several frames for one trap. LINK_EndFrame()
+//               marks the frame boundaries.
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "rtt.h"
+
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+#define LINK_SEMIHOST (0) // semihosting stdin/stdout
+#define LINK_FILE     (1) // semihosting file opened with SYS_OPEN
+#define LINK_RTT      (2) // RTT rings, see rtt.h
+#define LINK_PTY      (3) // POSIX pty or stdin/stdout, host builds only
+
+#ifndef CONFIG_LINK
+#define CONFIG_LINK LINK_SEMIHOST
+#endif
+
+#if CONFIG_LINK == LINK_PTY && !defined(HOST)
+#error "LINK_PTY is only available in host builds"
+#endif
+
+// Host path opened by LINK_FILE, e.g. the pty socat links to
+#ifndef CONFIG_LINK_FILE_PATH
+#define CONFIG_LINK_FILE_PATH "slipVirtTTY"
+#endif
+
+// Bytes the semihosting backends stage before trapping: the END bytes, the
+// escape pairs and the runs shorter than LINK_TX_DIRECT_MIN, headers included.
+// 448 holds an encoded full size frame, so every frame is copied whole and
+// the link traps once per frame at most. Parts with 6K of RAM or more hold
+// two such frames and then some, so a main loop pass goes out in fewer traps
+// still. Smaller buffers trade traps for RAM: with 96 only the short pieces
+// are copied and the runs between them trap on their own; 0 traps on every
+// LINK_Write().
+#ifndef LINK_TX_BUFFER_SIZE
+#if defined(py32f003x7) || defined(py32f003x8) || defined(py32f030x8) || defined(py32f031x6)
+#define LINK_TX_BUFFER_SIZE (1024)
+#else
+#define LINK_TX_BUFFER_SIZE (448)
+#endif
+#endif
+
+// Runs this long or longer are written straight from the packet (uip_buf or
+// flash) instead of being copied, a trap each.
+#ifndef LINK_TX_DIRECT_MIN
+#define LINK_TX_DIRECT_MIN (LINK_TX_BUFFER_SIZE)
+#endif
+
+#if LINK_TX_DIRECT_MIN > LINK_TX_BUFFER_SIZE
+#error "LINK_TX_DIRECT_MIN must not be larger than LINK_TX_BUFFER_SIZE"
+#endif
+
+// Queued frames are written out at LINK_Flush(), or as soon as this many
+// bytes are waiting at the end of a frame. Writing out early never saves a
+// trap, the buffer goes out anyway when the next piece doesn't fit, so by
+// default that only happens once it is full; lower it to get frames to the
+// host sooner.
+#ifndef LINK_TX_HIGH_WATER
+#define LINK_TX_HIGH_WATER (LINK_TX_BUFFER_SIZE)
+#endif
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t frames;    // frames written
+    uint32_t flushes;   // writes of the staged bytes, semihosting links only
+    uint32_t early;     // of those, forced before LINK_Flush() by a full buffer,
+                        // a long run or the high-water mark
+    uint32_t direct;    // long runs written straight from the packet
+    uint32_t maxFrames; // most frame ends in one write
+} LINK_Stats_t;
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+void LINK_Init(void);
+int LINK_Read(uint8_t *buf, int len);
+void LINK_Write(const uint8_t *buf, int len);
+void LINK_EndFrame(void);
+void LINK_Flush(void);
+int LINK_Pending(void);
+const LINK_Stats_t *LINK_GetStats(void);
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
@@ -60,7 +60,7 @@ int _write(int fd, const char *buf, int size)
 {
     if (fd == SEMIHOST_STDOUT || fd == SEMIHOST_STDERR)
     {
-        int32_t args[3] = {fd, (int32_t)buf, size};
+        intptr_t args[3] = {fd, (intptr_t)buf, size};
         return SEMIHOST_SysCall(SYS_WRITE, &args[0]);
     }
     return 0; // Unsupported file descriptor
@@ -124,7 +124,7 @@ void LOG(const LogLevel_e level, const char *tag, char *format, ...)
             break;
     }
     printf(colour);
-    printf("%lu %c %s: ", *s_systick, indicator, tag);
+    printf("%lu %c %s: ", (unsigned long)*s_systick, indicator, tag);
     va_list args;
     va_start(args, format);
     vprintf(format, args);
@@ -11,34 +11,51 @@
 //------------------------------------------------------------------------------
 // Module includes
 //------------------------------------------------------------------------------
-#include "gpio.h"
+#include "clock.h"
+#include "idle.h"
+#include "link.h"
 #include "log.h"
+#include "prof.h"
 #include "semihost.h"
+#if defined(HOST)
+#include "host.h"
+#else
+#include "gpio.h"
 #include "system.h"
+#endif
 
 #include <string.h>
 
 #include "slipdev.h"
 #include "uip.h"
+#include "uip_split.h"
 
 //------------------------------------------------------------------------------
 // Module constant defines
 //------------------------------------------------------------------------------
 #define TAG "main"
 
-#define SYSTICK_ONE_MILLISECOND ((uint32_t)F_CPU / 1000)
-#define SYSTICK_ONE_MICROSECOND ((uint32_t)F_CPU / 1000000)
-#define millis()                (SysTick->VAL / SYSTICK_ONE_MILLISECOND)
-#define ticks()                 (SysTick->VAL)
+// uIP's TIME_WAIT timer and application polls count in units of this,
+// retransmissions have millisecond timers of their own
+#define PERIODIC_INTERVAL_MS (1000)
 
 #ifndef UNUSED
 #define UNUSED(x) (void)(x)
 #endif /* UNUSED */
 
+#ifndef UNIQUE_ID_ADDRESS
 #define UNIQUE_ID_ADDRESS 0x1FFF0000
+#endif
 
 #define API_HEADER "HTTP/1.0 200 OK\r\nServer: uIP/0.9\r\nContent-type: application/json\r\n\r\n"
 
+// Big enough for the largest profiler report, whatever its counters say
+#if CONFIG_PROFILE
+#define API_BUFFER_SIZE (sizeof(API_HEADER) + PROF_REPORT_SIZE)
+#else
+#define API_BUFFER_SIZE (256)
+#endif
+
 //------------------------------------------------------------------------------
 // External variables
 //------------------------------------------------------------------------------
@@ -62,8 +79,6 @@ static char s_uidString[16] = {0};
 //------------------------------------------------------------------------------
 // Module static variables
 //------------------------------------------------------------------------------
-// NOTE: this won't update while in a debugger halt
-static volatile uint32_t s_systick = 0;
 
 //------------------------------------------------------------------------------
 // Module static function prototypes
@@ -84,36 +99,18 @@ int getchar(void)
     return SEMIHOST_SysCall(SYS_READC, NULL);
 }
 
-void get_clock(void)
-{
-    static int last_clk = 0;
-    const int clk = SEMIHOST_SysCall(SYS_CLOCK, NULL);
-    s_systick += (clk - last_clk);
-    last_clk = clk;
-}
-
-/**
- * @brief  Read data from a file descriptor using semihosting.
- * @param  fd - file descriptor (SEMIHOST_STDIN)
- * @param  buf - pointer to the buffer to store read data
- * @param  count - number of bytes to read
- * @return The number of bytes read, or 0 if no data is available.
- */
-static inline int read(int fd, void *buf, int count)
-{
-    int32_t args[3] = {fd, (int32_t)buf, count};
-    int ret = SEMIHOST_SysCall(SYS_READ, &args[0]);
-    if (ret < 0) return 0;      // nothing
-    if (ret == 0) return count; // all bytes read
-    return count - ret;         // return number of bytes read
-}
-
 void uip_log(char *msg)
 {
     UNUSED(msg);
     // LOGI("uip", msg);
 }
 
+// Timebase for uIP's retransmission timers, see uip.h
+u16_t uip_clock(void)
+{
+    return (u16_t)CLOCK_Millis();
+}
+
 int main(void)
 {
     (void)snprintf(s_uidString, sizeof(s_uidString), "%.4s%.3s-%03u",
@@ -121,20 +118,23 @@ int main(void)
 
 #if 0   // enable for testing semihosting i/o
     char c;
+    LINK_Init();
     while (1)
     {
-        slipdev_char_put('.');
-        if (slipdev_char_poll((uint8_t *)&c))
+        LINK_Write((const uint8_t *)".", 1);
+        LINK_Flush();
+        if (LINK_Read((uint8_t *)&c, 1))
         {
             printf("You pressed: %c\n", c);
         }
         DLY_ms(500);
     }
 #elif 0 // test buffered read
-    char rx_buffer[10];
+    uint8_t rx_buffer[10];
+    LINK_Init();
     while (1)
     {
-        int ret = read(SEMIHOST_STDIN, rx_buffer, sizeof(rx_buffer));
+        int ret = LINK_Read(rx_buffer, sizeof(rx_buffer));
         if (ret != 0)
         {
             printf("Read %d bytes: \r\n", ret);
@@ -144,37 +144,105 @@ int main(void)
 
 #endif
 
+    CLOCK_Init();
+    LINK_Init();
     slipdev_init();
     uip_init();
     httpd_init();
 
-    uint32_t lastTicks = s_systick;
+    uint32_t lastPeriodic = CLOCK_Millis();
 
     for (;;)
     {
-       get_clock();
+        CLOCK_Sync();
+
+        uint32_t start = PROF_Start();
         uip_len = slipdev_poll();
-        if (uip_len > 0)
+        PROF_Stage(PROF_STAGE_POLL, start);
+        const int received = (uip_len > 0);
+        if (received)
         {
+            start = PROF_Start();
             uip_input();
+            PROF_Stage(PROF_STAGE_INPUT, start);
             if (uip_len > 0)
             {
-                slipdev_send();
+                start = PROF_Start();
+                uip_split_output();
+                PROF_Stage(PROF_STAGE_SEND, start);
+            }
+#if UIP_SEND_WINDOW > 1
+            // An ACK may have opened the window for more than one segment
+            for (uip_window(); uip_len > 0; uip_window())
+            {
+                IDLE_Activity();
+                start = PROF_Start();
+                uip_split_output();
+                PROF_Stage(PROF_STAGE_SEND, start);
+            }
+#endif
+        }
+
+        // Retransmission timers run out between the periodic sweeps. They
+        // build their packets in uip_buf too, so not while a frame is in it
+        if (!slipdev_busy() && uip_rtx_wait() == 0)
+        {
+            const uint32_t sweep = PROF_Start();
+            for (uint8_t i = uip_active; i < UIP_CONNS; i = uip_conns[i].next)
+            {
+                uip_rtx_timer(i);
+                if (uip_len > 0)
+                {
+                    start = PROF_Start();
+                    uip_split_output();
+                    PROF_Stage(PROF_STAGE_SEND, start);
+                }
             }
+            PROF_Stage(PROF_STAGE_PERIODIC, sweep);
+        }
+
+        // Poll flat out while frames are coming in, back off once it's quiet
+        // until whichever timer is next
+        if (received || uip_len > 0 || slipdev_busy())
+        {
+            IDLE_Activity();
+        }
+        else
+        {
+            const uint32_t periodic = lastPeriodic + PERIODIC_INTERVAL_MS;
+            const uint32_t rtx = CLOCK_Millis() + uip_rtx_wait();
+            IDLE_Wait((int32_t)(rtx - periodic) < 0 ? rtx : periodic);
         }
 
-        const uint32_t now = s_systick;
-        if (now - lastTicks >= 100)
+        // uIP builds its output in uip_buf, which may be holding half a
+        // frame: give it one more interval to finish before dropping it
+        const uint32_t now = CLOCK_Millis();
+        const uint32_t since = now - lastPeriodic;
+        if (since >= PERIODIC_INTERVAL_MS && (!slipdev_busy() || since >= 2 * PERIODIC_INTERVAL_MS))
         {
-            lastTicks = now;
-            for (uint8_t i = 0; i < UIP_CONNS; i++)
+            slipdev_abort();
+            lastPeriodic = now;
+            const uint32_t sweep = PROF_Start();
+            // Only connections in use have timers to run
+            uip_tick();
+            for (uint8_t i = uip_active; i < UIP_CONNS; i = uip_conns[i].next)
             {
                 uip_periodic(i);
                 if (uip_len > 0)
                 {
-                    slipdev_send();
+                    start = PROF_Start();
+                    uip_split_output();
+                    PROF_Stage(PROF_STAGE_SEND, start);
                 }
             }
+            PROF_Stage(PROF_STAGE_PERIODIC, sweep);
+        }
+
+        // Everything sent this time round goes out in one write, together
+        // with the replies to the frames already waiting behind this one
+        if (!received || !LINK_Pending())
+        {
+            LINK_Flush();
         }
     }
 }
@@ -189,7 +257,7 @@ int main(void)
 int uip_api_handler(const char *endpoint, char **data, int *len)
 {
     // tcpchecksum calculation uses 16-bit accesses
-    __attribute__((aligned(2))) static char responseBuffer[256] = API_HEADER;
+    __attribute__((aligned(2))) static char responseBuffer[API_BUFFER_SIZE] = API_HEADER;
 
     static char *const payloadStart = responseBuffer + sizeof(API_HEADER) - 1;
     static const size_t payloadCapacity = sizeof(responseBuffer) - sizeof(API_HEADER);
@@ -198,83 +266,107 @@ int uip_api_handler(const char *endpoint, char **data, int *len)
     {
         const int ret = snprintf(payloadStart, payloadCapacity,
                                  "{\"hits\":%lu,\"uid\":\"%s\",\"runtime\":%lu}\r\n",
-                                 hs->hits, s_uidString, s_systick/100);
+                                 (unsigned long)hs->hits, s_uidString, (unsigned long)CLOCK_Millis() / 1000);
         *data = responseBuffer;
         *len = (ret > 0) ? ret + sizeof(API_HEADER) - 1 : 0;
         return 1;
     }
-    return 0;
-}
-
-/**
- * @brief  SysTick interrupt handler.
- * @param  None
- * @return None
- */
-void SysTick_Handler(void)
-{
-    // s_systick++;
-}
-
-extern int _write(int file, char *ptr, int len);
-void slipdev_char_put(uint8_t c)
-{
-    (void)_write(SEMIHOST_STDOUT, (char *)&c, 1);
-}
-
-void slipdev_write(uint8_t *buf, uint16_t len)
-{
-    (void)_write(SEMIHOST_STDOUT, (char *)buf, len);
-}
-
-#if 0 // read 1 char at a time
-uint8_t slipdev_char_poll(uint8_t *c)
-{
-    int data = getchar();
-    if (data != -1)
+#if SLIP_STATISTICS
+    if (strcmp(endpoint, "slip") == 0)
     {
-        *c = data;
+#if SLIP_CSLIP
+        const int ret = snprintf(payloadStart, payloadCapacity,
+                                 "{\"reads\":%lu,\"bytes\":%lu,\"frames\":%lu,\"oversize\":%lu,\"aborted\":%lu,"
+                                 "\"cslip_in\":%lu,\"cslip_out\":%lu,\"tossed\":%lu}\r\n",
+                                 (unsigned long)slipdev_stat.reads, (unsigned long)slipdev_stat.bytes,
+                                 (unsigned long)slipdev_stat.frames, (unsigned long)slipdev_stat.oversize,
+                                 (unsigned long)slipdev_stat.aborted, (unsigned long)slipdev_stat.cslip_in,
+                                 (unsigned long)slipdev_stat.cslip_out, (unsigned long)slipdev_stat.tossed);
+#else
+        const int ret = snprintf(payloadStart, payloadCapacity,
+                                 "{\"reads\":%lu,\"bytes\":%lu,\"frames\":%lu,\"oversize\":%lu,\"aborted\":%lu}\r\n",
+                                 (unsigned long)slipdev_stat.reads, (unsigned long)slipdev_stat.bytes,
+                                 (unsigned long)slipdev_stat.frames, (unsigned long)slipdev_stat.oversize,
+                                 (unsigned long)slipdev_stat.aborted);
+#endif
+        *data = responseBuffer;
+        *len = (ret > 0) ? ret + sizeof(API_HEADER) - 1 : 0;
         return 1;
     }
-    else
+#endif
+#if UIP_DEMUX_STATISTICS
+    if (strcmp(endpoint, "demux") == 0)
     {
-        return 0;
+        const int ret = snprintf(payloadStart, payloadCapacity,
+                                 "{\"lookups\":%lu,\"hits\":%lu,\"probes\":%lu,\"misses\":%lu}\r\n",
+                                 (unsigned long)uip_demux_stat.lookups, (unsigned long)uip_demux_stat.hits,
+                                 (unsigned long)uip_demux_stat.probes, (unsigned long)uip_demux_stat.misses);
+        *data = responseBuffer;
+        *len = (ret > 0) ? ret + sizeof(API_HEADER) - 1 : 0;
+        return 1;
     }
-}
-#else // buffered read
-
-// This can be as big as the SLIP_BUFFER_SIZE for
-// the lowest latency or smaller for lower memory usage
-#define RX_BUFFER_SIZE 64
-uint8_t slipdev_char_poll(uint8_t *c)
-{
-    static uint8_t rx_buffer[RX_BUFFER_SIZE];
-    static int stored = 0;
-    static int sent = 0;
-
-    // Fill the buffer if empty
-    if (stored == 0)
+#endif
+    if (strcmp(endpoint, "link") == 0)
+    {
+        const LINK_Stats_t *const link = LINK_GetStats();
+        const int ret = snprintf(payloadStart, payloadCapacity,
+                                 "{\"frames\":%lu,\"flushes\":%lu,\"early\":%lu,\"direct\":%lu,\"max_frames\":%lu}\r\n",
+                                 (unsigned long)link->frames, (unsigned long)link->flushes,
+                                 (unsigned long)link->early, (unsigned long)link->direct,
+                                 (unsigned long)link->maxFrames);
+        *data = responseBuffer;
+        *len = (ret > 0) ? ret + sizeof(API_HEADER) - 1 : 0;
+        return 1;
+    }
+    if (strcmp(endpoint, "idle") == 0)
     {
-        stored = read(SEMIHOST_STDIN, rx_buffer, RX_BUFFER_SIZE);
+        const IDLE_Stats_t *const idle = IDLE_GetStats();
+        const int ret = snprintf(payloadStart, payloadCapacity,
+                                 "{\"sleeps\":%lu,\"wakeups\":%lu,\"early\":%lu,\"idle_ms\":%lu}\r\n",
+                                 (unsigned long)idle->sleeps, (unsigned long)idle->wakeups,
+                                 (unsigned long)idle->early, (unsigned long)idle->idleMs);
+        *data = responseBuffer;
+        *len = (ret > 0) ? ret + sizeof(API_HEADER) - 1 : 0;
+        return 1;
     }
-
-    // Return a character if available
-    if (stored != sent)
+#if CONFIG_PROFILE
+    // profile, profile/traps, profile/rx or profile/reset
+    if (strncmp(endpoint, "profile", 7) == 0 && (endpoint[7] == '\0' || endpoint[7] == '/'))
     {
-        *c = rx_buffer[sent++];
-        if (sent == stored)
+        const char *what = (endpoint[7] == '/') ? &endpoint[8] : "";
+        if (strcmp(what, "reset") == 0)
+        {
+            PROF_Reset();
+            what = "";
+        }
+        const int ret = PROF_Report(what, payloadStart, payloadCapacity);
+        if (ret < 0)
         {
-            sent = 0;
-            stored = 0;
+            return 0;
         }
+        *data = responseBuffer;
+        *len = ret + sizeof(API_HEADER) - 1;
         return 1;
     }
-    else
-    {
-        return 0;
-    }
-}
 #endif
+    return 0;
+}
+
+// SLIP device hooks, see slipdev.h
+void slipdev_write(const u8_t *buf, u16_t len)
+{
+    LINK_Write(buf, len);
+}
+
+void slipdev_flush(void)
+{
+    LINK_EndFrame();
+}
+
+u16_t slipdev_read(u8_t *buf, u16_t len)
+{
+    return LINK_Read(buf, len);
+}
 
 //------------------------------------------------------------------------------
 // Module static functions
@@ -0,0 +1,299 @@
+//------------------------------------------------------------------------------
+//       Filename: prof.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the main loop and semihosting profiler
+//------------------------------------------------------------------------------
+//       Notes : Times are in microseconds from CLOCK_Micros(). If SysTick
+//               stops while the core is halted, the time spent inside a
+//               semihosting call is invisible here and shows up in
+//               CLOCK_HaltedMillis() instead, so both are reported.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "prof.h"
+
+#if CONFIG_PROFILE
+#include "clock.h"
+#include "semihost.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t count;
+    uint32_t total;
+    uint32_t max;
+} prof_timer_t;
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+static const struct
+{
+    SEMIHOST_Reason_e reason;
+    const char *name;
+} s_trapNames[] = {
+    {SYS_READ, "read"},
+    {SYS_WRITE, "write"},
+    {SYS_READC, "readc"},
+    {SYS_CLOCK, "clock"},
+    {SYS_ELLAPSED, "elapsed"},
+};
+#define TRAP_OTHER (sizeof(s_trapNames) / sizeof(s_trapNames[0]))
+
+static const char *const s_stageNames[PROF_STAGE_MAX] = {
+    [PROF_STAGE_POLL] = "poll",
+    [PROF_STAGE_INPUT] = "input",
+    [PROF_STAGE_SEND] = "send",
+    [PROF_STAGE_PERIODIC] = "periodic",
+};
+
+static prof_timer_t s_stages[PROF_STAGE_MAX];
+static prof_timer_t s_traps[TRAP_OTHER + 1];
+static uint32_t s_rxBins[PROF_RX_BINS];
+static uint32_t s_haltedBase = 0;
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+static void PROF_Add(prof_timer_t *timer, uint32_t start);
+static int PROF_Append(char *buf, int len, int room, const char *fmt, ...);
+static int PROF_Timers(char *buf, int len, int size, const prof_timer_t *timers, int count,
+                       const char *(*name)(int));
+static const char *PROF_StageName(int index);
+static const char *PROF_TrapName(int index);
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Take a timestamp at the start of a measurement.
+ * @param  None
+ * @return Timestamp to pass to PROF_Stage() or PROF_Trap().
+ */
+uint32_t PROF_Start(void)
+{
+    return CLOCK_Micros();
+}
+
+/**
+ * @brief  Record one run of a main loop stage.
+ * @param  stage - the stage that just finished
+ * @param  start - timestamp from PROF_Start()
+ * @return None
+ */
+void PROF_Stage(PROF_Stage_e stage, uint32_t start)
+{
+    PROF_Add(&s_stages[stage], start);
+}
+
+/**
+ * @brief  Record one semihosting call.
+ * @param  reason - the semihosting operation code
+ * @param  start - timestamp from PROF_Start()
+ * @return None
+ */
+void PROF_Trap(int reason, uint32_t start)
+{
+    size_t i = 0;
+    while (i < TRAP_OTHER && s_trapNames[i].reason != reason)
+    {
+        i++;
+    }
+    PROF_Add(&s_traps[i], start);
+}
+
+/**
+ * @brief  Record how full a read left the RX buffer.
+ * @param  stored - number of bytes the read returned
+ * @param  size - size of the RX buffer
+ * @return None
+ */
+void PROF_RxFill(int stored, int size)
+{
+    int bin;
+    if (stored <= 0)
+    {
+        bin = 0;
+    }
+    else if (stored >= size)
+    {
+        bin = PROF_RX_BINS - 1;
+    }
+    else
+    {
+        bin = 1 + (stored - 1) * (PROF_RX_BINS - 2) / size;
+    }
+    s_rxBins[bin]++;
+}
+
+/**
+ * @brief  Clear all counters.
+ * @param  None
+ * @return None
+ */
+void PROF_Reset(void)
+{
+    memset(s_stages, 0, sizeof(s_stages));
+    memset(s_traps, 0, sizeof(s_traps));
+    memset(s_rxBins, 0, sizeof(s_rxBins));
+    s_haltedBase = CLOCK_HaltedMillis();
+}
+
+/**
+ * @brief  Format the counters as JSON.
+ * @param  what - "" for the main loop stages, "traps" or "rx"
+ * @param  buf - destination buffer
+ * @param  size - size of the destination buffer
+ * @return The length of the JSON, or -1 if what is unknown or buf is too
+ *         small for even an empty report.
+ * @note   Timers are reported as [count, total us, max us]. Entries that
+ *         don't fit in buf are left out, so the JSON is always complete.
+ */
+int PROF_Report(const char *what, char *buf, int size)
+{
+    static const char rxEnd[] = "]}\r\n";
+    int len;
+
+    if (what[0] == '\0')
+    {
+        len = snprintf(buf, size, "{\"halted_ms\":%lu",
+                       (unsigned long)(CLOCK_HaltedMillis() - s_haltedBase));
+        len = PROF_Timers(buf, len, size, s_stages, PROF_STAGE_MAX, PROF_StageName);
+    }
+    else if (strcmp(what, "traps") == 0)
+    {
+        len = snprintf(buf, size, "{");
+        len = PROF_Timers(buf, len, size, s_traps, TRAP_OTHER + 1, PROF_TrapName);
+    }
+    else if (strcmp(what, "rx") == 0)
+    {
+        const int room = size - (int)sizeof(rxEnd) + 1;
+        len = snprintf(buf, size, "{\"rx_bins\":[");
+        for (int i = 0; i < PROF_RX_BINS; i++)
+        {
+            const int next = PROF_Append(buf, len, room, "%s%lu", i ? "," : "",
+                                         (unsigned long)s_rxBins[i]);
+            if (next == len)
+            {
+                break;
+            }
+            len = next;
+        }
+        len += snprintf(&buf[len], size - len, "%s", rxEnd);
+    }
+    else
+    {
+        return -1;
+    }
+
+    return (len < size) ? len : -1;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Add one measurement to a timer.
+ * @param  timer - the timer to update
+ * @param  start - timestamp from PROF_Start()
+ * @return None
+ */
+static void PROF_Add(prof_timer_t *timer, uint32_t start)
+{
+    const uint32_t elapsed = CLOCK_Micros() - start;
+    timer->count++;
+    timer->total += elapsed;
+    if (elapsed > timer->max)
+    {
+        timer->max = elapsed;
+    }
+}
+
+/**
+ * @brief  Append to a report, unless that would leave no room to close it.
+ * @param  buf - the report
+ * @param  len - length of the report so far
+ * @param  room - size of buf, less what closing the report takes
+ * @param  fmt - printf style format
+ * @return The new length, or len if it didn't fit.
+ */
+static int PROF_Append(char *buf, int len, int room, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    const int n = (len < room) ? vsnprintf(&buf[len], room - len, fmt, args) : -1;
+    va_end(args);
+    return (n >= 0 && len + n < room) ? len + n : len;
+}
+
+/**
+ * @brief  Format a list of timers as the rest of a JSON object.
+ * @param  buf - the object, opened by the caller
+ * @param  len - length of the object so far
+ * @param  size - size of buf
+ * @param  timers - the timers
+ * @param  count - number of timers
+ * @param  name - returns the key of a timer
+ * @return The length of the closed object. Timers that don't fit are left
+ *         out.
+ */
+static int PROF_Timers(char *buf, int len, int size, const prof_timer_t *timers, int count,
+                       const char *(*name)(int))
+{
+    static const char end[] = "}\r\n";
+    const int room = size - (int)sizeof(end) + 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        const int next = PROF_Append(buf, len, room, "%s\"%s\":[%lu,%lu,%lu]",
+                                     (buf[len - 1] == '{') ? "" : ",", name(i),
+                                     (unsigned long)timers[i].count, (unsigned long)timers[i].total,
+                                     (unsigned long)timers[i].max);
+        if (next == len)
+        {
+            break;
+        }
+        len = next;
+    }
+    return len + snprintf(&buf[len], size - len, "%s", end);
+}
+
+static const char *PROF_StageName(int index)
+{
+    return s_stageNames[index];
+}
+
+static const char *PROF_TrapName(int index)
+{
+    return (index < (int)TRAP_OTHER) ? s_trapNames[index].name : "other";
+}
+
+#endif /* CONFIG_PROFILE */
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+//       Filename: prof.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the main loop and semihosting profiler API
+//------------------------------------------------------------------------------
+//       Notes : Build with PROFILE=1. Otherwise every call compiles to nothing.
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+// 1: count and time semihosting calls and main loop stages
+#ifndef CONFIG_PROFILE
+#define CONFIG_PROFILE (0)
+#endif
+
+// Bins of the RX buffer occupancy histogram, first is empty, last is full
+#define PROF_RX_BINS (8)
+
+// Buffer PROF_Report() needs for its longest report, the traps one with
+// every counter at UINT32_MAX, NUL included
+#define PROF_REPORT_SIZE (263)
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+typedef enum
+{
+    PROF_STAGE_POLL = 0,
+    PROF_STAGE_INPUT,
+    PROF_STAGE_SEND,
+    PROF_STAGE_PERIODIC,
+    PROF_STAGE_MAX,
+} PROF_Stage_e;
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+#if CONFIG_PROFILE
+uint32_t PROF_Start(void);
+void PROF_Stage(PROF_Stage_e stage, uint32_t start);
+void PROF_Trap(int reason, uint32_t start);
+void PROF_RxFill(int stored, int size);
+void PROF_Reset(void);
+int PROF_Report(const char *what, char *buf, int size);
+#else
+static inline uint32_t PROF_Start(void) { return 0; }
+static inline void PROF_Stage(PROF_Stage_e stage, uint32_t start) { (void)stage, (void)start; }
+static inline void PROF_Trap(int reason, uint32_t start) { (void)reason, (void)start; }
+static inline void PROF_RxFill(int stored, int size) { (void)stored, (void)size; }
+#endif
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
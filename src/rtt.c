@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+//       Filename: rtt.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Implements the RTT shared memory ring API
+//------------------------------------------------------------------------------
+//       Notes : Channel 0 only. The up buffer blocks when full, because
+//               dropping bytes would corrupt the SLIP stream.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "rtt.h"
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+RTT_ControlBlock_t _SEGGER_RTT;
+
+static uint8_t s_upBuffer[RTT_UP_BUFFER_SIZE];
+static uint8_t s_downBuffer[RTT_DOWN_BUFFER_SIZE];
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+/**
+ * @brief  Initialise the RTT control block.
+ * @param  None
+ * @return None
+ * @note   The ID is written last so the debugger never finds a half
+ *         initialised control block.
+ */
+void RTT_Init(void)
+{
+    RTT_ControlBlock_t *const cb = &_SEGGER_RTT;
+
+    cb->MaxNumUpBuffers = 1;
+    cb->MaxNumDownBuffers = 1;
+
+    cb->up[0].sName = "slip";
+    cb->up[0].pBuffer = s_upBuffer;
+    cb->up[0].SizeOfBuffer = sizeof(s_upBuffer);
+    cb->up[0].WrOff = 0;
+    cb->up[0].RdOff = 0;
+    cb->up[0].Flags = RTT_MODE_BLOCK_IF_FIFO_FULL;
+
+    cb->down[0].sName = "slip";
+    cb->down[0].pBuffer = s_downBuffer;
+    cb->down[0].SizeOfBuffer = sizeof(s_downBuffer);
+    cb->down[0].WrOff = 0;
+    cb->down[0].RdOff = 0;
+    cb->down[0].Flags = RTT_MODE_NO_BLOCK_SKIP;
+
+    RTT_DMB();
+    // Write the ID back to front, so a partial match is never seen
+    memcpy(&cb->acID[7], "RTT", 4);
+    RTT_DMB();
+    memcpy(&cb->acID[0], "SEGGER ", 7);
+    RTT_DMB();
+}
+
+/**
+ * @brief  Write data to the up buffer.
+ * @param  buf - pointer to the data
+ * @param  len - number of bytes to write
+ * @return The number of bytes written.
+ * @note   Blocks until the host has made room for all of the data.
+ */
+int RTT_Write(const void *buf, int len)
+{
+    RTT_Buffer_t *const ring = &_SEGGER_RTT.up[0];
+    const uint8_t *src = (const uint8_t *)buf;
+    const uint32_t size = ring->SizeOfBuffer;
+    uint32_t wr = ring->WrOff;
+    int remaining = len;
+
+    while (remaining > 0)
+    {
+        const uint32_t rd = ring->RdOff;
+
+        // One slot is always left empty to tell full from empty
+        uint32_t space = (rd > wr) ? rd - wr - 1 : size - wr - (rd == 0);
+        if (space == 0)
+        {
+            continue;
+        }
+        if (space > (uint32_t)remaining)
+        {
+            space = remaining;
+        }
+
+        memcpy(&ring->pBuffer[wr], src, space);
+        src += space;
+        remaining -= space;
+        wr += space;
+        if (wr == size)
+        {
+            wr = 0;
+        }
+
+        // Data must land before the host sees the new offset
+        RTT_DMB();
+        ring->WrOff = wr;
+    }
+
+    return len;
+}
+
+/**
+ * @brief  Read data from the down buffer.
+ * @param  buf - pointer to the destination buffer
+ * @param  len - maximum number of bytes to read
+ * @return The number of bytes read, or 0 if no data is available.
+ */
+int RTT_Read(void *buf, int len)
+{
+    RTT_Buffer_t *const ring = &_SEGGER_RTT.down[0];
+    uint8_t *dst = (uint8_t *)buf;
+    const uint32_t size = ring->SizeOfBuffer;
+    uint32_t rd = ring->RdOff;
+    int count = 0;
+
+    while (count < len)
+    {
+        const uint32_t wr = ring->WrOff;
+        if (wr == rd)
+        {
+            break;
+        }
+
+        // Contiguous run up to the write offset or the end of the buffer
+        uint32_t avail = (wr > rd) ? wr - rd : size - rd;
+        if (avail > (uint32_t)(len - count))
+        {
+            avail = len - count;
+        }
+
+        RTT_DMB();
+        memcpy(dst, &ring->pBuffer[rd], avail);
+        dst += avail;
+        count += avail;
+        rd += avail;
+        if (rd == size)
+        {
+            rd = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        // Data must be consumed before the host may overwrite it
+        RTT_DMB();
+        ring->RdOff = rd;
+    }
+
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
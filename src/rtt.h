@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+//       Filename: rtt.h
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Defines the RTT shared memory ring API
+//------------------------------------------------------------------------------
+//       Notes : The control block uses the SEGGER RTT layout, so any RTT
+//               capable debugger (pyocd, J-Link, OpenOCD) can find it by
+//               scanning RAM for the "SEGGER RTT" ID.
+//               Each ring is single producer, single consumer and lock free:
+//               only the producer writes WrOff and only the consumer
+//               writes RdOff.
+//------------------------------------------------------------------------------
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Module exported defines
+//------------------------------------------------------------------------------
+#define RTT_ID "SEGGER RTT"
+
+// Target -> host
+#ifndef RTT_UP_BUFFER_SIZE
+#define RTT_UP_BUFFER_SIZE (256)
+#endif
+
+// Host -> target
+#ifndef RTT_DOWN_BUFFER_SIZE
+#define RTT_DOWN_BUFFER_SIZE (128)
+#endif
+
+// Buffer flags, same values as SEGGER's
+#define RTT_MODE_NO_BLOCK_SKIP      (0)
+#define RTT_MODE_NO_BLOCK_TRIM      (1)
+#define RTT_MODE_BLOCK_IF_FIFO_FULL (2)
+
+#if defined(HOST)
+#define RTT_DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define RTT_DMB() __asm volatile("dmb" ::: "memory")
+#endif
+
+//------------------------------------------------------------------------------
+// Module exported type definitions
+//------------------------------------------------------------------------------
+typedef struct
+{
+    const char *sName;
+    uint8_t *pBuffer;
+    uint32_t SizeOfBuffer;
+    volatile uint32_t WrOff;
+    volatile uint32_t RdOff;
+    uint32_t Flags;
+} RTT_Buffer_t;
+
+typedef struct
+{
+    char acID[16];
+    int32_t MaxNumUpBuffers;
+    int32_t MaxNumDownBuffers;
+    RTT_Buffer_t up[1];
+    RTT_Buffer_t down[1];
+} RTT_ControlBlock_t;
+
+//------------------------------------------------------------------------------
+// Module exported variables
+//------------------------------------------------------------------------------
+extern RTT_ControlBlock_t _SEGGER_RTT;
+
+//------------------------------------------------------------------------------
+// Module exported functions
+//------------------------------------------------------------------------------
+void RTT_Init(void);
+int RTT_Write(const void *buf, int len);
+int RTT_Read(void *buf, int len);
+
+/**
+ * @brief  Check if the host has written anything to the down buffer.
+ * @param  None
+ * @return Non-zero if there is data to read.
+ */
+static inline int RTT_HasData(void)
+{
+    return _SEGGER_RTT.down[0].WrOff != _SEGGER_RTT.down[0].RdOff;
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
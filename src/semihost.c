@@ -32,6 +32,7 @@
 //------------------------------------------------------------------------------
 // Module static variables
 //------------------------------------------------------------------------------
+volatile uint32_t SEMIHOST_RxReady = SEMIHOST_RX_READY_UNKNOWN;
 
 //------------------------------------------------------------------------------
 // Module static function prototypes
@@ -16,6 +16,9 @@ extern "C" {
 //------------------------------------------------------------------------------
 // Module includes
 //------------------------------------------------------------------------------
+#include "prof.h"
+
+#include <stdint.h>
 
 //------------------------------------------------------------------------------
 // Module exported defines
@@ -24,6 +27,14 @@ extern "C" {
 #define SEMIHOST_STDOUT 1
 #define SEMIHOST_STDERR 2
 
+// SYS_OPEN modes, same order as fopen()'s
+#define SEMIHOST_OPEN_RB     1 // "rb"
+#define SEMIHOST_OPEN_RPLUSB 3 // "r+b"
+#define SEMIHOST_OPEN_WB     5 // "wb"
+
+// Value of SEMIHOST_RxReady until a debugger starts driving it
+#define SEMIHOST_RX_READY_UNKNOWN 0xFFFFFFFFUL
+
 //------------------------------------------------------------------------------
 // Module exported type definitions
 //------------------------------------------------------------------------------
@@ -53,17 +64,23 @@ typedef enum
 //------------------------------------------------------------------------------
 // Module exported variables
 //------------------------------------------------------------------------------
+// Set to 1 by the debugger when it has stdin data, cleared by the target
+extern volatile uint32_t SEMIHOST_RxReady;
 
 //------------------------------------------------------------------------------
 // Module exported functions
 //------------------------------------------------------------------------------
 /**
- * @brief  Perform a semihosting system call.
+ * @brief  Trap to the debugger.
  * @param  reason - the semihosting operation code
  * @param  arg - pointer to the argument array (if needed)
  * @return The result of the semihosting operation, typically stored in R0.
+ * @note   Host builds service the call with POSIX I/O instead of a BKPT (see host/host.c).
  */
-static inline int __attribute__((always_inline)) SEMIHOST_SysCall(SEMIHOST_Reason_e reason, void *arg)
+#if defined(HOST)
+int SEMIHOST_Trap(SEMIHOST_Reason_e reason, void *arg);
+#else
+static inline int __attribute__((always_inline)) SEMIHOST_Trap(SEMIHOST_Reason_e reason, void *arg)
 {
     int value;
     __asm volatile(
@@ -77,6 +94,50 @@ static inline int __attribute__((always_inline)) SEMIHOST_SysCall(SEMIHOST_Reaso
         : "r0", "r1", "r2", "memory");
     return value; // return result code, stored in R0
 }
+#endif
+
+/**
+ * @brief  Perform a semihosting system call.
+ * @param  reason - the semihosting operation code
+ * @param  arg - pointer to the argument array (if needed)
+ * @return The result of the semihosting operation, typically stored in R0.
+ */
+static inline int __attribute__((always_inline)) SEMIHOST_SysCall(SEMIHOST_Reason_e reason, void *arg)
+{
+#if CONFIG_PROFILE
+    const uint32_t start = PROF_Start();
+    const int value = SEMIHOST_Trap(reason, arg);
+    PROF_Trap(reason, start);
+    return value;
+#else
+    return SEMIHOST_Trap(reason, arg);
+#endif
+}
+
+/**
+ * @brief  Check if it is worth trapping to read stdin.
+ * @param  None
+ * @return Non-zero if SYS_READ may return data.
+ * @note   Costs a single load when the host has nothing to send.
+ *         The debugger only writes 1 when the flag is 0, and the target only
+ *         writes 0 when it is 1, so a ring is never lost. Debuggers that
+ *         don't know about the flag leave it at SEMIHOST_RX_READY_UNKNOWN,
+ *         and every call traps as before.
+ */
+static inline int SEMIHOST_RxPending(void)
+{
+    const uint32_t ready = SEMIHOST_RxReady;
+    if (ready == 0)
+    {
+        return 0;
+    }
+    if (ready != SEMIHOST_RX_READY_UNKNOWN)
+    {
+        // Clear before the read, so data arriving during it rings again
+        SEMIHOST_RxReady = 0;
+    }
+    return 1;
+}
 
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -0,0 +1,408 @@
+// Microbenchmark for the host bridge's SLIP and COBS codec.
+//
+// Times codec.c from tools/slip-macos against the code the bridge used
+// before it: an encoder that copied the packet out of the utun buffer,
+// encoded it into a second buffer and wrote that, and a decoder that
+// read() the device a byte at a time. Frames are MTU sized slices of a
+// random, a JPEG and a worst case payload. Encoders write to /dev/null,
+// decoders read a temporary file holding the encoded stream, so the
+// system calls are counted too. Reports packet MB/s per core, from the
+// thread's CPU time. Both encoders must produce the same bytes and both
+// decoders the original packets, or the run fails.
+
+#include "codec.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MTU 1500
+#define NULL_LOOPBACK_HEADER_SIZE 4
+#define MAX_PACKET_SIZE (MTU + NULL_LOOPBACK_HEADER_SIZE)
+
+// Same as the bridge
+#define RX_READ_SIZE 16384
+
+// Packet bytes per payload, and per timed pass
+#define STREAM_SIZE (4 << 20)
+// The byte at a time decoder only gets the start of the stream, at one
+// system call per byte it would take minutes
+#define OLD_DECODE_SIZE (256 << 10)
+
+#define ROUNDS 5
+
+#ifndef JPEG_PATH
+#define JPEG_PATH "../../lib/uip/fs/vapeserver.jpeg"
+#endif
+
+struct payload {
+    const char *name;
+    unsigned char *data;
+};
+
+static int framing;
+
+// The old bridge codec
+
+static int old_encode_slip(unsigned char *in, unsigned char *out, int length) {
+    int count = 0;
+    int i;
+
+    for (i = 0; i < length; i++) {
+        unsigned char c = *in;
+        if (c == SLIP_END) {
+            *out = SLIP_ESC;
+            out++;
+            *out = SLIP_ESC_END;
+            count++;
+        } else if (c == SLIP_ESC) {
+            *out = SLIP_ESC;
+            out++;
+            *out = SLIP_ESC_ESC;
+            count++;
+        } else {
+            *out = c;
+        }
+
+        in++;
+        out++;
+        count++;
+    }
+
+    *out = SLIP_END;
+    count++;
+
+    return count;
+}
+
+static int old_encode_cobs(unsigned char *in, unsigned char *out, int length) {
+    unsigned char *code = out;
+    unsigned char *start = out;
+    int i;
+
+    *out++ = 1;
+    for (i = 0; i < length; i++) {
+        if (in[i] == 0) {
+            code = out;
+            *out++ = 1;
+            continue;
+        }
+        *out++ = in[i];
+        if (++*code == COBS_MAX_CODE && i + 1 < length) {
+            code = out;
+            *out++ = 1;
+        }
+    }
+
+    *out++ = COBS_DELIM;
+
+    return out - start;
+}
+
+// Returns the decoded length, or -1 at the end of the stream or on errors
+static int old_next_slip_packet(int fd, unsigned char buf[MTU]) {
+    int i = 0;
+    unsigned char c;
+
+    while (1) {
+        if (read(fd, &c, 1) != 1) {
+            return -1;
+        }
+        if (c == SLIP_ESC) {
+            if (read(fd, &c, 1) != 1) {
+                return -1;
+            }
+            if (c == SLIP_ESC_END) {
+                c = SLIP_END;
+            } else if (c == SLIP_ESC_ESC) {
+                c = SLIP_ESC;
+            } else {
+                return -1;
+            }
+        } else if (c == SLIP_END) {
+            return i;
+        }
+        buf[i++] = c;
+    }
+}
+
+static int old_next_cobs_packet(int fd, unsigned char buf[MTU]) {
+    int i = 0;
+    int left = 0;
+    int zero = 0;
+    unsigned char c;
+
+    while (1) {
+        if (read(fd, &c, 1) != 1) {
+            return -1;
+        }
+        if (c == COBS_DELIM) {
+            return left ? -1 : i;
+        }
+        if (i == MTU) {
+            return -1;
+        }
+        if (left) {
+            buf[i++] = c;
+            left--;
+        } else {
+            if (zero) {
+                buf[i++] = 0;
+            }
+            left = c - 1;
+            zero = c != COBS_MAX_CODE;
+        }
+    }
+}
+
+// Helpers
+
+static double cpu_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int frame_len(size_t off, size_t size) {
+    return size - off < MTU ? size - off : MTU;
+}
+
+static void fill(struct payload *random, struct payload *jpeg,
+                 struct payload *escape) {
+    unsigned int seed = 0x12345678;
+    unsigned char *img = malloc(STREAM_SIZE);
+    size_t img_len = 0;
+    FILE *f = fopen(JPEG_PATH, "rb");
+
+    if (!f || (img_len = fread(img, 1, STREAM_SIZE, f)) == 0) {
+        perror(JPEG_PATH);
+        exit(1);
+    }
+    fclose(f);
+
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        random->data[i] = seed;
+        jpeg->data[i] = img[i % img_len];
+        if (framing == FRAMING_COBS) {
+            escape->data[i] = 0;
+        } else {
+            escape->data[i] = (i & 1) ? SLIP_END : SLIP_ESC;
+        }
+    }
+    free(img);
+}
+
+// Encoders, one pass over the payload, writing to fd
+
+static void encode_old(const struct payload *p, int fd) {
+    unsigned char buf[MAX_PACKET_SIZE];
+    unsigned char packet[MTU];
+    unsigned char encoded[CODEC_MAX_ENCODED(MTU)];
+
+    for (size_t off = 0; off < STREAM_SIZE; off += MTU) {
+        int len = frame_len(off, STREAM_SIZE);
+        int n;
+
+        // What read() from the utun does, then the copy out of it
+        memcpy(&buf[NULL_LOOPBACK_HEADER_SIZE], p->data + off, len);
+        memcpy(packet, &buf[NULL_LOOPBACK_HEADER_SIZE], len);
+        if (framing == FRAMING_COBS) {
+            n = old_encode_cobs(packet, encoded, len);
+        } else {
+            n = old_encode_slip(packet, encoded, len);
+        }
+        if (write(fd, encoded, n) != n) {
+            perror("write");
+            exit(1);
+        }
+    }
+}
+
+static void encode_new(const struct payload *p, int fd) {
+    unsigned char buf[MAX_PACKET_SIZE];
+    unsigned char scratch[CODEC_MAX_ENCODED(MTU)];
+    struct iovec iov[CODEC_MAX_IOV];
+
+    for (size_t off = 0; off < STREAM_SIZE; off += MTU) {
+        int len = frame_len(off, STREAM_SIZE);
+        ssize_t want = 0;
+        int cnt;
+
+        memcpy(&buf[NULL_LOOPBACK_HEADER_SIZE], p->data + off, len);
+        cnt = encode_frame(framing, &buf[NULL_LOOPBACK_HEADER_SIZE], len, iov,
+                           scratch);
+        for (int i = 0; i < cnt; i++) {
+            want += iov[i].iov_len;
+        }
+        // Files and /dev/null take it all, the bridge loops on short writes
+        if (writev(fd, iov, cnt) != want) {
+            perror("writev");
+            exit(1);
+        }
+    }
+}
+
+// Decoders, reading the encoded stream from fd. Return the packet bytes
+// decoded, or 0 if a frame doesn't match the payload.
+
+static size_t decode_old(const struct payload *p, int fd, size_t limit) {
+    unsigned char buf[MTU];
+    size_t off = 0;
+
+    lseek(fd, 0, SEEK_SET);
+    while (off < limit) {
+        int len = framing == FRAMING_COBS ? old_next_cobs_packet(fd, buf)
+                                          : old_next_slip_packet(fd, buf);
+        if (len != frame_len(off, STREAM_SIZE) ||
+            memcmp(buf, p->data + off, len)) {
+            return 0;
+        }
+        off += len;
+    }
+    return off;
+}
+
+static size_t decode_new(const struct payload *p, int fd, size_t limit) {
+    unsigned char rbuf[RX_READ_SIZE];
+    unsigned char buf[MTU];
+    struct decoder dec;
+    size_t off = 0;
+    ssize_t n;
+
+    decoder_init(&dec, framing, buf, MTU);
+    lseek(fd, 0, SEEK_SET);
+    while (off < limit && (n = read(fd, rbuf, sizeof(rbuf))) > 0) {
+        for (int i = 0; i < n;) {
+            int len;
+            i += decoder_feed(&dec, rbuf + i, n - i, &len);
+            if (!len) {
+                continue;
+            }
+            if (len != frame_len(off, STREAM_SIZE) ||
+                memcmp(buf, p->data + off, len)) {
+                return 0;
+            }
+            off += len;
+        }
+    }
+    return off;
+}
+
+// Best of ROUNDS, in packet MB per CPU second
+
+static double time_encode(void (*encode)(const struct payload *, int),
+                          const struct payload *p, int fd) {
+    double best = 0;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = cpu_seconds();
+        encode(p, fd);
+        double rate = STREAM_SIZE / (cpu_seconds() - start) / 1e6;
+        best = rate > best ? rate : best;
+    }
+    return best;
+}
+
+static double time_decode(size_t (*decode)(const struct payload *, int,
+                                           size_t),
+                          const struct payload *p, int fd, size_t limit,
+                          int *failed) {
+    double best = 0;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = cpu_seconds();
+        size_t bytes = decode(p, fd, limit);
+        double rate = bytes / (cpu_seconds() - start) / 1e6;
+        if (bytes < limit) {
+            *failed = 1;
+        }
+        best = rate > best ? rate : best;
+    }
+    return best;
+}
+
+// Encoded streams from both encoders must be the same
+static int same_stream(int a, int b) {
+    unsigned char x[RX_READ_SIZE];
+    unsigned char y[RX_READ_SIZE];
+    ssize_t n;
+
+    lseek(a, 0, SEEK_SET);
+    lseek(b, 0, SEEK_SET);
+    do {
+        n = read(a, x, sizeof(x));
+        if (n < 0 || read(b, y, n) != n || memcmp(x, y, n)) {
+            return 0;
+        }
+    } while (n > 0);
+    return read(b, y, 1) == 0;
+}
+
+static int temp_file(void) {
+    char path[] = "/tmp/bridgebenchXXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    struct payload random = {"random", malloc(STREAM_SIZE)};
+    struct payload jpeg = {"jpeg", malloc(STREAM_SIZE)};
+    struct payload escape = {"escape", malloc(STREAM_SIZE)};
+    const struct payload *payloads[] = {&random, &jpeg, &escape};
+    int failed = 0;
+
+    if (argc > 1 && strcmp(argv[1], "cobs") == 0) {
+        framing = FRAMING_COBS;
+    } else if (argc > 1 && strcmp(argv[1], "slip") != 0) {
+        fprintf(stderr, "Usage: %s [slip|cobs]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int null = open("/dev/null", O_WRONLY);
+    if (null < 0) {
+        perror("/dev/null");
+        exit(1);
+    }
+
+    fill(&random, &jpeg, &escape);
+
+    printf("%-8s %10s %10s %10s %10s  (%s, MB/s per core, %s scan)\n",
+           "payload", "enc old", "enc new", "dec old", "dec new",
+           framing == FRAMING_COBS ? "COBS" : "SLIP", codec_scan_name());
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        const struct payload *p = payloads[i];
+        int stream = temp_file();
+        int check = temp_file();
+        int bad = 0;
+
+        encode_new(p, stream);
+        encode_old(p, check);
+        bad |= !same_stream(stream, check);
+        close(check);
+
+        double enc_old = time_encode(encode_old, p, null);
+        double enc_new = time_encode(encode_new, p, null);
+        double dec_old = time_decode(decode_old, p, stream, OLD_DECODE_SIZE,
+                                     &bad);
+        double dec_new = time_decode(decode_new, p, stream, STREAM_SIZE, &bad);
+        close(stream);
+
+        printf("%-8s %10.1f %10.1f %10.1f %10.1f%s\n", p->name, enc_old,
+               enc_new, dec_old, dec_new, bad ? "  MISMATCH" : "");
+        failed |= bad;
+    }
+
+    return failed;
+}
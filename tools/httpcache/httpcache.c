@@ -0,0 +1,973 @@
+// Caching reverse proxy for the device's web server.
+//
+// Everything httpd serves from fsdata.c only changes when the device is
+// reflashed, so it is fetched across the link once and then served from
+// here. Given the firmware ELF (-e), the proxy reads the fsdata files out
+// of its symbol table and hashes each one; the hash is the file's ETag,
+// an answer from the device is cached only if it hashes the same, and
+// when the ELF changes the files that changed are dropped. Without an
+// ELF every 200 answer outside /api/ is cached until restart.
+// /api/ answers are kept for a short TTL (-t). Requests for something
+// already being fetched wait for that fetch instead of starting another,
+// and at most -n fetches run at once, the rest queue, so a burst of
+// clients costs the device one request per object.
+// One thread, non-blocking sockets, epoll (kqueue on macOS) through the
+// bridge's poller.
+
+#include "poller.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_UPSTREAM "192.168.190.2:80"
+#define DEFAULT_API_TTL_MS 1000
+#define DEFAULT_MAX_FETCHES 2
+
+#define API_PREFIX "/api/"
+// What httpd serves for /
+#define INDEX_FILE "/index.html.gz"
+// httpd looks no further for the end of the path
+#define MAX_PATH_LEN 35
+
+#define MAX_FDS 4096
+#define MAX_ENTRIES 64
+#define MAX_FILES 64
+#define REQUEST_SIZE 4096
+#define MAX_RESPONSE (1 << 20)
+#define HEAD_SIZE 256
+
+// To ask and be answered, not counting the wait for the device
+#define CLIENT_TIMEOUT_US 30000000
+#define FETCH_TIMEOUT_US 30000000
+// How often timeouts and the ELF are checked
+#define SWEEP_US 1000000
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// An answer from the device, shared by every client it is sent to
+struct body {
+    int refs;
+    size_t len;
+    size_t status_len; // the status line, our headers go after it
+    int status;
+    uint64_t hash;
+    char data[];
+};
+
+// A file from the ELF's fsdata
+struct file {
+    char path[MAX_PATH_LEN + 1];
+    uint64_t etag;
+};
+
+struct client;
+struct fetch;
+
+struct entry {
+    int used;
+    char path[MAX_PATH_LEN + 1];
+    int api;
+    struct body *body; // cached, or NULL
+    uint64_t fetched;
+    struct fetch *fetch;
+    int queued;
+    struct client *waiters;
+};
+
+struct client {
+    int fd;
+    uint64_t since;
+    char req[REQUEST_SIZE];
+    int req_len;
+    int has_etag;
+    uint64_t etag; // If-None-Match
+    struct entry *waiting;
+    struct client *next;
+    // The answer: status line, head, rest of body
+    struct body *body;
+    char head[HEAD_SIZE];
+    size_t head_len;
+    size_t pos;
+};
+
+struct fetch {
+    int fd;
+    uint64_t since;
+    struct entry *entry;
+    int connected;
+    char req[64];
+    int req_len;
+    int req_pos;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+static struct {
+    unsigned long requests;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long collapsed;
+    unsigned long not_modified;
+    unsigned long fetches;
+    unsigned long fetch_errors;
+    unsigned long mismatches; // answers that don't match the ELF
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+} stats;
+
+static struct poller poller;
+static int listen_fd;
+static struct client *clients[MAX_FDS];
+static struct fetch *fetches[MAX_FDS];
+static int watched[MAX_FDS];
+
+static struct entry entries[MAX_ENTRIES];
+static struct entry *queue[MAX_ENTRIES];
+static int queue_head;
+static int queue_len;
+static int running;
+
+static struct sockaddr_storage upstream;
+static socklen_t upstream_len;
+static int max_fetches = DEFAULT_MAX_FETCHES;
+static uint64_t api_ttl_us = DEFAULT_API_TTL_MS * 1000ULL;
+
+static const char *elf_path;
+static struct file files[MAX_FILES];
+static int nfiles;
+static time_t elf_mtime;
+static off_t elf_size;
+
+static volatile sig_atomic_t stats_wanted;
+static volatile sig_atomic_t quit_wanted;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t fnv1a(const void *p, size_t len) {
+    const unsigned char *b = p;
+    uint64_t h = FNV_OFFSET;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ b[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+static void print_stats(void) {
+    printf("requests: %lu, %lu hits, %lu misses, %lu collapsed, %lu not "
+           "modified\n",
+           stats.requests, stats.hits, stats.misses, stats.collapsed,
+           stats.not_modified);
+    printf("device: %lu fetches, %lu errors, %lu not matching the ELF, %llu "
+           "bytes in, %llu bytes out\n",
+           stats.fetches, stats.fetch_errors, stats.mismatches, stats.bytes_in,
+           stats.bytes_out);
+}
+
+static void on_signal(int sig) {
+    if (sig == SIGINT || sig == SIGTERM) {
+        quit_wanted = 1;
+    } else {
+        stats_wanted = 1;
+    }
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void watch(int fd, int events) {
+    if (events != watched[fd]) {
+        poller_set(&poller, fd, events, watched[fd]);
+        watched[fd] = events;
+    }
+}
+
+static void unwatch_close(int fd) {
+    // Closing it takes it out of the poller too
+    watched[fd] = 0;
+    close(fd);
+}
+
+static void body_put(struct body *b) {
+    if (b && --b->refs == 0) {
+        free(b);
+    }
+}
+
+// Firmware ELF
+
+static const struct file *file_find(const char *path) {
+    if (strcmp(path, "/") == 0) {
+        path = INDEX_FILE;
+    }
+    for (int i = 0; i < nfiles; i++) {
+        if (strcmp(files[i].path, path) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+// Little endian fields
+static uint64_t rd(const unsigned char *p, int n) {
+    uint64_t v = 0;
+
+    while (n--) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+// Section header fields, for ELF32 or ELF64
+#define SH_TYPE(sh) rd((sh) + 4, 4)
+#define SH_ADDR(sh, is64) ((is64) ? rd((sh) + 0x10, 8) : rd((sh) + 0x0c, 4))
+#define SH_OFFSET(sh, is64) ((is64) ? rd((sh) + 0x18, 8) : rd((sh) + 0x10, 4))
+#define SH_SIZE(sh, is64) ((is64) ? rd((sh) + 0x20, 8) : rd((sh) + 0x14, 4))
+#define SH_LINK(sh, is64) rd((sh) + ((is64) ? 0x28 : 0x18), 4)
+#define SHT_SYMTAB 2
+
+struct elf {
+    const unsigned char *p;
+    size_t size;
+    int is64;
+    uint64_t shoff;
+    unsigned shentsize;
+    unsigned shnum;
+};
+
+static const unsigned char *elf_section(const struct elf *elf, unsigned i) {
+    return elf->p + elf->shoff + (uint64_t)i * elf->shentsize;
+}
+
+// Bytes of a symbol, or NULL if they aren't in the file
+static const unsigned char *elf_bytes(const struct elf *elf, unsigned shndx,
+                                      uint64_t value, uint64_t len) {
+    if (shndx == 0 || shndx >= elf->shnum) {
+        return NULL;
+    }
+    const unsigned char *sh = elf_section(elf, shndx);
+    uint64_t addr = SH_ADDR(sh, elf->is64);
+    uint64_t offset = SH_OFFSET(sh, elf->is64);
+
+    if (value < addr || offset + (value - addr) + len > elf->size) {
+        return NULL;
+    }
+    return elf->p + offset + (value - addr);
+}
+
+// Finds the name_X and data_X arrays makefsdata writes for each file.
+// Little endian ELF32 (the target) or ELF64 (host builds).
+static int elf_parse(const unsigned char *p, size_t size) {
+    struct sym {
+        char key[64];
+        const unsigned char *p;
+        uint64_t len;
+    } names[MAX_FILES], datas[MAX_FILES];
+    int nnames = 0;
+    int ndatas = 0;
+    struct elf elf = {.p = p, .size = size};
+
+    if (size < 0x40 || memcmp(p, "\x7f" "ELF", 4) != 0 || p[5] != 1) {
+        return -1;
+    }
+    elf.is64 = p[4] == 2;
+    elf.shoff = elf.is64 ? rd(p + 0x28, 8) : rd(p + 0x20, 4);
+    elf.shentsize = rd(p + (elf.is64 ? 0x3a : 0x2e), 2);
+    elf.shnum = rd(p + (elf.is64 ? 0x3c : 0x30), 2);
+    if (elf.shoff + (uint64_t)elf.shnum * elf.shentsize > size) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < elf.shnum; i++) {
+        const unsigned char *sh = elf_section(&elf, i);
+        if (SH_TYPE(sh) != SHT_SYMTAB || SH_LINK(sh, elf.is64) >= elf.shnum) {
+            continue;
+        }
+        const unsigned char *strtab = elf_section(&elf, SH_LINK(sh, elf.is64));
+        uint64_t off = SH_OFFSET(sh, elf.is64);
+        uint64_t len = SH_SIZE(sh, elf.is64);
+        uint64_t stroff = SH_OFFSET(strtab, elf.is64);
+        uint64_t strsize = SH_SIZE(strtab, elf.is64);
+        uint64_t entsize = elf.is64 ? 24 : 16;
+
+        if (off + len > size || stroff + strsize > size) {
+            return -1;
+        }
+
+        for (uint64_t s = 0; s + entsize <= len; s += entsize) {
+            const unsigned char *sym = p + off + s;
+            uint64_t name = rd(sym, 4);
+            unsigned shndx = rd(sym + (elf.is64 ? 6 : 14), 2);
+            uint64_t value = elf.is64 ? rd(sym + 8, 8) : rd(sym + 4, 4);
+            uint64_t symsize = elf.is64 ? rd(sym + 16, 8) : rd(sym + 8, 4);
+
+            if (name >= strsize || !symsize) {
+                continue;
+            }
+            const char *n = (const char *)p + stroff + name;
+            int is_name = strncmp(n, "name_", 5) == 0;
+            if (!is_name && strncmp(n, "data_", 5) != 0) {
+                continue;
+            }
+            int *count = is_name ? &nnames : &ndatas;
+            struct sym *t = is_name ? &names[*count] : &datas[*count];
+            if (*count == MAX_FILES) {
+                continue;
+            }
+            // LTO renames statics to name_X.lto_priv.0
+            snprintf(t->key, sizeof(t->key), "%.*s", (int)strcspn(n + 5, "."),
+                     n + 5);
+            t->p = elf_bytes(&elf, shndx, value, symsize);
+            t->len = symsize;
+            if (t->p) {
+                (*count)++;
+            }
+        }
+    }
+
+    nfiles = 0;
+    for (int d = 0; d < ndatas; d++) {
+        for (int n = 0; n < nnames; n++) {
+            if (strcmp(datas[d].key, names[n].key) != 0 ||
+                names[n].len > MAX_PATH_LEN + 1 ||
+                names[n].p[names[n].len - 1] != 0) {
+                continue;
+            }
+            struct file *f = &files[nfiles++];
+            memcpy(f->path, names[n].p, names[n].len);
+            f->etag = fnv1a(datas[d].p, datas[d].len);
+            break;
+        }
+    }
+    return nfiles;
+}
+
+static void entry_release(struct entry *e);
+
+// Drops cached files the new ELF doesn't have, or has changed
+static void elf_load(void) {
+    struct stat st;
+    unsigned char *elf;
+    FILE *f;
+
+    if (stat(elf_path, &st) != 0) {
+        return;
+    }
+    if (st.st_mtime == elf_mtime && st.st_size == elf_size) {
+        return;
+    }
+    elf_mtime = st.st_mtime;
+    elf_size = st.st_size;
+
+    if (!(f = fopen(elf_path, "rb")) || !(elf = malloc(st.st_size))) {
+        perror(elf_path);
+        exit(1);
+    }
+    size_t size = fread(elf, 1, st.st_size, f);
+    fclose(f);
+
+    if (elf_parse(elf, size) <= 0) {
+        fprintf(stderr, "%s: no fsdata files found\n", elf_path);
+        nfiles = 0;
+    } else {
+        printf("%s: %d files\n", elf_path, nfiles);
+    }
+    free(elf);
+
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        struct entry *e = &entries[i];
+        const struct file *file = file_find(e->path);
+        if (e->used && e->body && !e->api &&
+            (!file || file->etag != e->body->hash)) {
+            body_put(e->body);
+            e->body = NULL;
+            entry_release(e);
+        }
+    }
+}
+
+// Cache
+
+static struct entry *entry_get(const char *path) {
+    struct entry *free_entry = NULL;
+
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].path, path) == 0) {
+            return &entries[i];
+        }
+        if (!entries[i].used && !free_entry) {
+            free_entry = &entries[i];
+        }
+    }
+    if (free_entry) {
+        memset(free_entry, 0, sizeof(*free_entry));
+        free_entry->used = 1;
+        strcpy(free_entry->path, path);
+        free_entry->api = strncmp(path, API_PREFIX, strlen(API_PREFIX)) == 0;
+    }
+    return free_entry;
+}
+
+// Nothing cached or in flight, nobody waiting
+static void entry_release(struct entry *e) {
+    if (!e->body && !e->fetch && !e->queued && !e->waiters) {
+        e->used = 0;
+    }
+}
+
+static int entry_fresh(const struct entry *e, uint64_t now) {
+    return e->body && (!e->api || now - e->fetched < api_ttl_us);
+}
+
+// Clients
+
+static void client_close(struct client *c) {
+    unwatch_close(c->fd);
+    clients[c->fd] = NULL;
+    body_put(c->body);
+    free(c);
+}
+
+static void client_send(struct client *c, struct body *b, const char *fmt,
+                        ...) __attribute__((format(printf, 3, 4)));
+
+// Sends b, or just the head if b is NULL, then closes
+static void client_send(struct client *c, struct body *b, const char *fmt,
+                        ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(c->head, sizeof(c->head), fmt, ap);
+    va_end(ap);
+    c->head_len = n < (int)sizeof(c->head) ? (size_t)n : sizeof(c->head) - 1;
+    // An answer without a status line is passed on as it is
+    if (b && !b->status_len) {
+        c->head_len = 0;
+    }
+    c->body = b;
+    if (b) {
+        b->refs++;
+    }
+    c->pos = 0;
+    c->waiting = NULL;
+    watch(c->fd, POLLER_OUT);
+}
+
+static void client_error(struct client *c, int code, const char *text) {
+    client_send(c, NULL,
+                "HTTP/1.0 %d %s\r\nConnection: close\r\nContent-Length: "
+                "0\r\n\r\n",
+                code, text);
+}
+
+// Sends a cached or fetched answer, or 304 if the client has it
+static void client_answer(struct client *c, struct body *b, int api,
+                          const char *how) {
+    if (api) {
+        client_send(c, b, "X-Cache: %s\r\nConnection: close\r\n", how);
+    } else if (c->has_etag && c->etag == b->hash) {
+        stats.not_modified++;
+        client_send(c, NULL,
+                    "HTTP/1.0 304 Not Modified\r\nETag: \"%016llx\"\r\n"
+                    "X-Cache: %s\r\nConnection: close\r\n\r\n",
+                    (unsigned long long)b->hash, how);
+    } else {
+        client_send(c, b,
+                    "ETag: \"%016llx\"\r\nX-Cache: %s\r\nConnection: close\r\n",
+                    (unsigned long long)b->hash, how);
+    }
+}
+
+static void iov_add(struct iovec *iov, int *cnt, size_t *skip, const char *p,
+                    size_t len) {
+    if (*skip >= len) {
+        *skip -= len;
+        return;
+    }
+    iov[*cnt].iov_base = (void *)(p + *skip);
+    iov[*cnt].iov_len = len - *skip;
+    (*cnt)++;
+    *skip = 0;
+}
+
+static void client_writable(struct client *c) {
+    struct iovec iov[3];
+    size_t skip = c->pos;
+    int cnt = 0;
+
+    if (c->body) {
+        iov_add(iov, &cnt, &skip, c->body->data, c->body->status_len);
+        iov_add(iov, &cnt, &skip, c->head, c->head_len);
+        iov_add(iov, &cnt, &skip, c->body->data + c->body->status_len,
+                c->body->len - c->body->status_len);
+    } else {
+        iov_add(iov, &cnt, &skip, c->head, c->head_len);
+    }
+
+    ssize_t n = writev(c->fd, iov, cnt);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            client_close(c);
+        }
+        return;
+    }
+    c->pos += n;
+    stats.bytes_out += n;
+    // HTTP/1.0, the close ends the answer
+    if (n == (ssize_t)(iov[0].iov_len + (cnt > 1 ? iov[1].iov_len : 0) +
+                       (cnt > 2 ? iov[2].iov_len : 0))) {
+        client_close(c);
+    }
+}
+
+// Fetches
+
+static void fetch_start(struct entry *e);
+
+static void fetch_next(void) {
+    while (queue_len && running < max_fetches) {
+        struct entry *e = queue[queue_head];
+        queue_head = (queue_head + 1) % MAX_ENTRIES;
+        queue_len--;
+        e->queued = 0;
+        fetch_start(e);
+    }
+}
+
+static struct body *body_make(const char *data, size_t len) {
+    struct body *b = malloc(sizeof(*b) + len);
+    const char *eol = memchr(data, '\n', len);
+
+    if (!b) {
+        return NULL;
+    }
+    b->refs = 1;
+    b->len = len;
+    memcpy(b->data, data, len);
+    b->hash = fnv1a(data, len);
+    b->status = 0;
+    b->status_len = 0;
+    if (eol && len > 12 && strncmp(data, "HTTP/", 5) == 0) {
+        b->status_len = eol - data + 1;
+        b->status = atoi(data + 9);
+    }
+    return b;
+}
+
+// ok is 0 if the fetch failed
+static void fetch_done(struct fetch *f, int ok) {
+    struct entry *e = f->entry;
+    struct body *b = ok && f->len ? body_make(f->buf, f->len) : NULL;
+    int cache = 0;
+
+    unwatch_close(f->fd);
+    fetches[f->fd] = NULL;
+    running--;
+    e->fetch = NULL;
+
+    if (!b) {
+        stats.fetch_errors++;
+    } else if (e->api || !elf_path) {
+        cache = b->status == 200;
+    } else {
+        const struct file *file = file_find(e->path);
+        cache = file && file->etag == b->hash;
+        if (file && !cache) {
+            stats.mismatches++;
+            fprintf(stderr, "%s: the device's copy doesn't match %s\n",
+                    e->path, elf_path);
+        }
+    }
+
+    if (cache) {
+        body_put(e->body);
+        e->body = b;
+        b->refs++;
+        e->fetched = now_us();
+    }
+
+    while (e->waiters) {
+        struct client *c = e->waiters;
+        e->waiters = c->next;
+        if (b) {
+            client_answer(c, b, e->api, "MISS");
+        } else {
+            client_error(c, 502, "Bad Gateway");
+        }
+    }
+
+    body_put(b);
+    free(f->buf);
+    free(f);
+    entry_release(e);
+    fetch_next();
+}
+
+static void fetch_start(struct entry *e) {
+    struct fetch *f;
+    int fd;
+
+    if (running >= max_fetches) {
+        queue[(queue_head + queue_len++) % MAX_ENTRIES] = e;
+        e->queued = 1;
+        return;
+    }
+
+    fd = socket(upstream.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || fd >= MAX_FDS || !(f = calloc(1, sizeof(*f)))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        stats.fetch_errors++;
+        while (e->waiters) {
+            struct client *c = e->waiters;
+            e->waiters = c->next;
+            client_error(c, 503, "Service Unavailable");
+        }
+        entry_release(e);
+        return;
+    }
+
+    set_nonblocking(fd);
+    f->fd = fd;
+    f->entry = e;
+    f->since = now_us();
+    f->req_len = snprintf(f->req, sizeof(f->req), "GET %s HTTP/1.0\r\n\r\n",
+                          e->path);
+    e->fetch = f;
+    fetches[fd] = f;
+    running++;
+    stats.fetches++;
+
+    if (connect(fd, (struct sockaddr *)&upstream, upstream_len) < 0 &&
+        errno != EINPROGRESS) {
+        fetch_done(f, 0);
+        return;
+    }
+    // Writable once connected
+    watch(fd, POLLER_OUT);
+}
+
+static void fetch_writable(struct fetch *f) {
+    if (!f->connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(f->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            fetch_done(f, 0);
+            return;
+        }
+        f->connected = 1;
+    }
+
+    ssize_t n = write(f->fd, f->req + f->req_pos, f->req_len - f->req_pos);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            fetch_done(f, 0);
+        }
+        return;
+    }
+    f->req_pos += n;
+    if (f->req_pos == f->req_len) {
+        watch(f->fd, POLLER_IN);
+    }
+}
+
+static void fetch_readable(struct fetch *f) {
+    while (1) {
+        if (f->len == f->cap) {
+            size_t cap = f->cap ? 2 * f->cap : 16384;
+            char *buf = cap <= MAX_RESPONSE ? realloc(f->buf, cap) : NULL;
+            if (!buf) {
+                fetch_done(f, 0);
+                return;
+            }
+            f->buf = buf;
+            f->cap = cap;
+        }
+
+        ssize_t n = read(f->fd, f->buf + f->len, f->cap - f->len);
+        if (n == 0) {
+            // httpd closes when it's done
+            fetch_done(f, 1);
+            return;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fetch_done(f, 0);
+            }
+            return;
+        }
+        f->len += n;
+        stats.bytes_in += n;
+    }
+}
+
+// Requests
+
+static void client_request(struct client *c) {
+    char path[MAX_PATH_LEN + 1];
+    const char *p = c->req + 4;
+    size_t len = strcspn(p, " \r\n");
+    uint64_t now = now_us();
+
+    stats.requests++;
+    if (strncmp(c->req, "GET ", 4) != 0) {
+        client_error(c, 405, "Method Not Allowed");
+        return;
+    }
+    if (len == 0 || len > MAX_PATH_LEN) {
+        client_error(c, 414, "URI Too Long");
+        return;
+    }
+    memcpy(path, p, len);
+    path[len] = 0;
+
+    // If-None-Match: "etag"
+    for (const char *h = strchr(c->req, '\n'); h; h = strchr(h + 1, '\n')) {
+        if (strncasecmp(h + 1, "If-None-Match:", 14) == 0) {
+            const char *q = strchr(h + 15, '"');
+            c->has_etag = q && sscanf(q + 1, "%16llx",
+                                      (unsigned long long *)&c->etag) == 1;
+        }
+    }
+
+    struct entry *e = entry_get(path);
+    if (!e) {
+        client_error(c, 503, "Service Unavailable");
+        return;
+    }
+    if (entry_fresh(e, now)) {
+        stats.hits++;
+        client_answer(c, e->body, e->api, "HIT");
+        return;
+    }
+
+    // Wait for the fetch, which may already be on its way
+    c->waiting = e;
+    c->next = e->waiters;
+    e->waiters = c;
+    watch(c->fd, 0);
+    if (e->fetch || e->queued) {
+        stats.collapsed++;
+    } else {
+        stats.misses++;
+        fetch_start(e);
+    }
+}
+
+static void client_readable(struct client *c) {
+    while (1) {
+        ssize_t n = read(c->fd, c->req + c->req_len,
+                         sizeof(c->req) - 1 - c->req_len);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                       errno != EINTR)) {
+            client_close(c);
+            return;
+        }
+        if (n < 0) {
+            return;
+        }
+        c->req_len += n;
+        c->req[c->req_len] = 0;
+        if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n")) {
+            client_request(c);
+            return;
+        }
+        if (c->req_len == sizeof(c->req) - 1) {
+            client_error(c, 431, "Request Header Fields Too Large");
+            return;
+        }
+    }
+}
+
+static void on_accept(void) {
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        struct client *c;
+
+        if (fd < 0) {
+            return;
+        }
+        if (fd >= MAX_FDS || !(c = calloc(1, sizeof(*c)))) {
+            close(fd);
+            continue;
+        }
+        set_nonblocking(fd);
+        c->fd = fd;
+        c->since = now_us();
+        clients[fd] = c;
+        watch(fd, POLLER_IN);
+    }
+}
+
+// Drops clients that take too long to ask, and fetches the device doesn't
+// finish
+static void sweep(void) {
+    uint64_t now = now_us();
+
+    for (int fd = 0; fd < MAX_FDS; fd++) {
+        if (clients[fd] && !clients[fd]->waiting &&
+            now - clients[fd]->since > CLIENT_TIMEOUT_US) {
+            client_close(clients[fd]);
+        } else if (fetches[fd] && now - fetches[fd]->since > FETCH_TIMEOUT_US) {
+            fetch_done(fetches[fd], 0);
+        }
+    }
+    if (elf_path) {
+        elf_load();
+    }
+    poller_timer(&poller, SWEEP_US);
+}
+
+static void run(void) {
+    struct poll_event events[8];
+
+    poller_timer(&poller, SWEEP_US);
+    while (!quit_wanted) {
+        if (stats_wanted) {
+            stats_wanted = 0;
+            print_stats();
+        }
+
+        int n = poller_wait(&poller, events, 8);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].fd;
+            if (fd == POLLER_TIMER) {
+                sweep();
+            } else if (fd == listen_fd) {
+                on_accept();
+            } else if (fetches[fd]) {
+                if (events[i].events & POLLER_OUT) {
+                    fetch_writable(fetches[fd]);
+                } else {
+                    fetch_readable(fetches[fd]);
+                }
+            } else if (clients[fd]) {
+                if (events[i].events & POLLER_OUT) {
+                    client_writable(clients[fd]);
+                } else {
+                    client_readable(clients[fd]);
+                }
+            }
+        }
+    }
+    print_stats();
+}
+
+static void resolve(const char *address) {
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    struct addrinfo hints = {0};
+    struct addrinfo *res;
+
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(host, sizeof(host), "%.*s",
+             colon ? (int)(colon - address) : (int)strlen(address), address);
+    if (getaddrinfo(host, colon ? colon + 1 : "80", &hints, &res) != 0) {
+        fprintf(stderr, "Unable to resolve %s\n", address);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&upstream, res->ai_addr, res->ai_addrlen);
+    upstream_len = res->ai_addrlen;
+    freeaddrinfo(res);
+}
+
+int main(int argc, char **argv) {
+    const char *address = DEFAULT_UPSTREAM;
+    int port = DEFAULT_PORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:l:n:t:u:")) != -1) {
+        switch (opt) {
+        case 'e':
+            elf_path = optarg;
+            break;
+        case 'l':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            max_fetches = atoi(optarg);
+            break;
+        case 't':
+            api_ttl_us = atoi(optarg) * 1000ULL;
+            break;
+        case 'u':
+            address = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-e firmware.elf] [-l port] [-n fetches] [-t "
+                    "api_ttl_ms] [-u device:port]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (max_fetches < 1 || max_fetches > MAX_ENTRIES) {
+        fprintf(stderr, "-n must be 1 to %d\n", MAX_ENTRIES);
+        exit(EXIT_FAILURE);
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    resolve(address);
+    if (elf_path) {
+        elf_load();
+        if (!nfiles) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct sockaddr_in sin = {0};
+    int one = 1;
+
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&sin,
+                              sizeof(sin)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+    set_nonblocking(listen_fd);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    poller_init(&poller);
+    poller_set(&poller, listen_fd, POLLER_IN, 0);
+    printf("Listening on port %d for %s\n", port, address);
+
+    run();
+
+    return 0;
+}
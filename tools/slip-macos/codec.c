@@ -0,0 +1,394 @@
+// SLIP and COBS framing for the bridge, see codec.h
+
+#include "codec.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CODEC_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CODEC_NEON
+#endif
+
+// Runs shorter than this are copied into the scratch buffer instead of
+// getting an iovec of their own
+#define SHORT_RUN 16
+
+#define COBS_MAX_RUN (COBS_MAX_CODE - 1)
+
+typedef size_t (*scan_fn)(const unsigned char *p, size_t n);
+
+struct emit {
+    struct iovec *iov;
+    int cnt;
+    int staged; // the last iovec points into the scratch buffer
+    unsigned char *scratch;
+    size_t used;
+};
+
+static scan_fn scan_impl;
+static const char *scan_name;
+
+// Scanning for END and ESC
+
+static size_t scan_slip_scalar(const unsigned char *p, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (p[i] == SLIP_END || p[i] == SLIP_ESC) {
+            break;
+        }
+    }
+    return i;
+}
+
+#ifdef CODEC_X86
+static size_t scan_slip_sse2(const unsigned char *p, size_t n) {
+    const __m128i end = _mm_set1_epi8((char)SLIP_END);
+    const __m128i esc = _mm_set1_epi8((char)SLIP_ESC);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, end), _mm_cmpeq_epi8(v, esc)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_slip_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_slip_avx2(const unsigned char *p, size_t n) {
+    const __m256i end = _mm256_set1_epi8((char)SLIP_END);
+    const __m256i esc = _mm256_set1_epi8((char)SLIP_ESC);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, end), _mm256_cmpeq_epi8(v, esc)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_slip_sse2(p + i, n - i);
+}
+#endif
+
+#ifdef CODEC_NEON
+static size_t scan_slip_neon(const unsigned char *p, size_t n) {
+    const uint8x16_t end = vdupq_n_u8(SLIP_END);
+    const uint8x16_t esc = vdupq_n_u8(SLIP_ESC);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t hit = vorrq_u8(vceqq_u8(v, end), vceqq_u8(v, esc));
+        // Narrow to 4 bits per byte to get a mask that fits in 64 bits
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    return i + scan_slip_scalar(p + i, n - i);
+}
+#endif
+
+static void scan_select(void) {
+#if defined(CODEC_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_name = "avx2";
+        scan_impl = scan_slip_avx2;
+    } else {
+        scan_name = "sse2";
+        scan_impl = scan_slip_sse2;
+    }
+#elif defined(CODEC_NEON)
+    scan_name = "neon";
+    scan_impl = scan_slip_neon;
+#else
+    scan_name = "scalar";
+    scan_impl = scan_slip_scalar;
+#endif
+}
+
+// Count the bytes at p before the first END or ESC, at most n
+size_t scan_slip(const unsigned char *p, size_t n) {
+    if (!scan_impl) {
+        scan_select();
+    }
+    return scan_impl(p, n);
+}
+
+const char *codec_scan_name(void) {
+    if (!scan_impl) {
+        scan_select();
+    }
+    return scan_name;
+}
+
+// Encoding
+
+// Account for n bytes just written at the end of the scratch buffer
+static void emit_staged(struct emit *e, size_t n) {
+    if (e->staged) {
+        e->iov[e->cnt - 1].iov_len += n;
+    } else {
+        e->iov[e->cnt].iov_base = e->scratch + e->used;
+        e->iov[e->cnt].iov_len = n;
+        e->cnt++;
+        e->staged = 1;
+    }
+    e->used += n;
+}
+
+static void emit_copy(struct emit *e, const void *p, size_t n) {
+    memcpy(e->scratch + e->used, p, n);
+    emit_staged(e, n);
+}
+
+static void emit_ref(struct emit *e, const unsigned char *p, size_t n) {
+    // Out of iovecs, copy the rest
+    if (n < SHORT_RUN || e->cnt >= CODEC_MAX_IOV - 2) {
+        emit_copy(e, p, n);
+        return;
+    }
+    e->iov[e->cnt].iov_base = (void *)p;
+    e->iov[e->cnt].iov_len = n;
+    e->cnt++;
+    e->staged = 0;
+}
+
+// Escape bytes one at a time into the scratch buffer, where END and ESC
+// are too close together for scanning to pay. Stops after SHORT_RUN plain
+// bytes in a row, returns the bytes used.
+static size_t stage_slip(struct emit *e, const unsigned char *in, size_t len) {
+    unsigned char *start = e->scratch + e->used;
+    unsigned char *out = start;
+    size_t plain = 0;
+    size_t i;
+
+    for (i = 0; i < len && plain < SHORT_RUN; i++) {
+        unsigned char c = in[i];
+        if (c == SLIP_END) {
+            *out++ = SLIP_ESC;
+            *out++ = SLIP_ESC_END;
+            plain = 0;
+        } else if (c == SLIP_ESC) {
+            *out++ = SLIP_ESC;
+            *out++ = SLIP_ESC_ESC;
+            plain = 0;
+        } else {
+            *out++ = c;
+            plain++;
+        }
+    }
+    emit_staged(e, out - start);
+    return i;
+}
+
+static void encode_slip(struct emit *e, const unsigned char *in, size_t len) {
+    static const unsigned char end = SLIP_END;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run = scan_slip(in + i, len - i);
+        if (run >= SHORT_RUN) {
+            emit_ref(e, in + i, run);
+            i += run;
+        }
+        if (i < len) {
+            i += stage_slip(e, in + i, len - i);
+        }
+    }
+    emit_copy(e, &end, 1);
+}
+
+static void encode_cobs(struct emit *e, const unsigned char *in, size_t len) {
+    static const unsigned char delim = COBS_DELIM;
+    size_t i = 0;
+
+    while (1) {
+        size_t max = len - i < COBS_MAX_RUN ? len - i : COBS_MAX_RUN;
+        const unsigned char *zero = memchr(in + i, 0, max);
+        size_t run = zero ? (size_t)(zero - (in + i)) : max;
+        unsigned char code = run + 1;
+
+        if (run == 0 && i < len) {
+            // A run of zeros, each one an empty block
+            size_t zeros = 1;
+            while (i + zeros < len && in[i + zeros] == 0) {
+                zeros++;
+            }
+            memset(e->scratch + e->used, 1, zeros);
+            emit_staged(e, zeros);
+            i += zeros;
+            continue;
+        }
+        emit_copy(e, &code, 1);
+        if (run) {
+            emit_ref(e, in + i, run);
+            i += run;
+        }
+        if (i == len) {
+            break; // the last block stands for no zero
+        }
+        if (run < COBS_MAX_RUN) {
+            i++; // the zero the code stands for
+        }
+    }
+    emit_copy(e, &delim, 1);
+}
+
+// Encode a packet for writev(). scratch must hold CODEC_MAX_ENCODED(len)
+// bytes, and iov CODEC_MAX_IOV entries. Returns the number of iovecs used,
+// which point into in and scratch.
+int encode_frame(int framing, const unsigned char *in, int len,
+                 struct iovec *iov, unsigned char *scratch) {
+    struct emit e = {iov, 0, 0, scratch, 0};
+
+    if (framing == FRAMING_COBS) {
+        encode_cobs(&e, in, len);
+    } else {
+        encode_slip(&e, in, len);
+    }
+    return e.cnt;
+}
+
+// Decoding
+
+void decoder_init(struct decoder *d, int framing, unsigned char *buf,
+                  int cap) {
+    memset(d, 0, sizeof(*d));
+    d->framing = framing;
+    d->buf = buf;
+    d->cap = cap;
+}
+
+static void put(struct decoder *d, const unsigned char *p, size_t n) {
+    if (d->bad) {
+        return;
+    }
+    if (d->len + n > (size_t)d->cap) {
+        d->oversize++;
+        d->bad = 1;
+        return;
+    }
+    memcpy(d->buf + d->len, p, n);
+    d->len += n;
+}
+
+// A delimiter: returns the frame length, or 0 if there is no good frame
+static int end_frame(struct decoder *d) {
+    int len = d->bad ? 0 : d->len;
+
+    d->len = 0;
+    d->bad = 0;
+    d->esc = 0;
+    d->left = 0;
+    d->zero = 0;
+    if (len > 0) {
+        d->frames++;
+    }
+    return len;
+}
+
+static int feed_slip(struct decoder *d, const unsigned char *in, int n,
+                     int *frame_len) {
+    int i = 0;
+    unsigned char c;
+
+    while (i < n) {
+        if (d->esc) {
+            d->esc = 0;
+            c = in[i];
+            if (c == SLIP_ESC_END) {
+                c = SLIP_END;
+            } else if (c == SLIP_ESC_ESC) {
+                c = SLIP_ESC;
+            } else {
+                // Bad escape, skip the frame. An END still ends it.
+                d->errors++;
+                d->bad = 1;
+                continue;
+            }
+            put(d, &c, 1);
+            i++;
+            continue;
+        }
+
+        size_t run = scan_slip(in + i, n - i);
+        if (run) {
+            put(d, in + i, run);
+            i += run;
+            if (i == n) {
+                break;
+            }
+        }
+
+        if (in[i++] == SLIP_ESC) {
+            d->esc = 1;
+        } else if ((*frame_len = end_frame(d)) > 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+static int feed_cobs(struct decoder *d, const unsigned char *in, int n,
+                     int *frame_len) {
+    int i = 0;
+    unsigned char c;
+
+    while (i < n) {
+        if (d->left) {
+            size_t max = d->left < n - i ? d->left : n - i;
+            const unsigned char *zero = memchr(in + i, 0, max);
+            size_t run = zero ? (size_t)(zero - (in + i)) : max;
+
+            put(d, in + i, run);
+            i += run;
+            d->left -= run;
+            if (zero) {
+                // Cut short, the delimiter ends the broken frame
+                d->errors++;
+                d->bad = 1;
+                d->left = 0;
+            }
+            continue;
+        }
+
+        c = in[i++];
+        if (c == COBS_DELIM) {
+            if ((*frame_len = end_frame(d)) > 0) {
+                return i;
+            }
+            continue;
+        }
+
+        // A code byte, so the last block wasn't the end of the frame
+        if (d->zero) {
+            put(d, (const unsigned char *)"", 1);
+        }
+        d->left = c - 1;
+        d->zero = c != COBS_MAX_CODE;
+    }
+    return n;
+}
+
+// Decode up to n bytes. Returns how many were used; if they completed a
+// frame, stops there and sets *frame_len to its length in d->buf, which
+// stays valid until the next call. Otherwise *frame_len is 0.
+int decoder_feed(struct decoder *d, const unsigned char *in, int n,
+                 int *frame_len) {
+    *frame_len = 0;
+    if (d->framing == FRAMING_COBS) {
+        return feed_cobs(d, in, n, frame_len);
+    }
+    return feed_slip(d, in, n, frame_len);
+}
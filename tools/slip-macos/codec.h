@@ -0,0 +1,58 @@
+// SLIP and COBS framing for the bridge.
+//
+// Decoding works on whole blocks as read() returns them and keeps its
+// state between calls, so frames may be split across reads anywhere.
+// Encoding doesn't copy the packet: it fills an iovec array with runs of
+// the packet itself, and puts only escapes, code bytes and short runs in
+// a scratch buffer, ready for writev().
+// Plain C, with SSE2/AVX2 (x86) or NEON (arm64) scans where available.
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define FRAMING_SLIP 0
+#define FRAMING_COBS 1
+
+#define SLIP_END 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+#define COBS_DELIM 0x00
+#define COBS_MAX_CODE 0xff
+
+// Worst case size of an encoded packet, SLIP with every byte escaped
+#define CODEC_MAX_ENCODED(len) (2 * (len) + 2)
+
+// iovecs encode_frame() may use for one frame
+#define CODEC_MAX_IOV 64
+
+struct decoder {
+    int framing;
+    unsigned char *buf; // decoded frame
+    int cap;
+    int len;
+    int esc;  // SLIP: the last byte was an ESC
+    int left; // COBS: bytes left in the block
+    int zero; // COBS: a zero follows the block, unless it ends the frame
+    int bad;  // skipping to the end of a broken or oversize frame
+
+    unsigned long frames;
+    unsigned long errors;   // bad escapes or cut short COBS blocks
+    unsigned long oversize; // frames longer than cap
+};
+
+void decoder_init(struct decoder *d, int framing, unsigned char *buf, int cap);
+int decoder_feed(struct decoder *d, const unsigned char *in, int n,
+                 int *frame_len);
+
+int encode_frame(int framing, const unsigned char *in, int len,
+                 struct iovec *iov, unsigned char *scratch);
+
+size_t scan_slip(const unsigned char *p, size_t n);
+const char *codec_scan_name(void);
+
+#endif // CODEC_H
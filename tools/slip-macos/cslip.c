@@ -0,0 +1,415 @@
+// Van Jacobson TCP/IP header compression (RFC 1144) for the SLIP bridge.
+//
+// Compression is only used with -c, and stops again if the peer never
+// answers in kind, so the bridge still works with plain SLIP devices.
+// Decompression is always on: a plain SLIP peer never sends a first
+// byte with the top bit set, or 0x7x.
+
+#include "cslip.h"
+
+#include <string.h>
+
+// Bits in the change mask
+#define NEW_C 0x40
+#define NEW_I 0x20
+#define NEW_S 0x08
+#define NEW_A 0x04
+#define NEW_W 0x02
+#define NEW_U 0x01
+#define TCP_PUSH_BIT 0x10
+
+#define SPECIAL_I (NEW_S | NEW_W | NEW_U)
+#define SPECIAL_D (NEW_S | NEW_A | NEW_W | NEW_U)
+#define SPECIALS_MASK (NEW_S | NEW_A | NEW_W | NEW_U)
+
+// IP header offsets
+#define IP_TOS 1
+#define IP_LEN 2
+#define IP_ID 4
+#define IP_OFFSET 6
+#define IP_TTL 8
+#define IP_PROTO 9
+#define IP_CHKSUM 10
+#define IP_ADDRS 12
+#define IP_HDR_LEN 20
+#define IP_PROTO_TCP 6
+
+// TCP header offsets
+#define TCP_SEQ 4
+#define TCP_ACK 8
+#define TCP_OFFSET 12
+#define TCP_FLAGS 13
+#define TCP_WND 14
+#define TCP_CHKSUM 16
+#define TCP_URGP 18
+#define TCP_HDR_LEN 20
+
+#define TH_FIN 0x01
+#define TH_SYN 0x02
+#define TH_RST 0x04
+#define TH_PUSH 0x08
+#define TH_ACK 0x10
+#define TH_URG 0x20
+
+static unsigned get16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+static void put16(unsigned char *p, unsigned n) {
+    p[0] = n >> 8;
+    p[1] = n;
+}
+
+static unsigned long get32(const unsigned char *p) {
+    return ((unsigned long)get16(p) << 16) | get16(p + 2);
+}
+
+static void put32(unsigned char *p, unsigned long n) {
+    put16(p, (n >> 16) & 0xffff);
+    put16(p + 2, n & 0xffff);
+}
+
+static unsigned char *encode(unsigned char *cp, unsigned n) {
+    n &= 0xffff;
+    if (n == 0 || n >= 256) {
+        *cp++ = 0;
+        *cp++ = n >> 8;
+    }
+    *cp++ = n;
+    return cp;
+}
+
+static unsigned decode(const unsigned char **cp) {
+    const unsigned char *p = *cp;
+    if (*p == 0) {
+        *cp = p + 3;
+        return get16(p + 1);
+    }
+    *cp = p + 1;
+    return *p;
+}
+
+static int header_length(const unsigned char *ip, int len) {
+    int ihl = (ip[0] & 0x0f) * 4;
+    if (ihl < IP_HDR_LEN || len < ihl + TCP_HDR_LEN) {
+        return -1;
+    }
+    int hlen = ihl + (ip[ihl + TCP_OFFSET] >> 4) * 4;
+    if (hlen < ihl + TCP_HDR_LEN || hlen > len || hlen > CSLIP_MAX_HDR) {
+        return -1;
+    }
+    return hlen;
+}
+
+static void ip_checksum(unsigned char *ip) {
+    unsigned long sum = 0;
+    int ihl = (ip[0] & 0x0f) * 4;
+
+    put16(&ip[IP_CHKSUM], 0);
+    for (int i = 0; i < ihl; i += 2) {
+        sum += get16(&ip[i]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    put16(&ip[IP_CHKSUM], ~sum & 0xffff);
+}
+
+void cslip_init(struct cslip *c, int tx_slots) {
+    memset(c, 0, sizeof(*c));
+    if (tx_slots > CSLIP_MAX_SLOTS) {
+        tx_slots = CSLIP_MAX_SLOTS;
+    }
+    c->tx_slots = tx_slots;
+    c->tx_last = -1;
+    c->rx_last = -1;
+    c->rx_toss = 1;
+}
+
+void cslip_toss(struct cslip *c) { c->rx_toss = 1; }
+
+// Compress a packet into out, which must have room for len bytes.
+// Returns the length of the frame to send.
+int cslip_compress(struct cslip *c, const unsigned char *in, int len,
+                   unsigned char *out) {
+    const unsigned char *th;
+    unsigned char deltas[16];
+    unsigned char *cp = deltas;
+    unsigned changes = 0;
+    unsigned long deltaA, deltaS;
+    unsigned delta;
+    struct cslip_slot *cs;
+    int hlen, ihl, i;
+
+    if (c->tx_slots == 0 || len < IP_HDR_LEN || (in[0] & 0xf0) != 0x40 ||
+        in[IP_PROTO] != IP_PROTO_TCP || (get16(&in[IP_OFFSET]) & 0x3fff) ||
+        (hlen = header_length(in, len)) < 0) {
+        goto plain;
+    }
+    ihl = (in[0] & 0x0f) * 4;
+    th = in + ihl;
+    if ((th[TCP_FLAGS] & (TH_SYN | TH_FIN | TH_RST | TH_ACK)) != TH_ACK) {
+        goto plain;
+    }
+
+    for (i = 0; i < c->tx_slots; i++) {
+        cs = &c->tx[i];
+        if (cs->valid && memcmp(&cs->hdr[IP_ADDRS], &in[IP_ADDRS], 8) == 0 &&
+            memcmp(&cs->hdr[(cs->hdr[0] & 0x0f) * 4], th, 4) == 0) {
+            break;
+        }
+    }
+    if (i == c->tx_slots) {
+        i = c->tx_next;
+        c->tx_next = (c->tx_next + 1) % c->tx_slots;
+        goto uncompressed;
+    }
+
+    const unsigned char *oh = c->tx[i].hdr;
+    const unsigned char *ot = oh + ihl;
+
+    // Anything expected to stay the same, including options
+    if (c->tx[i].hlen != hlen || oh[0] != in[0] || oh[IP_TOS] != in[IP_TOS] ||
+        oh[IP_TTL] != in[IP_TTL] ||
+        get16(&oh[IP_OFFSET]) != get16(&in[IP_OFFSET]) ||
+        ot[TCP_OFFSET] != th[TCP_OFFSET] ||
+        memcmp(&oh[IP_HDR_LEN], &in[IP_HDR_LEN], ihl - IP_HDR_LEN) != 0 ||
+        memcmp(&ot[TCP_HDR_LEN], &th[TCP_HDR_LEN], hlen - ihl - TCP_HDR_LEN) !=
+            0) {
+        goto uncompressed;
+    }
+
+    if (th[TCP_FLAGS] & TH_URG) {
+        cp = encode(cp, get16(&th[TCP_URGP]));
+        changes |= NEW_U;
+    } else if (get16(&th[TCP_URGP]) != get16(&ot[TCP_URGP])) {
+        goto uncompressed;
+    }
+
+    delta = (get16(&th[TCP_WND]) - get16(&ot[TCP_WND])) & 0xffff;
+    if (delta) {
+        cp = encode(cp, delta);
+        changes |= NEW_W;
+    }
+
+    deltaA = (get32(&th[TCP_ACK]) - get32(&ot[TCP_ACK])) & 0xffffffffUL;
+    if (deltaA) {
+        if (deltaA > 0xffff) {
+            goto uncompressed;
+        }
+        cp = encode(cp, deltaA);
+        changes |= NEW_A;
+    }
+
+    deltaS = (get32(&th[TCP_SEQ]) - get32(&ot[TCP_SEQ])) & 0xffffffffUL;
+    if (deltaS) {
+        if (deltaS > 0xffff) {
+            goto uncompressed;
+        }
+        cp = encode(cp, deltaS);
+        changes |= NEW_S;
+    }
+
+    unsigned olddata = get16(&oh[IP_LEN]) - hlen;
+    switch (changes) {
+    case 0:
+        // Only an ACK after data is expected, anything else is a
+        // retransmission and goes whole
+        if (get16(&in[IP_LEN]) != get16(&oh[IP_LEN]) && olddata == 0) {
+            break;
+        }
+        // fall through
+    case SPECIAL_I:
+    case SPECIAL_D:
+        goto uncompressed;
+    case NEW_S | NEW_A:
+        if (deltaS == deltaA && deltaS == olddata) {
+            changes = SPECIAL_I;
+            cp = deltas;
+        }
+        break;
+    case NEW_S:
+        if (deltaS == olddata) {
+            changes = SPECIAL_D;
+            cp = deltas;
+        }
+        break;
+    }
+
+    delta = (get16(&in[IP_ID]) - get16(&oh[IP_ID])) & 0xffff;
+    if (delta != 1) {
+        cp = encode(cp, delta);
+        changes |= NEW_I;
+    }
+    if (th[TCP_FLAGS] & TH_PUSH) {
+        changes |= TCP_PUSH_BIT;
+    }
+
+    memcpy(c->tx[i].hdr, in, hlen);
+
+    unsigned char *o = out;
+    if (c->tx_last != i) {
+        c->tx_last = i;
+        *o++ = CSLIP_TYPE_COMPRESSED_TCP | NEW_C | changes;
+        *o++ = i;
+    } else {
+        *o++ = CSLIP_TYPE_COMPRESSED_TCP | changes;
+    }
+    *o++ = th[TCP_CHKSUM];
+    *o++ = th[TCP_CHKSUM + 1];
+    memcpy(o, deltas, cp - deltas);
+    o += cp - deltas;
+    c->tx_saved += hlen - (o - out);
+    memcpy(o, in + hlen, len - hlen);
+    c->tx_compressed++;
+    return (o - out) + len - hlen;
+
+uncompressed:
+    if (!c->confirmed && ++c->probes > CSLIP_PROBE_LIMIT) {
+        // The peer doesn't speak CSLIP
+        c->tx_slots = 0;
+        goto plain;
+    }
+    memcpy(c->tx[i].hdr, in, hlen);
+    c->tx[i].hlen = hlen;
+    c->tx[i].valid = 1;
+    c->tx_last = i;
+    memcpy(out, in, len);
+    out[0] = (out[0] & 0x0f) | CSLIP_TYPE_UNCOMPRESSED_TCP;
+    out[IP_PROTO] = i;
+    c->tx_uncompressed++;
+    return len;
+
+plain:
+    memcpy(out, in, len);
+    return len;
+}
+
+// Rebuild the IP packet from a received frame. Returns its length, or -1
+// if the frame has to be dropped. out may be in, unless the frame is
+// CSLIP_TYPE_COMPRESSED_TCP.
+int cslip_uncompress(struct cslip *c, const unsigned char *in, int len,
+                     unsigned char *out, int out_size) {
+    const unsigned char *cp = in;
+    unsigned char *ip, *th;
+    unsigned changes;
+    int hlen, n;
+
+    if (len < 3) {
+        goto bad;
+    }
+
+    if (!(in[0] & CSLIP_TYPE_COMPRESSED_TCP)) {
+        if (len > out_size) {
+            goto bad;
+        }
+        if (out != in) {
+            memcpy(out, in, len);
+        }
+        if (in[0] < CSLIP_TYPE_UNCOMPRESSED_TCP) {
+            // A plain ACK after we started compressing means the peer
+            // dropped our frames, so it doesn't speak CSLIP
+            if (!c->confirmed && c->probes > 0 && len >= IP_HDR_LEN &&
+                in[IP_PROTO] == IP_PROTO_TCP &&
+                header_length(in, len) > 0 &&
+                (in[(in[0] & 0x0f) * 4 + TCP_FLAGS] &
+                 (TH_SYN | TH_FIN | TH_RST | TH_ACK)) == TH_ACK) {
+                c->tx_slots = 0;
+            }
+            return len;
+        }
+
+        // Uncompressed TCP: restore the protocol and remember the header
+        int slot = in[IP_PROTO];
+        out[0] = (out[0] & 0x0f) | 0x40;
+        out[IP_PROTO] = IP_PROTO_TCP;
+        hlen = header_length(out, len);
+        if (hlen < 0) {
+            goto bad;
+        }
+        memcpy(c->rx[slot].hdr, out, hlen);
+        c->rx[slot].hlen = hlen;
+        c->rx[slot].valid = 1;
+        c->rx_last = slot;
+        c->rx_toss = 0;
+        c->confirmed = 1;
+        c->rx_uncompressed++;
+        return len;
+    }
+
+    c->confirmed = 1;
+    changes = *cp++;
+    if (changes & NEW_C) {
+        c->rx_last = *cp++;
+        c->rx_toss = 0;
+    } else if (c->rx_toss) {
+        c->rx_tossed++;
+        return -1;
+    }
+    if (c->rx_last < 0 || !c->rx[c->rx_last].valid) {
+        goto bad;
+    }
+
+    struct cslip_slot *cs = &c->rx[c->rx_last];
+    ip = cs->hdr;
+    th = ip + (ip[0] & 0x0f) * 4;
+    th[TCP_CHKSUM] = cp[0];
+    th[TCP_CHKSUM + 1] = cp[1];
+    cp += 2;
+    if (changes & TCP_PUSH_BIT) {
+        th[TCP_FLAGS] |= TH_PUSH;
+    } else {
+        th[TCP_FLAGS] &= ~TH_PUSH;
+    }
+
+    unsigned olddata = get16(&ip[IP_LEN]) - cs->hlen;
+    switch (changes & SPECIALS_MASK) {
+    case SPECIAL_I:
+        put32(&th[TCP_ACK], get32(&th[TCP_ACK]) + olddata);
+        put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + olddata);
+        break;
+    case SPECIAL_D:
+        put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + olddata);
+        break;
+    default:
+        if (changes & NEW_U) {
+            th[TCP_FLAGS] |= TH_URG;
+            put16(&th[TCP_URGP], decode(&cp));
+        } else {
+            th[TCP_FLAGS] &= ~TH_URG;
+        }
+        if (changes & NEW_W) {
+            put16(&th[TCP_WND], get16(&th[TCP_WND]) + decode(&cp));
+        }
+        if (changes & NEW_A) {
+            put32(&th[TCP_ACK], get32(&th[TCP_ACK]) + decode(&cp));
+        }
+        if (changes & NEW_S) {
+            put32(&th[TCP_SEQ], get32(&th[TCP_SEQ]) + decode(&cp));
+        }
+        break;
+    }
+    if (changes & NEW_I) {
+        put16(&ip[IP_ID], get16(&ip[IP_ID]) + decode(&cp));
+    } else {
+        put16(&ip[IP_ID], get16(&ip[IP_ID]) + 1);
+    }
+
+    hlen = cp - in;
+    if (hlen > len) {
+        goto bad;
+    }
+    n = len - hlen + cs->hlen;
+    if (n > out_size) {
+        goto bad;
+    }
+    put16(&ip[IP_LEN], n);
+    ip_checksum(ip);
+    memcpy(out, ip, cs->hlen);
+    memcpy(out + cs->hlen, cp, len - hlen);
+    c->rx_compressed++;
+    return n;
+
+bad:
+    c->rx_toss = 1;
+    c->rx_tossed++;
+    return -1;
+}
@@ -0,0 +1,50 @@
+// Van Jacobson TCP/IP header compression (RFC 1144) for the SLIP bridge.
+// Plain C, no macOS APIs, so it can be built and tested anywhere.
+
+#ifndef CSLIP_H
+#define CSLIP_H
+
+#define CSLIP_TYPE_IP 0x40
+#define CSLIP_TYPE_UNCOMPRESSED_TCP 0x70
+#define CSLIP_TYPE_COMPRESSED_TCP 0x80
+
+#define CSLIP_MAX_SLOTS 256
+#define CSLIP_MAX_HDR 120 // 60 bytes of IP and 60 of TCP header
+
+// Uncompressed TCP frames sent without hearing any CSLIP back, before
+// deciding the peer only speaks plain SLIP
+#define CSLIP_PROBE_LIMIT 3
+
+struct cslip_slot {
+    unsigned char hdr[CSLIP_MAX_HDR];
+    int hlen;
+    int valid;
+};
+
+struct cslip {
+    int tx_slots; // slots the peer can decompress, 0 when not compressing
+    int confirmed; // the peer has sent CSLIP
+    int probes;    // uncompressed frames sent before confirmed
+    struct cslip_slot tx[CSLIP_MAX_SLOTS];
+    struct cslip_slot rx[CSLIP_MAX_SLOTS];
+    int tx_last;
+    int tx_next;
+    int rx_last;
+    int rx_toss;
+
+    unsigned long tx_compressed;
+    unsigned long tx_uncompressed;
+    unsigned long tx_saved; // header bytes not sent
+    unsigned long rx_compressed;
+    unsigned long rx_uncompressed;
+    unsigned long rx_tossed;
+};
+
+void cslip_init(struct cslip *c, int tx_slots);
+int cslip_compress(struct cslip *c, const unsigned char *in, int len,
+                   unsigned char *out);
+int cslip_uncompress(struct cslip *c, const unsigned char *in, int len,
+                     unsigned char *out, int out_size);
+void cslip_toss(struct cslip *c);
+
+#endif // CSLIP_H
@@ -0,0 +1,128 @@
+// Event loop plumbing, see poller.h
+
+#include "poller.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/event.h>
+#else
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+void poller_init(struct poller *p) {
+#ifdef __APPLE__
+    p->fd = kqueue();
+#else
+    struct epoll_event ev = {.events = EPOLLIN};
+
+    p->fd = epoll_create1(0);
+    p->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    ev.data.fd = p->timerfd;
+    if (p->timerfd == -1 ||
+        epoll_ctl(p->fd, EPOLL_CTL_ADD, p->timerfd, &ev) == -1) {
+        p->fd = -1;
+    }
+#endif
+    if (p->fd == -1) {
+        perror("poller");
+        exit(1);
+    }
+}
+
+void poller_set(struct poller *p, int fd, int events, int old) {
+#ifdef __APPLE__
+    struct kevent changes[2];
+    int n = 0;
+
+    if ((events ^ old) & POLLER_IN) {
+        EV_SET(&changes[n++], fd, EVFILT_READ,
+               (events & POLLER_IN) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+    }
+    if ((events ^ old) & POLLER_OUT) {
+        EV_SET(&changes[n++], fd, EVFILT_WRITE,
+               (events & POLLER_OUT) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+    }
+    kevent(p->fd, changes, n, NULL, 0, NULL);
+#else
+    struct epoll_event ev = {0};
+
+    ev.events = ((events & POLLER_IN) ? EPOLLIN : 0) |
+                ((events & POLLER_OUT) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    epoll_ctl(p->fd,
+              !old      ? EPOLL_CTL_ADD
+              : !events ? EPOLL_CTL_DEL
+                        : EPOLL_CTL_MOD,
+              fd, &ev);
+#endif
+}
+
+void poller_timer(struct poller *p, int us) {
+#ifdef __APPLE__
+    struct kevent change;
+
+    EV_SET(&change, 0, EVFILT_TIMER, us ? EV_ADD | EV_ONESHOT : EV_DELETE,
+           NOTE_USECONDS, us, NULL);
+    kevent(p->fd, &change, 1, NULL, 0, NULL);
+#else
+    struct itimerspec its = {0};
+
+    its.it_value.tv_sec = us / 1000000;
+    its.it_value.tv_nsec = (us % 1000000) * 1000L;
+    timerfd_settime(p->timerfd, 0, &its, NULL);
+#endif
+}
+
+int poller_wait(struct poller *p, struct poll_event *out, int max) {
+#ifdef __APPLE__
+    struct kevent evs[8];
+    int n = kevent(p->fd, NULL, 0, evs, max < 8 ? max : 8, NULL);
+
+    for (int i = 0; i < n; i++) {
+        if (evs[i].filter == EVFILT_TIMER) {
+            out[i].fd = POLLER_TIMER;
+            out[i].events = 0;
+        } else {
+            out[i].fd = evs[i].ident;
+            out[i].events = evs[i].filter == EVFILT_READ ? POLLER_IN : POLLER_OUT;
+            // A closed device shows up as readable, the read finds out
+            if (evs[i].flags & EV_EOF) {
+                out[i].events |= POLLER_IN;
+            }
+        }
+    }
+#else
+    struct epoll_event evs[8];
+    int n = epoll_wait(p->fd, evs, max < 8 ? max : 8, -1);
+
+    for (int i = 0; i < n; i++) {
+        if (evs[i].data.fd == p->timerfd) {
+            uint64_t expired;
+            read(p->timerfd, &expired, sizeof(expired));
+            out[i].fd = POLLER_TIMER;
+            out[i].events = 0;
+        } else {
+            out[i].fd = evs[i].data.fd;
+            // Errors and hangups show up as readable, the read finds out
+            out[i].events =
+                ((evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) ? POLLER_IN
+                                                                    : 0) |
+                ((evs[i].events & EPOLLOUT) ? POLLER_OUT : 0);
+        }
+    }
+#endif
+    if (n < 0) {
+        if (errno != EINTR) {
+            perror("poller");
+            exit(1);
+        }
+        return 0;
+    }
+    return n;
+}
@@ -0,0 +1,32 @@
+// Event loop plumbing for the bridge and the tools built on it: epoll and
+// a timerfd on Linux, kqueue on macOS. File descriptors are watched for
+// reading and/or writing, and there is one timer.
+
+#ifndef POLLER_H
+#define POLLER_H
+
+#define POLLER_IN 1
+#define POLLER_OUT 2
+#define POLLER_TIMER -1
+
+struct poll_event {
+    int fd; // or POLLER_TIMER
+    int events;
+};
+
+struct poller {
+    int fd;
+#ifndef __APPLE__
+    int timerfd;
+#endif
+};
+
+void poller_init(struct poller *p);
+// Watch fd for events (POLLER_IN | POLLER_OUT, or 0 for nothing) instead of old
+void poller_set(struct poller *p, int fd, int events, int old);
+// Fire POLLER_TIMER once, us microseconds from now, or never if us is 0
+void poller_timer(struct poller *p, int us);
+// Wait for events, returns how many, or 0 if a signal came in first
+int poller_wait(struct poller *p, struct poll_event *out, int max);
+
+#endif // POLLER_H
@@ -0,0 +1,553 @@
+// Latency and throughput probe for the SLIP bridge, see probe.h
+
+#include "probe.h"
+
+#include "codec.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MTU 1500
+#define RX_READ_SIZE 16384
+
+// How long to wait for an answer before sending again, and how often
+#define PROBE_TIMEOUT_US 1000000
+#define PROBE_TRIES 3
+// Longest a GET may take, start to finish
+#define PROBE_GET_TIMEOUT_US 10000000
+
+#define PING_DATA_SIZE 56
+#define HTTP_PORT 80
+#define FIRST_PORT 40000
+#define TCP_WINDOW 65535
+#define TCP_MSS 1460
+// Bytes kept from the start of each answer, for the status line
+#define HTTP_HEAD_SIZE 64
+
+#define IP_HLEN 20
+#define TCP_HLEN 20
+#define ICMP_HLEN 8
+#define IP_PROTO_ICMP 1
+#define IP_PROTO_TCP 6
+#define ICMP_ECHO_REPLY 0
+#define ICMP_ECHO 8
+
+#define TH_FIN 0x01
+#define TH_SYN 0x02
+#define TH_RST 0x04
+#define TH_PSH 0x08
+#define TH_ACK 0x10
+
+struct samples {
+    uint32_t *us;
+    int n;
+};
+
+struct get_result {
+    int status;
+    long bytes; // of the answer, headers included
+    uint32_t ttfb;
+    uint32_t total;
+    int retransmits;
+};
+
+static const char *paths[] = {"/", "/vapeserver.jpeg", "/api/status"};
+
+static int devfd;
+static int framing;
+static struct cslip *cslip;
+static uint32_t local;
+static uint32_t remote;
+static uint16_t ip_id;
+static unsigned next_port;
+static uint32_t delayed_ack_us;
+
+static struct decoder decoder;
+static unsigned char rx_frame[MTU];
+static unsigned char rbuf[RX_READ_SIZE];
+static int rpos;
+static int rlen;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned get16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static void put16(unsigned char *p, unsigned v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+static uint32_t sum16(uint32_t sum, const unsigned char *p, int len) {
+    for (int i = 0; i + 1 < len; i += 2) {
+        sum += get16(p + i);
+    }
+    if (len & 1) {
+        sum += p[len - 1] << 8;
+    }
+    return sum;
+}
+
+static unsigned fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum & 0xffff;
+}
+
+static void ip_header(unsigned char *p, int proto, int len) {
+    memset(p, 0, IP_HLEN);
+    p[0] = 0x45;
+    put16(p + 2, len);
+    put16(p + 4, ip_id++);
+    p[8] = 64;
+    p[9] = proto;
+    put32(p + 12, local);
+    put32(p + 16, remote);
+    put16(p + 10, fold(sum16(0, p, IP_HLEN)));
+}
+
+// Link
+
+static void write_all(struct iovec *iov, int cnt) {
+    while (cnt) {
+        ssize_t n = writev(devfd, iov, cnt);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                struct pollfd pfd = {devfd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            perror("probe: write");
+            exit(1);
+        }
+        while (cnt && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+static void send_packet(const unsigned char *p, int len) {
+    static unsigned char packet[MTU];
+    static unsigned char scratch[CODEC_MAX_ENCODED(MTU)];
+    struct iovec iov[CODEC_MAX_IOV];
+
+    if (trace_enabled) {
+        trace_packet(TRACE_TO_DEVICE, p, len);
+    }
+    if (cslip->tx_slots) {
+        len = cslip_compress(cslip, p, len, packet);
+        p = packet;
+    }
+    write_all(iov, encode_frame(framing, p, len, iov, scratch));
+}
+
+// Waits until deadline for the next IP packet from the device. Returns
+// its length, with *p pointing at it, or 0 at the deadline.
+static int recv_packet(uint64_t deadline, unsigned char **p) {
+    static unsigned char packet[MTU];
+
+    while (1) {
+        while (rpos < rlen) {
+            int len;
+            rpos += decoder_feed(&decoder, rbuf + rpos, rlen - rpos, &len);
+            if (!len) {
+                continue;
+            }
+            unsigned char *out =
+                rx_frame[0] & CSLIP_TYPE_COMPRESSED_TCP ? packet : rx_frame;
+            len = cslip_uncompress(cslip, rx_frame, len, out, MTU);
+            if (len < IP_HLEN || (out[0] >> 4) != 4) {
+                continue;
+            }
+            if (trace_enabled) {
+                trace_packet(TRACE_FROM_DEVICE, out, len);
+            }
+            *p = out;
+            return len;
+        }
+
+        uint64_t now = now_us();
+        if (now >= deadline) {
+            return 0;
+        }
+
+        struct pollfd pfd = {devfd, POLLIN, 0};
+        int ms = (deadline - now + 999) / 1000;
+        if (poll(&pfd, 1, ms) <= 0) {
+            continue;
+        }
+
+        ssize_t n = read(devfd, rbuf, sizeof(rbuf));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            fprintf(stderr, "probe: device closed\n");
+            exit(1);
+        }
+        rpos = 0;
+        rlen = n > 0 ? n : 0;
+    }
+}
+
+// ICMP
+
+// Returns the round trip time, or 0 if there was no answer
+static uint32_t ping(unsigned seq) {
+    unsigned char p[IP_HLEN + ICMP_HLEN + PING_DATA_SIZE];
+    unsigned char *icmp = p + IP_HLEN;
+    unsigned id = getpid() & 0xffff;
+    uint64_t start = now_us();
+    uint64_t deadline = start + PROBE_TIMEOUT_US;
+
+    ip_header(p, IP_PROTO_ICMP, sizeof(p));
+    memset(icmp, 0, ICMP_HLEN);
+    icmp[0] = ICMP_ECHO;
+    put16(icmp + 4, id);
+    put16(icmp + 6, seq);
+    for (int i = 0; i < PING_DATA_SIZE; i++) {
+        icmp[ICMP_HLEN + i] = i;
+    }
+    put16(icmp + 2, fold(sum16(0, icmp, ICMP_HLEN + PING_DATA_SIZE)));
+    send_packet(p, sizeof(p));
+
+    while (1) {
+        unsigned char *r;
+        int len = recv_packet(deadline, &r);
+        if (!len) {
+            return 0;
+        }
+        int hl = (r[0] & 0x0f) * 4;
+        if (r[9] == IP_PROTO_ICMP && get32(r + 12) == remote &&
+            len >= hl + ICMP_HLEN && r[hl] == ICMP_ECHO_REPLY &&
+            get16(r + hl + 4) == id && get16(r + hl + 6) == seq) {
+            uint32_t rtt = now_us() - start;
+            return rtt ? rtt : 1;
+        }
+    }
+}
+
+// TCP and HTTP
+
+static void tcp_send(unsigned port, uint32_t seq, uint32_t ack, int flags,
+                     const void *data, int len) {
+    unsigned char p[IP_HLEN + TCP_HLEN + 4 + 128];
+    unsigned char *th = p + IP_HLEN;
+    int hlen = TCP_HLEN;
+    uint32_t sum;
+
+    if (flags & TH_SYN) {
+        // MSS option
+        th[20] = 2;
+        th[21] = 4;
+        put16(th + 22, TCP_MSS);
+        hlen += 4;
+    }
+
+    ip_header(p, IP_PROTO_TCP, IP_HLEN + hlen + len);
+    put16(th, port);
+    put16(th + 2, HTTP_PORT);
+    put32(th + 4, seq);
+    put32(th + 8, ack);
+    th[12] = (hlen / 4) << 4;
+    th[13] = flags;
+    put16(th + 14, TCP_WINDOW);
+    put16(th + 16, 0);
+    put16(th + 18, 0);
+    if (len) {
+        memcpy(th + hlen, data, len);
+    }
+
+    sum = sum16(0, p + 12, 8) + IP_PROTO_TCP + hlen + len;
+    put16(th + 16, fold(sum16(sum, th, hlen + len)));
+    send_packet(p, IP_HLEN + hlen + len);
+}
+
+// The next segment for port before deadline, or 0. Sets its header,
+// payload and payload length.
+static int tcp_recv(unsigned port, uint64_t deadline, unsigned char **th,
+                    unsigned char **data, int *len) {
+    while (1) {
+        unsigned char *r;
+        int n = recv_packet(deadline, &r);
+        if (!n) {
+            return 0;
+        }
+        int hl = (r[0] & 0x0f) * 4;
+        if (r[9] != IP_PROTO_TCP || get32(r + 12) != remote ||
+            n < hl + TCP_HLEN) {
+            continue;
+        }
+        unsigned char *t = r + hl;
+        if (get16(t) != HTTP_PORT || get16(t + 2) != port) {
+            continue;
+        }
+        int thl = (t[12] >> 4) * 4;
+        int total = get16(r + 2);
+        *th = t;
+        *data = t + thl;
+        *len = (total < n ? total : n) - hl - thl;
+        if (*len < 0) {
+            continue;
+        }
+        return 1;
+    }
+}
+
+// Returns 0 and fills in r if the whole answer came back
+static int get(const char *path, struct get_result *r) {
+    unsigned port = next_port++;
+    uint32_t iss = (uint32_t)random();
+    uint32_t snd_nxt = iss + 1;
+    uint32_t rcv_nxt = 0;
+    uint64_t start = now_us();
+    uint64_t deadline = start + PROBE_GET_TIMEOUT_US;
+    uint64_t sent;
+    unsigned char head[HTTP_HEAD_SIZE + 1];
+    int head_len = 0;
+    int tries = 0;
+    int acked = 0;
+    int unacked = 0; // in order segments not ACKed yet
+    uint64_t ack_due = 0;
+    char req[128];
+    int req_len;
+    unsigned char *th;
+    unsigned char *data;
+    int len;
+
+    if (next_port > 0xffff) {
+        next_port = FIRST_PORT;
+    }
+    memset(r, 0, sizeof(*r));
+    req_len = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\n\r\n", path);
+
+    // Handshake
+    while (1) {
+        if (tries++ == PROBE_TRIES) {
+            return -1;
+        }
+        tcp_send(port, iss, 0, TH_SYN, NULL, 0);
+        sent = now_us();
+        while (tcp_recv(port, sent + PROBE_TIMEOUT_US, &th, &data, &len)) {
+            if (th[13] & TH_RST) {
+                return -1;
+            }
+            if ((th[13] & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK) &&
+                get32(th + 8) == iss + 1) {
+                rcv_nxt = get32(th + 4) + 1;
+                goto connected;
+            }
+        }
+    }
+
+connected:
+    // The ACK on its own, as httpd ignores data that comes with it
+    tcp_send(port, snd_nxt, rcv_nxt, TH_ACK, NULL, 0);
+    tcp_send(port, snd_nxt, rcv_nxt, TH_ACK | TH_PSH, req, req_len);
+    sent = start = now_us();
+    tries = 1;
+
+    while (1) {
+        uint64_t wait = acked || r->bytes ? deadline : sent + PROBE_TIMEOUT_US;
+        if (unacked && ack_due < wait) {
+            wait = ack_due;
+        }
+        if (!tcp_recv(port, wait < deadline ? wait : deadline, &th, &data,
+                      &len)) {
+            if (unacked && now_us() >= ack_due) {
+                tcp_send(port, snd_nxt + acked * req_len, rcv_nxt, TH_ACK,
+                         NULL, 0);
+                unacked = 0;
+                continue;
+            }
+            if (now_us() >= deadline || tries == PROBE_TRIES) {
+                break;
+            }
+            tcp_send(port, snd_nxt, rcv_nxt, TH_ACK | TH_PSH, req, req_len);
+            sent = now_us();
+            tries++;
+            r->retransmits++;
+            continue;
+        }
+
+        uint64_t now = now_us();
+        unsigned flags = th[13];
+        uint32_t seq = get32(th + 4);
+
+        if (flags & TH_RST) {
+            return -1;
+        }
+        if ((flags & TH_ACK) && get32(th + 8) == snd_nxt + req_len) {
+            acked = 1;
+        }
+        if (len && seq == rcv_nxt) {
+            if (!r->bytes) {
+                r->ttfb = now - start;
+            }
+            int keep = HTTP_HEAD_SIZE - head_len;
+            memcpy(head + head_len, data, len < keep ? len : keep);
+            head_len += len < keep ? len : keep;
+            r->bytes += len;
+            rcv_nxt += len;
+        }
+        if ((flags & TH_FIN) && seq + len == rcv_nxt) {
+            rcv_nxt++;
+            r->total = now - start;
+            // Close our side too; the device drops the connection
+            // whether or not it sees our ACK of its FIN
+            tcp_send(port, snd_nxt + req_len, rcv_nxt, TH_FIN | TH_ACK,
+                     NULL, 0);
+            head[head_len] = 0;
+            if (head_len > 9 && strncmp((char *)head, "HTTP/", 5) == 0) {
+                r->status = atoi((char *)head + 9);
+            }
+            // Its ACK of our FIN
+            tcp_recv(port, now_us() + PROBE_TIMEOUT_US, &th, &data, &len);
+            return r->status ? 0 : -1;
+        }
+        // Every segment is ACKed at once, out of order ones with the
+        // sequence number still expected. With a delayed ACK, an in order
+        // segment waits for the next one, or for the timer
+        if (len && delayed_ack_us && seq + len == rcv_nxt && !unacked) {
+            unacked = 1;
+            ack_due = now + delayed_ack_us;
+        } else if (len) {
+            tcp_send(port, snd_nxt + acked * req_len, rcv_nxt, TH_ACK, NULL,
+                     0);
+            unacked = 0;
+        }
+    }
+
+    tcp_send(port, snd_nxt + req_len, rcv_nxt, TH_RST | TH_ACK, NULL, 0);
+    return -1;
+}
+
+// Results
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of sorted samples
+static uint32_t percentile(const struct samples *s, int pct) {
+    int rank = (s->n * pct + 99) / 100;
+    return s->us[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_samples(const char *name, struct samples *s) {
+    if (!s->n) {
+        printf("\"%s\": null", name);
+        return;
+    }
+    qsort(s->us, s->n, sizeof(s->us[0]), cmp_u32);
+    printf("\"%s\": {\"min\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, "
+           "\"max\": %u}",
+           name, s->us[0], percentile(s, 50), percentile(s, 90),
+           percentile(s, 99), s->us[s->n - 1]);
+}
+
+int probe_run(int fd, int link_framing, struct cslip *link_cslip,
+              const char *local_ip, const char *remote_ip, int count,
+              int delayed_ack_ms) {
+    struct in_addr addr;
+    struct samples rtt = {calloc(count, sizeof(uint32_t)), 0};
+    struct samples ttfb = {calloc(count, sizeof(uint32_t)), 0};
+    struct samples total = {calloc(count, sizeof(uint32_t)), 0};
+    int failed = 0;
+
+    devfd = fd;
+    framing = link_framing;
+    cslip = link_cslip;
+    delayed_ack_us = delayed_ack_ms * 1000;
+    if (inet_pton(AF_INET, local_ip, &addr) != 1) {
+        fprintf(stderr, "probe: bad address %s\n", local_ip);
+        return 1;
+    }
+    local = ntohl(addr.s_addr);
+    if (inet_pton(AF_INET, remote_ip, &addr) != 1) {
+        fprintf(stderr, "probe: bad address %s\n", remote_ip);
+        return 1;
+    }
+    remote = ntohl(addr.s_addr);
+    srandom(now_us());
+    next_port = FIRST_PORT + random() % 10000;
+    decoder_init(&decoder, framing, rx_frame, MTU);
+
+    for (int i = 0; i < count; i++) {
+        uint32_t us = ping(i);
+        if (us) {
+            rtt.us[rtt.n++] = us;
+        }
+    }
+    failed |= rtt.n != count;
+
+    printf("{\n  \"count\": %d,\n  \"delayed_ack_ms\": %d,\n  \"icmp\": "
+           "{\"received\": %d, ",
+           count, delayed_ack_ms, rtt.n);
+    print_samples("rtt_us", &rtt);
+    printf("},\n  \"http\": [");
+
+    for (size_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+        struct get_result r = {0};
+        long bytes = 0;
+        int status = 0;
+        int retransmits = 0;
+        uint64_t time = 0;
+
+        ttfb.n = 0;
+        total.n = 0;
+        for (int i = 0; i < count; i++) {
+            if (get(paths[p], &r) == 0) {
+                ttfb.us[ttfb.n++] = r.ttfb;
+                total.us[total.n++] = r.total;
+                status = r.status;
+                bytes = r.bytes;
+                time += r.total;
+            }
+            retransmits += r.retransmits;
+        }
+        failed |= total.n != count;
+
+        printf("%s\n    {\"path\": \"%s\", \"status\": %d, \"bytes\": %ld, "
+               "\"completed\": %d, \"retransmits\": %d, ",
+               p ? "," : "", paths[p], status, bytes, total.n, retransmits);
+        print_samples("ttfb_us", &ttfb);
+        printf(", ");
+        print_samples("total_us", &total);
+        // Answer bytes over the time from request to FIN, all runs
+        printf(", \"goodput_Bps\": %.0f}",
+               time ? (double)bytes * total.n * 1e6 / time : 0.0);
+    }
+    printf("\n  ]\n}\n");
+
+    free(rtt.us);
+    free(ttfb.us);
+    free(total.us);
+    return failed;
+}
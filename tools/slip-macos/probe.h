@@ -0,0 +1,27 @@
+// Latency and throughput probe for the SLIP bridge.
+//
+// Talks to the device directly over the SLIP (or COBS) link, without a
+// tunnel or the kernel's IP stack in the way: it builds its own ICMP echo
+// requests, and HTTP GETs over a minimal TCP client that ACKs every
+// segment at once, so what it measures is the device and the link alone.
+// It can also delay its ACKs the way most TCP stacks do: every second
+// segment at once, a lone one when the timer runs out.
+// Prints the results as JSON on stdout.
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "cslip.h"
+
+// Echo requests, and GETs of each object, by default
+#define PROBE_DEFAULT_COUNT 50
+// Delayed ACK timer, as on macOS
+#define PROBE_DEFAULT_DELAYED_ACK_MS 100
+
+// fd is the device, non-blocking. The addresses are the bridge's (-l) and
+// the device's (-r). delayed_ack_ms is 0 to ACK every segment at once.
+// Returns 0 if every probe was answered, 1 otherwise.
+int probe_run(int fd, int framing, struct cslip *cslip, const char *local_ip,
+              const char *remote_ip, int count, int delayed_ack_ms);
+
+#endif // PROBE_H
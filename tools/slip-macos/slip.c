@@ -1,40 +1,73 @@
 #include <errno.h>
 #include <fcntl.h>
-#include <net/if_utun.h>
-#include <pthread.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
-#include <sys/kern_control.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
-#include <sys/sys_domain.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <syslog.h>
 #include <termios.h>
 #include <unistd.h>
 
+#ifdef __APPLE__
+#include <net/if_utun.h>
+#include <sys/kern_control.h>
+#include <sys/sys_domain.h>
+#else
+#include <linux/if_tun.h>
+#include <net/if.h>
+#endif
+
+#include "codec.h"
+#include "cslip.h"
+#include "poller.h"
+#include "probe.h"
+#include "trace.h"
+
 #define DEVICE_TYPE_HARDWARE 'h'
 #define DEVICE_TYPE_SOCKET_CLIENT 'c'
 #define DEVICE_TYPE_SOCKET_SERVER 's'
+#define DEVICE_TYPE_TCP_CLIENT 't'
 #define DEFAULT_BAUD 9600
 
 #define MAX_UTUN_NUMBER 255
 
+#ifdef __APPLE__
+#define TUN_NAME "utun"
+#else
+#define TUN_NAME "tun"
+#endif
+
+// Time between attempts to reconnect to the device
+#define RECONNECT_DELAY_US 100000
+
 #define MTU 1500
+// utun prefixes packets with their address family, Linux tun with flags
+// and the ethertype. Both are 4 bytes.
 #define NULL_LOOPBACK_HEADER_SIZE 4
 #define MAX_PACKET_SIZE (MTU + NULL_LOOPBACK_HEADER_SIZE)
-#define MAX_PACKET_SIZE_SLIP                                                   \
-    (MTU * 2 + 1) // worst case all escaped plus the end character
 
-#define END 0xc0
-#define ESC 0xdb
-#define ESC_ESC 0xdd
-#define ESC_END 0xdc
+// Bytes asked of the device per read(), frames are decoded out of these
+#define RX_READ_SIZE 16384
 
-#define DECODE_END_OF_PACKET -2
+// Packets from the tunnel queued for the device. The queue is written out
+// when it's full, holds TX_QUEUE_HIGH_WATER bytes, or the first packet in
+// it has waited DEFAULT_COALESCE_US (-w), so the device gets a burst of
+// packets in one write.
+#define TX_QUEUE_FRAMES 32
+#define TX_QUEUE_HIGH_WATER 8192
+#define DEFAULT_COALESCE_US 100
+#define TX_MAX_IOV 1024
 
 // #define DEBUG
 
@@ -192,6 +225,62 @@ int open_unix_domain_socket_as_server(const char *socket_path) {
     return cl;
 }
 
+int open_tcp_client(const char *address, int error_is_fatal) {
+    // address is host:port, e.g. localhost:4290 for pyocd's semihosting
+    // telnet port. Small frames go out at once, without Nagle's delay.
+    struct addrinfo hints, *res, *ai;
+    char host[256];
+    const char *port = strrchr(address, ':');
+    int fd = -1;
+    int one = 1;
+    int err;
+
+    if (!port || port == address || port - address >= (int)sizeof(host)) {
+        fprintf(stderr, "TCP device must be host:port, not %s\n", address);
+        exit(1);
+    }
+    memcpy(host, address, port - address);
+    host[port - address] = '\0';
+    port++;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((err = getaddrinfo(host, port, &hints, &res)) != 0) {
+        if (error_is_fatal) {
+            fprintf(stderr, "%s: %s\n", address, gai_strerror(err));
+        }
+        return -1;
+    }
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd == -1) {
+        if (error_is_fatal) {
+            perror("connect error");
+        }
+        return -1;
+    }
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1) {
+        perror("TCP_NODELAY"); // just a warning, not a fatal error
+    }
+
+    return fd;
+}
+
+#ifdef __APPLE__
 int tun(int number) {
     // Original header:
     // From http://newosxbook.com/src.jl?tree=listings&file=17-15-utun.c
@@ -248,164 +337,496 @@ int tun(int number) {
     return fd;
 }
 
-int encode_slip(unsigned char *in, unsigned char *out, int length) {
-    int count = 0;
-    int i;
-
-    for (i = 0; i < length; i++) {
-        unsigned char c = *in;
-        if (c == END) {
-            *out = ESC;
-            out++;
-            *out = ESC_END;
-            count++;
-        } else if (c == ESC) {
-            *out = ESC;
-            out++;
-            *out = ESC_ESC;
-            count++;
-        } else {
-            *out = c;
-        }
+#else
+int tun(int number) {
+    // Linux: a tun%d device from /dev/net/tun. With packet information on,
+    // each packet starts with 4 bytes of flags and ethertype, which stand
+    // in for the utun header.
+    struct ifreq ifr;
+    int fd = open("/dev/net/tun", O_RDWR);
 
-        in++;
-        out++;
-        count++;
+    if (fd == -1) {
+        perror("/dev/net/tun");
+        return -1;
     }
 
-    *out = END;
-    count++;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN;
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "tun%d", number);
 
-    return count;
+    if (ioctl(fd, TUNSETIFF, &ifr) == -1) {
+        // In use, try another one
+        close(fd);
+        return -1;
+    }
+
+    return fd;
 }
+#endif
 
-int decode_slip(int fd) {
-    unsigned char c;
-    if (!read(fd, &c, 1)) {
-        printf("Read error\n");
-        return -1;
+int open_device(char device_type, char *device_path, int baud,
+                int error_is_fatal) {
+    int fd = -1;
+
+    switch (device_type) {
+    case DEVICE_TYPE_HARDWARE:
+        fd = open_serial_port(device_path, baud);
+        break;
+    case DEVICE_TYPE_SOCKET_CLIENT:
+        fd = open_unix_domain_socket_as_client(device_path, error_is_fatal);
+        break;
+    case DEVICE_TYPE_SOCKET_SERVER:
+        fd = open_unix_domain_socket_as_server(device_path);
+        break;
+    case DEVICE_TYPE_TCP_CLIENT:
+        fd = open_tcp_client(device_path, error_is_fatal);
+        break;
     }
 
-    if (c == ESC) {
-        // escape character - look at the next one too
-        if (!read(fd, &c, 1)) {
-            printf("Read error\n");
-            return -1;
-        }
-        if (c == ESC_END) {
-            return END;
-        } else if (c == ESC_ESC) {
-            return ESC;
-        } else {
-            printf("Decoding error\n");
-            return -1;
+    if (fd == -1 && error_is_fatal) {
+        fprintf(stderr, "Unable to open device\n");
+        exit(1);
+    }
+    return fd;
+}
+
+// Header compression state
+static struct cslip cslip;
+static int cslip_slots;
+
+static int framing = FRAMING_SLIP;
+
+// Packets from the tunnel wait this long for more to share their write
+// to the device, -w
+static int coalesce_us = DEFAULT_COALESCE_US;
+
+// Packets from the tunnel waiting for the device. Each is encoded where it
+// was read, and the whole queue goes out with one writev().
+struct tx_frame {
+    unsigned char buf[MAX_PACKET_SIZE]; // as read from the tunnel
+    unsigned char packet[MTU];          // compressed copy
+    unsigned char scratch[CODEC_MAX_ENCODED(MTU)];
+    struct iovec iov[CODEC_MAX_IOV];
+    int cnt;
+    int next;     // first iovec not written yet
+    size_t bytes; // left to write
+};
+
+static struct tx_frame tx_queue[TX_QUEUE_FRAMES];
+static int tx_head;
+static int tx_count;
+static size_t tx_bytes;
+
+static struct stats {
+    unsigned long tun_in;      // packets read from the tunnel
+    unsigned long tun_out;     // packets written to the tunnel
+    unsigned long writes;      // writev() calls to the device
+    unsigned long frames;      // frames those carried, or began
+    unsigned long max_frames;  // most in one write
+    unsigned long short_writes; // the device took less than all of it
+    unsigned long max_depth;   // most frames queued
+    size_t max_bytes;          // most bytes queued
+    unsigned long dropped_tx;  // no device
+    unsigned long dropped_rx;  // the tunnel was full
+    unsigned long reconnects;
+} stats;
+
+// Its timer flushes the TX queue or retries the device
+static struct poller poller;
+static int tunfd;
+static int devfd = -1;
+static int tun_watched; // POLLER_* events asked for
+static int dev_watched;
+static int timer_armed;
+static int tx_blocked; // the device didn't take the last write whole
+
+static char device_type;
+static char *device_path;
+static int baud;
+
+static struct decoder decoder;
+static unsigned char rx_frame[MTU];
+static unsigned long rx_lost;
+
+static volatile sig_atomic_t stats_wanted;
+static volatile sig_atomic_t quit_wanted;
+
+#ifdef DEBUG
+static void dump(const char *what, const struct iovec *iov, int cnt) {
+    int n = 0;
+
+    printf("%s:\n", what);
+    for (int i = 0; i < cnt; i++) {
+        const unsigned char *p = iov[i].iov_base;
+        for (size_t j = 0; j < iov[i].iov_len; j++, n++) {
+            printf("%02x%c", p[j], n % 16 == 15 ? '\n' : ' ');
         }
-    } else if (c == END) {
-        return DECODE_END_OF_PACKET;
+    }
+    printf("\n");
+}
+#endif
+
+static void print_stats(void) {
+    printf("tunnel: %lu in, %lu out, %lu dropped in, %lu dropped out\n",
+           stats.tun_in, stats.tun_out, stats.dropped_tx, stats.dropped_rx);
+    printf("device: %lu writes, %.2f frames/write (max %lu), %lu short, "
+           "queue max %lu frames %zu bytes, %lu reconnects\n",
+           stats.writes,
+           stats.writes ? (double)stats.frames / stats.writes : 0.0,
+           stats.max_frames, stats.short_writes, stats.max_depth,
+           stats.max_bytes, stats.reconnects);
+    if (trace_enabled) {
+        printf("trace: %lu dropped\n", trace_dropped);
+    }
+}
+
+static void on_signal(int sig) {
+    if (sig == SIGINT || sig == SIGTERM) {
+        quit_wanted = 1;
     } else {
-        return c;
+        stats_wanted = 1;
     }
 }
 
-int next_slip_packet(int fd, unsigned char buf[MTU]) {
-    int i = 0;
-    while (1) {
-        int result = decode_slip(fd);
-        if (result == -1) {
-            return -1;
-        } else if (result == DECODE_END_OF_PACKET) {
-            // full packet
-            return i;
-        } else {
-            buf[i] = (unsigned char)result;
-            i++;
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Watch the tunnel for packets unless the queue is full, and the device
+// for room once it has turned a write away
+static void update_watch(void) {
+    int tun = (devfd < 0 || tx_count < TX_QUEUE_FRAMES) ? POLLER_IN : 0;
+
+    if (tun != tun_watched) {
+        poller_set(&poller, tunfd, tun, tun_watched);
+        tun_watched = tun;
+    }
+    if (devfd >= 0) {
+        int dev = POLLER_IN | (tx_blocked ? POLLER_OUT : 0);
+        if (dev != dev_watched) {
+            poller_set(&poller, devfd, dev, dev_watched);
+            dev_watched = dev;
         }
     }
 }
 
-typedef struct thread_args {
-    int utunfd;
-    int serialfd;
-} thread_args;
+static void arm_timer(int us) {
+    poller_timer(&poller, us);
+    timer_armed = 1;
+}
 
-void *tx_thread(void *vargp) {
-    thread_args *args = (thread_args *)vargp;
+static void disarm_timer(void) {
+    if (timer_armed) {
+        poller_timer(&poller, 0);
+        timer_armed = 0;
+    }
+}
 
-    // Read from tunnel and forward it to serial
-    while (1) {
-        unsigned char c[MAX_PACKET_SIZE];
-        unsigned char encoded[MAX_PACKET_SIZE_SLIP];
-        int len;
-        int i;
-        int encoded_length;
+static void device_lost(void) {
+    printf("Device lost, attempting reconnect...\n");
+    print_stats();
+
+    // Closing it takes it out of the poller too
+    close(devfd);
+    devfd = -1;
+    dev_watched = 0;
+
+    stats.dropped_tx += tx_count;
+    tx_blocked = 0;
+    tx_head = 0;
+    tx_count = 0;
+    tx_bytes = 0;
+
+    // The device may have restarted and forgotten its slots
+    cslip_init(&cslip, cslip_slots);
+    decoder_init(&decoder, framing, rx_frame, MTU);
+    rx_lost = 0;
+
+    disarm_timer();
+    arm_timer(RECONNECT_DELAY_US);
+    update_watch();
+}
 
-        len = read(args->utunfd, c, MAX_PACKET_SIZE);
+static void device_up(int fd) {
+    set_nonblocking(fd);
+    devfd = fd;
+    printf("SLIP connection up\n");
+    update_watch();
+}
 
-        if (len == -1) {
-            printf("error %i\n", errno);
-            return vargp;
+static void reconnect(void) {
+    int fd = open_device(device_type, device_path, baud, 0);
+
+    timer_armed = 0;
+    if (fd == -1) {
+        arm_timer(RECONNECT_DELAY_US);
+        return;
+    }
+    stats.reconnects++;
+    device_up(fd);
+}
+
+// Write out as much of the queue as the device takes
+static void tx_flush(void) {
+    static struct iovec iov[TX_MAX_IOV];
+
+    disarm_timer();
+    tx_blocked = 0;
+    while (tx_count) {
+        int cnt = 0;
+        int frames = 0;
+        size_t want = 0;
+
+        for (int i = 0; i < tx_count; i++) {
+            struct tx_frame *f = &tx_queue[(tx_head + i) % TX_QUEUE_FRAMES];
+            if (cnt + f->cnt - f->next > TX_MAX_IOV) {
+                break;
+            }
+            memcpy(&iov[cnt], &f->iov[f->next],
+                   (f->cnt - f->next) * sizeof(iov[0]));
+            cnt += f->cnt - f->next;
+            want += f->bytes;
+            frames++;
         }
 
-        // Skip first 4 bytes - this is the null/loopback header
-        len -= 4;
-        unsigned char packet[MTU];
-        memcpy(packet, &c[4], len);
+        ssize_t written = writev(devfd, iov, cnt);
+        ssize_t n = written;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                tx_blocked = 1;
+                break;
+            }
+            device_lost();
+            return;
+        }
 
-        encoded_length = encode_slip(packet, encoded, len);
+        stats.writes++;
+        stats.frames += frames;
+        if ((unsigned long)frames > stats.max_frames) {
+            stats.max_frames = frames;
+        }
+        if ((size_t)written < want) {
+            stats.short_writes++;
+        }
 
-#ifdef DEBUG
-        printf("TX:\n");
-        for (i = 0; i < encoded_length; i++) {
-            printf("%02x ", encoded[i]);
-            if ((i - 4) % 16 == 15)
-                printf("\n");
+        // Drop what was written, and pick up after it next time
+        tx_bytes -= n;
+        while (n > 0) {
+            struct tx_frame *f = &tx_queue[tx_head];
+            if ((size_t)n >= f->bytes) {
+                n -= f->bytes;
+                tx_head = (tx_head + 1) % TX_QUEUE_FRAMES;
+                tx_count--;
+                continue;
+            }
+            f->bytes -= n;
+            while ((size_t)n >= f->iov[f->next].iov_len) {
+                n -= f->iov[f->next].iov_len;
+                f->next++;
+            }
+            f->iov[f->next].iov_base = (char *)f->iov[f->next].iov_base + n;
+            f->iov[f->next].iov_len -= n;
+            n = 0;
         }
-        printf("\n");
+        if ((size_t)written < want) {
+            tx_blocked = 1; // wait for room
+            break;
+        }
+    }
+    update_watch();
+}
+
+// Compress and encode a packet just read into its queue slot
+static void tx_queue_packet(struct tx_frame *f, int len) {
+    const unsigned char *frame = &f->buf[NULL_LOOPBACK_HEADER_SIZE];
+
+    // Without compression the packet is encoded straight from the read
+    // buffer
+    if (cslip.tx_slots) {
+        len = cslip_compress(&cslip, frame, len, f->packet);
+        frame = f->packet;
+        if (!cslip.tx_slots) {
+            printf("Device doesn't answer CSLIP, compression off\n");
+        }
+    }
+
+    f->cnt = encode_frame(framing, frame, len, f->iov, f->scratch);
+    f->next = 0;
+    f->bytes = 0;
+    for (int i = 0; i < f->cnt; i++) {
+        f->bytes += f->iov[i].iov_len;
+    }
+
+#ifdef DEBUG
+    dump("TX", f->iov, f->cnt);
 #endif
 
-        write(args->serialfd, encoded, encoded_length);
+    tx_count++;
+    tx_bytes += f->bytes;
+    if ((unsigned long)tx_count > stats.max_depth) {
+        stats.max_depth = tx_count;
+    }
+    if (tx_bytes > stats.max_bytes) {
+        stats.max_bytes = tx_bytes;
     }
-    return vargp;
 }
 
-void *rx_thread(void *vargp) {
-    thread_args *args = (thread_args *)vargp;
+static void tun_readable(void) {
+    static struct tx_frame discard;
 
-    unsigned char c[MTU];
-    unsigned char packet[MAX_PACKET_SIZE];
+    // Read everything the tunnel has, so a burst shares one write
+    while (devfd < 0 || tx_count < TX_QUEUE_FRAMES) {
+        struct tx_frame *f =
+            devfd < 0 ? &discard
+                      : &tx_queue[(tx_head + tx_count) % TX_QUEUE_FRAMES];
+        ssize_t len = read(tunfd, f->buf, MAX_PACKET_SIZE);
 
-    packet[0] = 0;
-    packet[1] = 0;
-    packet[2] = 0;
-    packet[3] = AF_INET;
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            printf("error %i\n", errno);
+            exit(1);
+        }
+        // Skip first 4 bytes - this is the null/loopback header
+        if (len <= NULL_LOOPBACK_HEADER_SIZE) {
+            continue;
+        }
+        stats.tun_in++;
+        if (devfd < 0) {
+            stats.dropped_tx++;
+            continue;
+        }
+        if (trace_enabled) {
+            trace_packet(TRACE_TO_DEVICE, &f->buf[NULL_LOOPBACK_HEADER_SIZE],
+                         len - NULL_LOOPBACK_HEADER_SIZE);
+        }
+        tx_queue_packet(f, len - NULL_LOOPBACK_HEADER_SIZE);
+    }
+
+    // While blocked, the device asks for more when it has room
+    if (devfd >= 0 && tx_count && !tx_blocked) {
+        if (coalesce_us == 0 || tx_count == TX_QUEUE_FRAMES ||
+            tx_bytes >= TX_QUEUE_HIGH_WATER) {
+            tx_flush();
+        } else if (!timer_armed) {
+            // The window starts with the first packet queued
+            arm_timer(coalesce_us);
+        }
+    }
+    update_watch();
+}
+
+static void rx_packet(int length) {
+#ifdef __APPLE__
+    static const unsigned char loopback[NULL_LOOPBACK_HEADER_SIZE] = {
+        0, 0, 0, AF_INET};
+#else
+    static const unsigned char loopback[NULL_LOOPBACK_HEADER_SIZE] = {
+        0, 0, 0x08, 0x00}; // no flags, ETH_P_IP
+#endif
+    static unsigned char packet[MTU];
+
+    // Only compressed frames grow, the rest are fixed up in place
+    unsigned char *out =
+        rx_frame[0] & CSLIP_TYPE_COMPRESSED_TCP ? packet : rx_frame;
+    length = cslip_uncompress(&cslip, rx_frame, length, out, MTU);
+    if (length < 0) {
+        return;
+    }
+    if (trace_enabled) {
+        trace_packet(TRACE_FROM_DEVICE, out, length);
+    }
+
+    struct iovec iov[2] = {
+        {(void *)loopback, NULL_LOOPBACK_HEADER_SIZE},
+        {out, length},
+    };
+
+#ifdef DEBUG
+    dump("RX", iov, 2);
+#endif
+
+    // The tunnel takes a packet whole or not at all
+    if (writev(tunfd, iov, 2) < 0) {
+        stats.dropped_rx++;
+    } else {
+        stats.tun_out++;
+    }
+}
+
+static void dev_readable(void) {
+    static unsigned char rbuf[RX_READ_SIZE];
 
-    // Read from serial and forward it to tunnel
     while (1) {
-        int length;
-        length = next_slip_packet(args->serialfd, c);
-        if (length < 0) {
-            return vargp;
-        } else if (length < 1) {
+        ssize_t n = read(devfd, rbuf, sizeof(rbuf));
+        if (n < 0 && errno == EINTR) {
             continue;
         }
-        // Copy into packet. The first 4 bytes of packet are static
-        // and remain the same, so we copy after them
-        memcpy(&packet[4], c, length);
-        length += 4;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            device_lost();
+            return;
+        }
 
-#ifdef DEBUG
-        printf("RX:\n");
-        for (int i = 0; i < length; i++) {
-            printf("%02x ", packet[i]);
-            if ((i - 4) % 16 == 15)
-                printf("\n");
+        for (int off = 0; off < n;) {
+            int length;
+            off += decoder_feed(&decoder, rbuf + off, n - off, &length);
+            if (length > 0) {
+                rx_packet(length);
+            }
         }
-        printf("\n");
-#endif
+        if (n < (ssize_t)sizeof(rbuf)) {
+            break;
+        }
+    }
+
+    if (decoder.errors + decoder.oversize != rx_lost) {
+        rx_lost = decoder.errors + decoder.oversize;
+        printf("Decoding error, %lu frames dropped\n", rx_lost);
+    }
+}
 
-        write(args->utunfd, packet, length);
+static void run(void) {
+    struct poll_event events[8];
+
+    while (!quit_wanted) {
+        if (stats_wanted) {
+            stats_wanted = 0;
+            print_stats();
+        }
+
+        int n = poller_wait(&poller, events, 8);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].fd;
+            if (fd == POLLER_TIMER) {
+                if (devfd < 0) {
+                    reconnect();
+                } else {
+                    timer_armed = 0;
+                    tx_flush();
+                }
+            } else if (fd == tunfd) {
+                tun_readable();
+            } else if (fd == devfd) {
+                if (events[i].events & POLLER_IN) {
+                    dev_readable();
+                }
+                if (devfd >= 0 && (events[i].events & POLLER_OUT)) {
+                    tx_flush();
+                }
+            }
+        }
     }
-    return vargp;
+    print_stats();
 }
 
 int create_utun(int *utun_num) {
@@ -427,47 +848,24 @@ int create_utun(int *utun_num) {
         exit(1);
     }
 
-    printf("Created utun%i\n", num);
+    printf("Created " TUN_NAME "%i\n", num);
 
     *utun_num = num;
 
     return fd;
 }
 
-int connect_device(char device_type, char *device_path, int baud,
-                   int error_is_fatal) {
-    int fd;
-
-    while (1) {
-        switch (device_type) {
-        case DEVICE_TYPE_HARDWARE:
-            fd = open_serial_port(device_path, baud);
-            break;
-        case DEVICE_TYPE_SOCKET_CLIENT:
-            fd = open_unix_domain_socket_as_client(device_path, error_is_fatal);
-            break;
-        case DEVICE_TYPE_SOCKET_SERVER:
-            fd = open_unix_domain_socket_as_server(device_path);
-            break;
-        }
-
-        if (fd == -1) {
-            if (error_is_fatal) {
-                fprintf(stderr, "Unable to open device\n");
-                exit(1);
-            } else {
-                continue;
-            }
-        } else {
-            return fd;
-        }
-    }
-}
-
 void run_ifconfig(int utun_num, char *local_ip, char *remote_ip) {
-    char ifconfig[50];
-
-    sprintf(ifconfig, "ifconfig utun%i %s %s", utun_num, local_ip, remote_ip);
+    char ifconfig[160];
+
+#ifdef __APPLE__
+    snprintf(ifconfig, sizeof(ifconfig), "ifconfig utun%i %s %s", utun_num,
+             local_ip, remote_ip);
+#else
+    snprintf(ifconfig, sizeof(ifconfig),
+             "ip addr add %s peer %s dev tun%i && ip link set tun%i mtu %i up",
+             local_ip, remote_ip, utun_num, utun_num, MTU);
+#endif
 
     printf("Running: %s\n", ifconfig);
     if (system(ifconfig) != 0) {
@@ -477,30 +875,65 @@ void run_ifconfig(int utun_num, char *local_ip, char *remote_ip) {
 }
 
 int main(int argc, char **argv) {
-    thread_args thread_args;
-
-    char *device_path;
-    char *local_ip;
-    char *remote_ip;
-    int baud = DEFAULT_BAUD;
-    char device_type = DEVICE_TYPE_HARDWARE;
-
+    char *local_ip = NULL;
+    char *remote_ip = NULL;
+    char *pcap_path = NULL;
+    char *json_path = NULL;
+    int probe_count = 0;
+    int delayed_ack_ms = 0;
+
+    static const struct option long_options[] = {
+        {"probe", optional_argument, NULL, 'P'},
+        {"delayed-ack", optional_argument, NULL, 'D'},
+        {NULL, 0, NULL, 0},
+    };
     int opt;
 
-    while ((opt = getopt(argc, argv, "b:l:r:t:")) != -1) {
+    baud = DEFAULT_BAUD;
+    device_type = DEVICE_TYPE_HARDWARE;
+
+    while ((opt = getopt_long(argc, argv, "b:c:f:j:l:p:r:t:w:", long_options,
+                              NULL)) != -1) {
         switch (opt) {
         case 'b':
             baud = atoi(optarg);
             break;
+        case 'c':
+            cslip_slots = atoi(optarg);
+            break;
+        case 'D':
+            delayed_ack_ms =
+                optarg ? atoi(optarg) : PROBE_DEFAULT_DELAYED_ACK_MS;
+            break;
+        case 'f':
+            if (strcmp(optarg, "cobs") == 0) {
+                framing = FRAMING_COBS;
+            } else if (strcmp(optarg, "slip") != 0) {
+                fprintf(stderr, "Unknown framing %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
         case 'l':
             local_ip = optarg;
             break;
+        case 'p':
+            pcap_path = optarg;
+            break;
+        case 'P':
+            probe_count = optarg ? atoi(optarg) : PROBE_DEFAULT_COUNT;
+            break;
         case 'r':
             remote_ip = optarg;
             break;
         case 't':
             device_type = optarg[0];
             break;
+        case 'w':
+            coalesce_us = atoi(optarg);
+            break;
         }
     }
 
@@ -515,43 +948,74 @@ int main(int argc, char **argv) {
 
     if (!(device_type == DEVICE_TYPE_HARDWARE ||
           device_type == DEVICE_TYPE_SOCKET_SERVER ||
-          device_type == DEVICE_TYPE_SOCKET_CLIENT) ||
-        !local_ip || !remote_ip || !device_path) {
+          device_type == DEVICE_TYPE_SOCKET_CLIENT ||
+          device_type == DEVICE_TYPE_TCP_CLIENT) ||
+        !local_ip || !remote_ip || !device_path || coalesce_us < 0 ||
+        probe_count < 0 || delayed_ack_ms < 0) {
         fprintf(
             stderr,
-            "Usage: %s -l local_ip -r remote_ip [-b baud] [-t type] [device]\n",
+            "Usage: %s -l local_ip -r remote_ip [-b baud] [-c slots] [-f "
+            "slip|cobs] [-j trace.json] [-p capture.pcapng] [-t type] [-w "
+            "usec] [--probe[=count]] [--delayed-ack[=ms]] [device]\n",
             argv[0]);
         exit(EXIT_FAILURE);
     }
 
+    // Logs go to files and pipes too
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Probing needs no tunnel, and no root
+    if (probe_count) {
+        int fd = open_device(device_type, device_path, baud, 1);
+        set_nonblocking(fd);
+        cslip_init(&cslip, cslip_slots);
+        if (trace_open(pcap_path, json_path) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        int failed = probe_run(fd, framing, &cslip, local_ip, remote_ip,
+                               probe_count, delayed_ack_ms);
+        trace_close();
+        return failed;
+    }
+
     int utun_num;
 
-    thread_args.utunfd = create_utun(&utun_num);
+    tunfd = create_utun(&utun_num);
+    set_nonblocking(tunfd);
 
     run_ifconfig(utun_num, local_ip, remote_ip);
 
+    // SIGINT or SIGTERM print the statistics and quit, SIGUSR1 (or ^T on
+    // macOS) prints them and carries on
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+#ifdef SIGINFO
+    sigaction(SIGINFO, &sa, NULL);
+#endif
+    signal(SIGPIPE, SIG_IGN);
+
+    poller_init(&poller);
+    cslip_init(&cslip, cslip_slots);
+    decoder_init(&decoder, framing, rx_frame, MTU);
+
     // The first time we try to open the device any error should be fatal
     // as this is likely a config problem.
     // After that we will try to reconnect in the event of an error, for
     // example due to serial line being disconnected, socket server restart
     // etc.
-    thread_args.serialfd = connect_device(device_type, device_path, baud, 1);
-
-    pthread_t tx_thread_id, rx_thread_id;
-
-    pthread_create(&tx_thread_id, NULL, tx_thread, (void *)&thread_args);
-
-    while (1) {
-        pthread_create(&rx_thread_id, NULL, rx_thread, (void *)&thread_args);
-
-        printf("SLIP connection up\n");
+    device_up(open_device(device_type, device_path, baud, 1));
 
-        pthread_join(rx_thread_id, NULL);
+    if (trace_open(pcap_path, json_path) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
-        printf("Device lost, attempting reconnect...\n");
+    run();
 
-        thread_args.serialfd = connect_device(device_type, device_path, baud, 0);
-    }
+    trace_close();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,417 @@
+// Packet capture and flow tracing for the SLIP bridge, see trace.h
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// pcapng
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_MAGIC 0x1a2b3c4d
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_EPB_FLAGS 2
+#define PCAPNG_INBOUND 1
+#define PCAPNG_OUTBOUND 2
+#define LINKTYPE_RAW 101
+
+// IP and TCP header offsets
+#define IP_LEN 2
+#define IP_PROTO 9
+#define IP_SRC 12
+#define IP_DST 16
+#define IP_PROTO_TCP 6
+#define TCP_SEQ 4
+#define TCP_ACK 8
+#define TCP_OFFSET 12
+#define TCP_FLAGS 13
+
+#define TH_FIN 0x01
+#define TH_SYN 0x02
+#define TH_RST 0x04
+#define TH_ACK 0x10
+
+// TCP flows followed at once, and unacknowledged segments per direction
+#define MAX_FLOWS 64
+#define MAX_SEGS 64
+
+// The writer looks for packets this often when the ring is empty
+#define WRITER_IDLE_NS 1000000
+
+struct record {
+    uint64_t us;
+    int dir;
+    int len;    // on the wire
+    int caplen; // kept
+    unsigned char data[TRACE_SNAPLEN];
+};
+
+struct seg {
+    uint32_t seq;
+    uint32_t end;
+    uint64_t sent;
+    int retransmitted; // no RTT sample from it (Karn)
+};
+
+struct flow_dir {
+    int started;
+    uint32_t next; // highest sequence number sent
+    struct seg segs[MAX_SEGS];
+    int nsegs;
+};
+
+struct flow {
+    int used;
+    int tid;
+    uint32_t addr[2]; // [0] opened the flow (or sent first)
+    unsigned port[2];
+    int dir0; // trace direction of packets from addr[0]
+    struct flow_dir d[2];
+    uint64_t last_seen;
+    uint64_t request_at; // waiting for the first byte of the answer
+};
+
+int trace_enabled;
+unsigned long trace_dropped;
+
+static struct record ring[TRACE_RING_SIZE];
+static atomic_uint ring_head; // written by the event loop
+static atomic_uint ring_tail; // written by the writer
+static atomic_int stopping;
+static pthread_t writer;
+
+static FILE *pcap;
+static FILE *json;
+static int json_events;
+static uint64_t t0;
+
+static struct flow flows[MAX_FLOWS];
+static int next_tid = 1;
+static unsigned long async_id;
+
+static const char *dir_name[2] = {"to device", "from device"};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned get16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static int seq_le(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+
+// pcapng
+
+static void put_u32(uint32_t v) { fwrite(&v, 4, 1, pcap); }
+
+static void pcap_header(void) {
+    uint16_t version[2] = {1, 0};
+    int64_t section_len = -1;
+    uint16_t link[2] = {LINKTYPE_RAW, 0};
+
+    put_u32(PCAPNG_SHB);
+    put_u32(28);
+    put_u32(PCAPNG_MAGIC);
+    fwrite(version, 2, 2, pcap);
+    fwrite(&section_len, 8, 1, pcap);
+    put_u32(28);
+
+    // No if_tsresol option, so timestamps are in microseconds
+    put_u32(PCAPNG_IDB);
+    put_u32(20);
+    fwrite(link, 2, 2, pcap);
+    put_u32(TRACE_SNAPLEN);
+    put_u32(20);
+}
+
+static void pcap_packet(const struct record *r) {
+    static const unsigned char pad[4];
+    int padded = (r->caplen + 3) & ~3;
+    uint32_t total = 28 + padded + 12 + 4;
+
+    put_u32(PCAPNG_EPB);
+    put_u32(total);
+    put_u32(0); // interface
+    put_u32(r->us >> 32);
+    put_u32(r->us);
+    put_u32(r->caplen);
+    put_u32(r->len);
+    fwrite(r->data, 1, r->caplen, pcap);
+    fwrite(pad, 1, padded - r->caplen, pcap);
+    put_u32(PCAPNG_OPT_EPB_FLAGS | (4 << 16));
+    put_u32(r->dir == TRACE_FROM_DEVICE ? PCAPNG_INBOUND : PCAPNG_OUTBOUND);
+    put_u32(PCAPNG_OPT_END);
+    put_u32(total);
+}
+
+// Chrome trace
+
+static void event(const char *fmt, ...) {
+    va_list ap;
+
+    fputs(json_events++ ? ",\n" : "[\n", json);
+    va_start(ap, fmt);
+    vfprintf(json, fmt, ap);
+    va_end(ap);
+}
+
+static double rel(uint64_t us) { return (double)(us - t0); }
+
+static struct flow *flow_find(const unsigned char *ip, const unsigned char *th,
+                              int dir) {
+    uint32_t src = get32(ip + IP_SRC);
+    uint32_t dst = get32(ip + IP_DST);
+    unsigned sport = get16(th);
+    unsigned dport = get16(th + 2);
+    struct flow *oldest = &flows[0];
+
+    for (int i = 0; i < MAX_FLOWS; i++) {
+        struct flow *f = &flows[i];
+        if (f->used &&
+            ((f->addr[0] == src && f->port[0] == sport && f->addr[1] == dst &&
+              f->port[1] == dport) ||
+             (f->addr[0] == dst && f->port[0] == dport && f->addr[1] == src &&
+              f->port[1] == sport))) {
+            return f;
+        }
+        if (!f->used || (oldest->used && f->last_seen < oldest->last_seen)) {
+            oldest = f;
+        }
+    }
+
+    // A new flow, or the least recently seen one reused
+    memset(oldest, 0, sizeof(*oldest));
+    oldest->used = 1;
+    oldest->tid = next_tid++;
+    oldest->addr[0] = src;
+    oldest->port[0] = sport;
+    oldest->addr[1] = dst;
+    oldest->port[1] = dport;
+    oldest->dir0 = dir;
+    event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+          "\"args\":{\"name\":\"%u.%u.%u.%u:%u > %u.%u.%u.%u:%u\"}}",
+          oldest->tid, src >> 24, (src >> 16) & 0xff, (src >> 8) & 0xff,
+          src & 0xff, sport, dst >> 24, (dst >> 16) & 0xff, (dst >> 8) & 0xff,
+          dst & 0xff, dport);
+    return oldest;
+}
+
+// A segment that takes up sequence space, from side s of the flow
+static void flow_send(struct flow *f, int s, int dir, uint32_t seq,
+                      uint32_t end, uint64_t now) {
+    struct flow_dir *d = &f->d[s];
+
+    if (d->started && seq_le(end, d->next)) {
+        // Seen it before: find when it was first sent
+        for (int i = 0; i < d->nsegs; i++) {
+            struct seg *g = &d->segs[i];
+            if (seq_le(g->seq, seq) && !seq_le(g->end, seq)) {
+                g->retransmitted = 1;
+                event("{\"name\":\"retransmit\",\"ph\":\"i\",\"s\":\"t\","
+                      "\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"args\":{\"dir\":"
+                      "\"%s\",\"seq\":%u,\"len\":%u,\"after_ms\":%.1f}}",
+                      f->tid, rel(now), dir_name[dir], seq, end - seq,
+                      (now - g->sent) / 1000.0);
+                return;
+            }
+        }
+        event("{\"name\":\"retransmit\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+              "\"tid\":%d,\"ts\":%.0f,\"args\":{\"dir\":\"%s\",\"seq\":%u,"
+              "\"len\":%u}}",
+              f->tid, rel(now), dir_name[dir], seq, end - seq);
+        return;
+    }
+
+    if (d->nsegs == MAX_SEGS) {
+        memmove(&d->segs[0], &d->segs[1], sizeof(d->segs[0]) * --d->nsegs);
+    }
+    d->segs[d->nsegs++] = (struct seg){seq, end, now, 0};
+    d->next = end;
+    d->started = 1;
+}
+
+// An acknowledgement from side s, for what the other side sent
+static void flow_ack(struct flow *f, int s, int dir, uint32_t ack,
+                     uint64_t now) {
+    struct flow_dir *d = &f->d[!s];
+    int acked = 0;
+
+    while (acked < d->nsegs && seq_le(d->segs[acked].end, ack)) {
+        struct seg *g = &d->segs[acked++];
+        if (g->retransmitted) {
+            continue;
+        }
+        unsigned long id = ++async_id;
+        double rtt = (now - g->sent) / 1000.0;
+        // The segment travelled the other way to this ACK
+        const char *name = dir_name[!dir];
+        event("{\"name\":\"%s\",\"cat\":\"segment\",\"ph\":\"b\",\"pid\":1,"
+              "\"tid\":%d,\"id\":%lu,\"ts\":%.0f,\"args\":{\"seq\":%u,"
+              "\"len\":%u,\"rtt_ms\":%.2f}}",
+              name, f->tid, id, rel(g->sent), g->seq, g->end - g->seq, rtt);
+        event("{\"name\":\"%s\",\"cat\":\"segment\",\"ph\":\"e\",\"pid\":1,"
+              "\"tid\":%d,\"id\":%lu,\"ts\":%.0f}",
+              name, f->tid, id, rel(now));
+        event("{\"name\":\"rtt %d\",\"ph\":\"C\",\"pid\":1,\"ts\":%.0f,"
+              "\"args\":{\"%s ms\":%.2f}}",
+              f->tid, rel(now), name, rtt);
+    }
+    memmove(&d->segs[0], &d->segs[acked], sizeof(d->segs[0]) * (d->nsegs - acked));
+    d->nsegs -= acked;
+}
+
+static void trace_tcp(const struct record *r) {
+    const unsigned char *ip = r->data;
+    int ihl = (ip[0] & 0x0f) * 4;
+
+    if (r->caplen < ihl + 20 || ip[IP_PROTO] != IP_PROTO_TCP ||
+        (ip[0] >> 4) != 4) {
+        return;
+    }
+
+    const unsigned char *th = ip + ihl;
+    int thl = (th[TCP_OFFSET] >> 4) * 4;
+    int payload = (int)get16(ip + IP_LEN) - ihl - thl;
+    unsigned flags = th[TCP_FLAGS];
+    uint32_t seq = get32(th + TCP_SEQ);
+    uint32_t len = payload + !!(flags & TH_SYN) + !!(flags & TH_FIN);
+    struct flow *f = flow_find(ip, th, r->dir);
+    int s = r->dir == f->dir0 ? 0 : 1;
+
+    f->last_seen = r->us;
+
+    if (flags & TH_RST) {
+        event("{\"name\":\"RST\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+              "\"tid\":%d,\"ts\":%.0f,\"args\":{\"dir\":\"%s\"}}",
+              f->tid, rel(r->us), dir_name[r->dir]);
+    }
+    if (flags & TH_ACK) {
+        flow_ack(f, s, r->dir, get32(th + TCP_ACK), r->us);
+    }
+    if (len) {
+        flow_send(f, s, r->dir, seq, seq + len, r->us);
+    }
+
+    // Side 0 opened the flow, so its data is a request and side 1's the
+    // answer
+    if (payload > 0 && s == 0 && !f->request_at) {
+        f->request_at = r->us;
+    } else if (payload > 0 && s == 1 && f->request_at) {
+        event("{\"name\":\"request to first byte\",\"ph\":\"X\",\"pid\":1,"
+              "\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f,\"args\":{\"ms\":%.2f}}",
+              f->tid, rel(f->request_at), (double)(r->us - f->request_at),
+              (r->us - f->request_at) / 1000.0);
+        f->request_at = 0;
+    }
+}
+
+// Writer thread
+
+static void write_record(const struct record *r) {
+    if (!t0) {
+        t0 = r->us;
+    }
+    if (pcap) {
+        pcap_packet(r);
+    }
+    if (json) {
+        trace_tcp(r);
+    }
+}
+
+static void *writer_thread(void *arg) {
+    const struct timespec idle = {0, WRITER_IDLE_NS};
+
+    while (1) {
+        unsigned tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&ring_head, memory_order_acquire);
+
+        if (tail == head) {
+            if (atomic_load(&stopping)) {
+                break;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        while (tail != head) {
+            write_record(&ring[tail % TRACE_RING_SIZE]);
+            atomic_store_explicit(&ring_tail, ++tail, memory_order_release);
+        }
+    }
+    return arg;
+}
+
+int trace_open(const char *pcap_path, const char *json_path) {
+    if (pcap_path) {
+        if (!(pcap = fopen(pcap_path, "wb"))) {
+            perror(pcap_path);
+            return -1;
+        }
+        pcap_header();
+    }
+    if (json_path) {
+        if (!(json = fopen(json_path, "w"))) {
+            perror(json_path);
+            return -1;
+        }
+        event("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"args\":{\"name\":\"SLIP bridge\"}}");
+    }
+    if (!pcap && !json) {
+        return 0;
+    }
+    if (pthread_create(&writer, NULL, writer_thread, NULL) != 0) {
+        perror("trace writer");
+        return -1;
+    }
+    trace_enabled = 1;
+    return 0;
+}
+
+// Called from the event loop only
+void trace_packet(int dir, const unsigned char *ip, int len) {
+    unsigned head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    struct record *r;
+
+    if (head - tail == TRACE_RING_SIZE) {
+        trace_dropped++;
+        return;
+    }
+
+    r = &ring[head % TRACE_RING_SIZE];
+    r->us = now_us();
+    r->dir = dir;
+    r->len = len;
+    r->caplen = len < TRACE_SNAPLEN ? len : TRACE_SNAPLEN;
+    memcpy(r->data, ip, r->caplen);
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+void trace_close(void) {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = 0;
+    atomic_store(&stopping, 1);
+    pthread_join(writer, NULL);
+
+    if (pcap) {
+        fclose(pcap);
+    }
+    if (json) {
+        fputs("\n]\n", json);
+        fclose(json);
+    }
+}
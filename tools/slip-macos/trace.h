@@ -0,0 +1,32 @@
+// Packet capture and flow tracing for the SLIP bridge.
+//
+// The event loop hands every IP packet to trace_packet(), which copies it
+// into a single producer, single consumer ring and returns; it never
+// blocks or takes a lock. A writer thread empties the ring into a pcapng
+// file (LINKTYPE_RAW, microsecond timestamps, direction flags) and/or a
+// Chrome trace JSON file (chrome://tracing or ui.perfetto.dev) with, per
+// TCP flow, the time from each request to the first byte of its answer,
+// each segment from sent to acknowledged, and retransmissions.
+// Packets are dropped, and counted, if the ring is full.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_TO_DEVICE 0
+#define TRACE_FROM_DEVICE 1
+
+// Packets the ring holds
+#define TRACE_RING_SIZE 1024
+// Bytes kept of each packet
+#define TRACE_SNAPLEN 1500
+
+// Either path may be NULL. Returns 0, or -1 if a file can't be opened.
+int trace_open(const char *pcap_path, const char *json_path);
+void trace_packet(int dir, const unsigned char *ip, int len);
+// Write out what's queued and close the files
+void trace_close(void);
+
+extern int trace_enabled;
+extern unsigned long trace_dropped;
+
+#endif // TRACE_H
@@ -0,0 +1,411 @@
+//------------------------------------------------------------------------------
+//       Filename: slipbench.c
+//------------------------------------------------------------------------------
+//       Bogdan Ionescu (c) 2025
+//------------------------------------------------------------------------------
+//       Purpose : Microbenchmark for the SLIP transmit encoder
+//------------------------------------------------------------------------------
+//       Notes : Runs slipdev_send() from lib/uip/slipdev.c against the old
+//               byte at a time encoder, on random, JPEG and all-escape
+//               payloads, and reports cycles per payload byte and the
+//               size on the wire. Built with COBS=1 both encoders use
+//               COBS framing instead, and the worst case is all zeros.
+//               The output goes into a frame sized buffer, the way the
+//               semihosting link gathers it. Both encoders must produce
+//               the same bytes, or the run fails.
+//               Built for the host (make) or the target (make target),
+//               where it counts core cycles with SysTick and prints over
+//               semihosting.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module includes
+//------------------------------------------------------------------------------
+#include "slipdev.h"
+#include "uip.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(HOST)
+#include "system.h"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// The JPEG served by httpd, from flash on the target
+#include "fsdata.h"
+#include "fsdata.c"
+
+//------------------------------------------------------------------------------
+// Module constant defines
+//------------------------------------------------------------------------------
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+#define COBS_MAX_CODE 0xFF
+
+// uIP sends the first 40 bytes from uip_buf and the rest from uip_appdata
+#define HEADER_SIZE  (40)
+#define PAYLOAD_SIZE (UIP_BUFSIZE - HEADER_SIZE)
+
+// Same as the old slip_tx_buf, one encoded full size frame
+#define SINK_SIZE (UIP_BUFSIZE + 64)
+
+#if defined(HOST)
+#define ROUNDS (2000)
+#else
+#define ROUNDS (16)
+#endif
+
+#if !defined(HOST)
+#define CYCLE_UNIT "cycles"
+#elif defined(__x86_64__) || defined(__i386__)
+#define CYCLE_UNIT "tsc"
+#else
+#define CYCLE_UNIT "ns"
+#endif
+
+//------------------------------------------------------------------------------
+// External variables
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// External functions
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Module type definitions
+//------------------------------------------------------------------------------
+typedef void (*send_fn_t)(void);
+
+typedef struct
+{
+    const char *name;
+    const u8_t *data;
+    uint32_t size;
+} payload_t;
+
+//------------------------------------------------------------------------------
+// Module static variables
+//------------------------------------------------------------------------------
+// What slipdev.c expects from uip.c, which isn't linked in
+u8_t uip_buf[UIP_BUFSIZE + 2];
+volatile u8_t *uip_appdata;
+volatile u16_t uip_len;
+
+static u8_t s_random[PAYLOAD_SIZE];
+static u8_t s_escapes[PAYLOAD_SIZE];
+
+static u8_t s_sink[SINK_SIZE];
+static uint32_t s_sinkLen = 0;
+static uint32_t s_sinkHash = 0;
+static uint32_t s_wireBytes = 0;
+static int s_hashing = 0;
+
+#if !defined(HOST)
+static volatile uint32_t s_ticks = 0;
+#endif
+
+//------------------------------------------------------------------------------
+// Module static function prototypes
+//------------------------------------------------------------------------------
+static void BENCH_ReferenceSend(void);
+static uint32_t BENCH_Cycles(void);
+static void BENCH_SinkFlush(void);
+static uint32_t BENCH_Send(const payload_t *payload, send_fn_t send, uint32_t *bytes);
+static uint32_t BENCH_Run(const payload_t *payload, send_fn_t send, uint32_t *hash,
+                          uint32_t *wire);
+
+//------------------------------------------------------------------------------
+// Module externally exported functions
+//------------------------------------------------------------------------------
+
+int main(void)
+{
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < sizeof(s_random); i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        s_random[i] = (u8_t)seed;
+    }
+    for (size_t i = 0; i < sizeof(s_escapes); i++)
+    {
+#if SLIP_COBS
+        s_escapes[i] = 0;
+#else
+        s_escapes[i] = (i & 1) ? SLIP_END : SLIP_ESC;
+#endif
+    }
+
+    const payload_t payloads[] = {
+        {"random", s_random, sizeof(s_random)},
+        {"jpeg", (const u8_t *)data_vapeserver_jpeg, sizeof(data_vapeserver_jpeg)},
+        {"escape", s_escapes, sizeof(s_escapes)},
+    };
+
+    int failed = 0;
+    printf("%-8s %8s %12s %12s %8s  (%s %s/byte, %d rounds)\n", "payload", "bytes", "reference",
+           "slipdev", "wire", SLIP_COBS ? "COBS" : "SLIP", CYCLE_UNIT, ROUNDS);
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++)
+    {
+        const payload_t *const p = &payloads[i];
+        uint32_t refHash;
+        uint32_t newHash;
+        uint32_t wire;
+        const uint32_t ref = BENCH_Run(p, BENCH_ReferenceSend, &refHash, &wire);
+        const uint32_t now = BENCH_Run(p, slipdev_send, &newHash, &wire);
+
+        // Fixed point, newlib-nano's printf has no floats
+        printf("%-8s %8lu %9lu.%02lu %9lu.%02lu %5lu.%01lu%%%s\n", p->name, (unsigned long)p->size,
+               (unsigned long)(ref / 100), (unsigned long)(ref % 100),
+               (unsigned long)(now / 100), (unsigned long)(now % 100),
+               (unsigned long)(wire / 10), (unsigned long)(wire % 10),
+               (refHash == newHash) ? "" : "  MISMATCH");
+        failed |= (refHash != newHash);
+    }
+
+    return failed;
+}
+
+// SLIP device hooks, see slipdev.h
+void slipdev_write(const u8_t *buf, u16_t len)
+{
+    if (s_sinkLen + len > SINK_SIZE)
+    {
+        BENCH_SinkFlush();
+    }
+    memcpy(&s_sink[s_sinkLen], buf, len);
+    s_sinkLen += len;
+    s_wireBytes += len;
+}
+
+void slipdev_flush(void)
+{
+    BENCH_SinkFlush();
+}
+
+u16_t slipdev_read(u8_t *buf, u16_t len)
+{
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+#if !defined(HOST)
+/**
+ * @brief  SysTick interrupt handler, counts milliseconds for BENCH_Cycles().
+ * @param  None
+ * @return None
+ */
+void SysTick_Handler(void)
+{
+    s_ticks++;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Module static functions
+//------------------------------------------------------------------------------
+
+#if SLIP_COBS
+/**
+ * @brief  A byte at a time COBS encoder, the textbook one.
+ * @param  None
+ * @return None
+ * @note   A frame that ends with a full block gets no empty block after
+ *         it, same as slipdev_send().
+ */
+static void BENCH_ReferenceSend(void)
+{
+    static u8_t cobs_tx_buf[SINK_SIZE];
+    const u8_t *ptr = uip_buf;
+    uint32_t pos = 0;
+    uint32_t codePos;
+    u8_t code = 1;
+
+    cobs_tx_buf[pos++] = 0;
+    codePos = pos++;
+    for (u16_t i = 0; i < uip_len; ++i)
+    {
+        if (i == HEADER_SIZE)
+        {
+            ptr = (const u8_t *)uip_appdata;
+        }
+        const u8_t c = *ptr++;
+        if (c == 0)
+        {
+            cobs_tx_buf[codePos] = code;
+            codePos = pos++;
+            code = 1;
+            continue;
+        }
+        cobs_tx_buf[pos++] = c;
+        if (++code == COBS_MAX_CODE && i + 1 < uip_len)
+        {
+            cobs_tx_buf[codePos] = code;
+            codePos = pos++;
+            code = 1;
+        }
+    }
+    cobs_tx_buf[codePos] = code;
+    cobs_tx_buf[pos++] = 0;
+    slipdev_write(cobs_tx_buf, pos);
+    slipdev_flush();
+}
+#else
+/**
+ * @brief  The byte at a time encoder slipdev_send() used to be.
+ * @param  None
+ * @return None
+ */
+static void BENCH_ReferenceSend(void)
+{
+    static u8_t slip_tx_buf[SINK_SIZE];
+    const u8_t *ptr = uip_buf;
+    uint32_t pos = 0;
+
+    slip_tx_buf[pos++] = SLIP_END;
+    for (u16_t i = 0; i < uip_len; ++i)
+    {
+        if (i == HEADER_SIZE)
+        {
+            ptr = (const u8_t *)uip_appdata;
+        }
+        const u8_t c = *ptr++;
+        switch (c)
+        {
+            case SLIP_END:
+                slip_tx_buf[pos++] = SLIP_ESC;
+                slip_tx_buf[pos++] = SLIP_ESC_END;
+                break;
+            case SLIP_ESC:
+                slip_tx_buf[pos++] = SLIP_ESC;
+                slip_tx_buf[pos++] = SLIP_ESC_ESC;
+                break;
+            default:
+                slip_tx_buf[pos++] = c;
+                break;
+        }
+        if (pos >= SINK_SIZE - 2)
+        {
+            slipdev_write(slip_tx_buf, pos);
+            pos = 0;
+        }
+    }
+    slip_tx_buf[pos++] = SLIP_END;
+    slipdev_write(slip_tx_buf, pos);
+    slipdev_flush();
+}
+#endif
+
+/**
+ * @brief  Read the cycle counter.
+ * @param  None
+ * @return Core cycles on the target, TSC ticks or nanoseconds on the host.
+ */
+static uint32_t BENCH_Cycles(void)
+{
+#if !defined(HOST)
+    uint32_t ms;
+    uint32_t val;
+    do
+    {
+        ms = s_ticks;
+        val = SysTick->VAL;
+    } while (ms != s_ticks);
+    return ms * (SysTick->LOAD + 1) + (SysTick->LOAD - val);
+#elif defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+/**
+ * @brief  Drop whatever the encoder has written, hashing it when checking.
+ * @param  None
+ * @return None
+ */
+static void BENCH_SinkFlush(void)
+{
+    if (s_hashing)
+    {
+        for (uint32_t i = 0; i < s_sinkLen; i++)
+        {
+            s_sinkHash = (s_sinkHash ^ s_sink[i]) * 16777619UL;
+        }
+    }
+    s_sinkLen = 0;
+}
+
+/**
+ * @brief  Send a payload as uIP would, in full size frames.
+ * @param  payload - data to send
+ * @param  send - encoder to use
+ * @param  bytes - set to the number of packet bytes sent
+ * @return Cycles spent in the encoder.
+ * @note   Every frame gets the first bytes of the payload as its header.
+ */
+static uint32_t BENCH_Send(const payload_t *payload, send_fn_t send, uint32_t *bytes)
+{
+    uint32_t cycles = 0;
+
+    memcpy(uip_buf, payload->data, HEADER_SIZE);
+    *bytes = 0;
+    for (uint32_t off = 0; off < payload->size; off += PAYLOAD_SIZE)
+    {
+        const uint32_t left = payload->size - off;
+        // Read in place, from flash for the JPEG
+        uip_appdata = (u8_t *)&payload->data[off];
+        uip_len = HEADER_SIZE + ((left < PAYLOAD_SIZE) ? left : PAYLOAD_SIZE);
+        *bytes += uip_len;
+
+        const uint32_t start = BENCH_Cycles();
+        send();
+        cycles += BENCH_Cycles() - start;
+    }
+    return cycles;
+}
+
+/**
+ * @brief  Time an encoder on a payload.
+ * @param  payload - data to send
+ * @param  send - encoder to time
+ * @param  hash - set to the hash of the encoded stream
+ * @param  wire - set to the encoded size, in tenths of a percent of the packet bytes
+ * @return Cycles per packet byte, times 100.
+ */
+static uint32_t BENCH_Run(const payload_t *payload, send_fn_t send, uint32_t *hash,
+                          uint32_t *wire)
+{
+    uint32_t bytes;
+
+    // One pass to check the output, then the timed ones without hashing
+    s_hashing = 1;
+    s_sinkHash = 2166136261UL;
+    s_wireBytes = 0;
+    (void)BENCH_Send(payload, send, &bytes);
+    *hash = s_sinkHash;
+    *wire = s_wireBytes * 1000 / bytes;
+    s_hashing = 0;
+
+    uint64_t cycles = 0;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        cycles += BENCH_Send(payload, send, &bytes);
+    }
+    return (uint32_t)(cycles * 100 / ((uint64_t)bytes * ROUNDS));
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------